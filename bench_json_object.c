@@ -0,0 +1,613 @@
+#define _POSIX_C_SOURCE 200809L
+#include "libjson.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define BENCH_KEYS 100000
+
+/* only for bench, the key hash of the library */
+uint64_t key_hash_str(const char *str, size_t len);
+
+/* only for bench */
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* only for bench */
+static void bench_report(const char *name, long ops, double sec)
+{
+    printf("%-36s %10ld ops %10.3f ms %12.0f ops/s\n",
+        name, ops, sec * 1e3, ops / sec);
+}
+
+/*
+ * session table churn: keep a sliding window of live keys, expiring
+ * the oldest key and adding a new one at each step
+ */
+void bench_json_object_delete_churn(void)
+{
+    int i;
+    char key[32];
+    double t;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    for (i = 0; i < BENCH_KEYS; i++) {
+        sprintf(key, "session-%08d", i);
+        json_obj->add_num(json_obj, key, i);
+    }
+
+    t = now_sec();
+    for (i = 0; i < 4 * BENCH_KEYS; i++) {
+        sprintf(key, "session-%08d", i);
+        json_obj->del(json_obj, key);
+        sprintf(key, "session-%08d", i + BENCH_KEYS);
+        json_obj->add_num(json_obj, key, i);
+    }
+    bench_report("object delete churn (del+add)", 4L * BENCH_KEYS, now_sec() - t);
+
+    FREE_JSON(json_obj);
+}
+
+/* drain a full table, deleting keys in insertion order */
+void bench_json_object_delete_all(void)
+{
+    int i;
+    char key[32];
+    double t;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    for (i = 0; i < BENCH_KEYS; i++) {
+        sprintf(key, "k%d", i);
+        json_obj->add_null(json_obj, key);
+    }
+
+    t = now_sec();
+    for (i = 0; i < BENCH_KEYS; i++) {
+        sprintf(key, "k%d", i);
+        json_obj->del(json_obj, key);
+    }
+    bench_report("object delete all", BENCH_KEYS, now_sec() - t);
+
+    FREE_JSON(json_obj);
+}
+
+/* read one field of many records of the same shape, by string and by handle */
+void bench_json_object_get_by_key_handle(void)
+{
+    int i, j, sum;
+    double t;
+    JSONKey k;
+    JSONObject* json_objs[100];
+
+    for (i = 0; i < 100; i++) {
+        json_objs[i] = JSON_OBJECT_PTR();
+        json_objs[i]->add_num(json_objs[i], "id", i);
+        json_objs[i]->add_str(json_objs[i], "name", "user");
+        json_objs[i]->add_num(json_objs[i], "user_id", i);
+        json_objs[i]->add_true(json_objs[i], "active");
+    }
+
+    sum = 0;
+    t = now_sec();
+    for (j = 0; j < BENCH_KEYS / 10; j++) {
+        for (i = 0; i < 100; i++) {
+            sum += json_objs[i]->get_num(json_objs[i], "user_id");
+        }
+    }
+    bench_report("object get_num by string", 10L * BENCH_KEYS, now_sec() - t);
+
+    k = JSON_KEY("user_id");
+    t = now_sec();
+    for (j = 0; j < BENCH_KEYS / 10; j++) {
+        for (i = 0; i < 100; i++) {
+            sum -= json_objs[i]->get_num_k(json_objs[i], k);
+        }
+    }
+    bench_report("object get_num by key handle", 10L * BENCH_KEYS, now_sec() - t);
+    FREE_JSON_KEY(k);
+
+    for (i = 0; i < 100; i++) {
+        FREE_JSON(json_objs[i]);
+    }
+    if (sum) {
+        printf("unexpected sum %d\n", sum);
+    }
+}
+
+/* only for bench, the byte-at-a-time FNV-1a hash used before */
+static uint64_t fnv1a(const char *key, size_t len)
+{
+    uint64_t hash = 14695981039346656037UL;
+    const unsigned char *p = (const unsigned char *)key;
+    const unsigned char *e = p + len;
+
+    for (; p != e; p++) {
+        hash ^= (uint64_t)*p;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+/* only for bench, the I-th key of a key-length distribution */
+static void bench_key(char *key, int dist, int i)
+{
+    switch (dist) {
+    case 0: /* short field names */
+        sprintf(key, "f%d", i);
+        break;
+    case 1: /* uuids */
+        sprintf(key, "%08x-1f2e-4d3c-8b7a-%012x", i * 2654435761u, i);
+        break;
+    default: /* urls */
+        sprintf(key, "https://api.example.com/v2/accounts/%d/orders/%08d?expand=items", i % 97, i);
+        break;
+    }
+}
+
+static const char *g_bench_dists[] = { "short", "uuid", "url" };
+
+/* raw hash throughput, old FNV-1a against the seeded hash */
+void bench_key_hash(void)
+{
+    int d, i, j;
+    size_t len;
+    char key[128], name[64];
+    uint64_t sink = 0;
+    double t;
+
+    for (d = 0; d < 3; d++) {
+        bench_key(key, d, 12345);
+        len = strlen(key);
+
+        t = now_sec();
+        for (i = 0; i < 10 * BENCH_KEYS; i++) {
+            key[0] = (char)i;
+            for (j = 0; j < 10; j++) {
+                sink += fnv1a(key, len);
+            }
+        }
+        sprintf(name, "hash fnv1a %s (%zu B)", g_bench_dists[d], len);
+        bench_report(name, 100L * BENCH_KEYS, now_sec() - t);
+
+        t = now_sec();
+        for (i = 0; i < 10 * BENCH_KEYS; i++) {
+            key[0] = (char)i;
+            for (j = 0; j < 10; j++) {
+                sink += key_hash_str(key, len);
+            }
+        }
+        sprintf(name, "hash seeded %s (%zu B)", g_bench_dists[d], len);
+        bench_report(name, 100L * BENCH_KEYS, now_sec() - t);
+    }
+    if (0 == sink) {
+        printf("unexpected hash sink\n");
+    }
+}
+
+/* object insert and lookup throughput by key-length distribution */
+void bench_json_object_key_lengths(void)
+{
+    int d, i, sum;
+    char key[128], name[64];
+    double t;
+    JSONObject* json_obj;
+
+    for (d = 0; d < 3; d++) {
+        json_obj = JSON_OBJECT_PTR();
+        t = now_sec();
+        for (i = 0; i < BENCH_KEYS; i++) {
+            bench_key(key, d, i);
+            json_obj->add_num(json_obj, key, i);
+        }
+        sprintf(name, "object insert %s keys", g_bench_dists[d]);
+        bench_report(name, BENCH_KEYS, now_sec() - t);
+
+        sum = 0;
+        t = now_sec();
+        for (i = 0; i < BENCH_KEYS; i++) {
+            bench_key(key, d, i);
+            sum += json_obj->get_num(json_obj, key) == i;
+        }
+        sprintf(name, "object lookup %s keys", g_bench_dists[d]);
+        bench_report(name, BENCH_KEYS, now_sec() - t);
+        if (sum != BENCH_KEYS) {
+            printf("unexpected lookup count %d\n", sum);
+        }
+        FREE_JSON(json_obj);
+    }
+}
+
+/* only for bench, build and free small documents */
+static void *bench_build_docs(void *arg)
+{
+    int i, j;
+    char key[16];
+    JSONObject* json_obj;
+    JSONArray* json_arr;
+
+    for (i = 0; i < BENCH_KEYS / 10; i++) {
+        json_obj = JSON_OBJECT_PTR();
+        json_arr = JSON_ARRAY_PTR();
+        for (j = 0; j < 8; j++) {
+            sprintf(key, "field%d", j);
+            json_obj->add_num(json_obj, key, j);
+            json_arr->add_num(json_arr, -1, j);
+        }
+        json_obj->add_move(json_obj, "items", json_arr);
+        FREE_JSON(json_arr);
+        FREE_JSON(json_obj);
+    }
+    return NULL;
+}
+
+/* documents built at once by several threads */
+void bench_json_build_threads(void)
+{
+    int i, n;
+    double t;
+    char name[64];
+    pthread_t threads[8];
+
+    for (n = 1; n <= 8; n <<= 1) {
+        t = now_sec();
+        for (i = 0; i < n; i++) {
+            pthread_create(&threads[i], NULL, bench_build_docs, NULL);
+        }
+        for (i = 0; i < n; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        sprintf(name, "build docs in %d threads", n);
+        bench_report(name, (long)n * BENCH_KEYS / 10, now_sec() - t);
+    }
+}
+
+/* many small records, as class instances and as compact handles */
+void bench_json_object_handles(void)
+{
+    int i, sum;
+    double t;
+    JSONObject** json_objs;
+    JSON* json_hdls;
+
+    json_objs = malloc(BENCH_KEYS * sizeof *json_objs);
+    json_hdls = malloc(BENCH_KEYS * sizeof *json_hdls);
+
+    t = now_sec();
+    for (i = 0; i < BENCH_KEYS; i++) {
+        json_objs[i] = JSON_OBJECT_PTR();
+        json_objs[i]->add_num(json_objs[i], "id", i);
+    }
+    bench_report("create class objects", BENCH_KEYS, now_sec() - t);
+
+    t = now_sec();
+    for (i = 0; i < BENCH_KEYS; i++) {
+        json_hdls[i] = JSON_OBJECT_HANDLE();
+        json_obj_add_num(&json_hdls[i], "id", i);
+    }
+    bench_report("create object handles", BENCH_KEYS, now_sec() - t);
+
+    sum = 0;
+    t = now_sec();
+    for (i = 0; i < BENCH_KEYS; i++) {
+        sum += json_objs[i]->get_num(json_objs[i], "id");
+    }
+    bench_report("get_num of class objects", BENCH_KEYS, now_sec() - t);
+
+    t = now_sec();
+    for (i = 0; i < BENCH_KEYS; i++) {
+        sum -= json_obj_get_num(&json_hdls[i], "id");
+    }
+    bench_report("get_num of object handles", BENCH_KEYS, now_sec() - t);
+    printf("%-36s %10zu B %10zu B\n", "size of class object and handle",
+        sizeof(JSONObject), sizeof(JSON));
+
+    for (i = 0; i < BENCH_KEYS; i++) {
+        FREE_JSON(json_objs[i]);
+        FREE_JSON_DATA(&json_hdls[i]);
+    }
+    free(json_objs);
+    free(json_hdls);
+    if (sum) {
+        printf("unexpected sum %d\n", sum);
+    }
+}
+
+/* lookups in a read-mostly document, before and after freezing it */
+void bench_json_object_frozen(void)
+{
+    int i, j, sum;
+    char key[32];
+    char (*keys)[32];
+    double t;
+    JSONMemoryStats st;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    keys = malloc(BENCH_KEYS * sizeof *keys);
+    for (i = 0; i < BENCH_KEYS; i++) {
+        sprintf(keys[i], "config.%d", (int)((i * 2654435761u) % BENCH_KEYS));
+        sprintf(key, "config.%d", i);
+        json_obj->add_num(json_obj, key, i);
+    }
+
+    for (j = 0; j < 2; j++) {
+        sum = 0;
+        t = now_sec();
+        for (i = 0; i < 10 * BENCH_KEYS; i++) {
+            sum += json_obj->get_num(json_obj, keys[i % BENCH_KEYS]);
+        }
+        bench_report(j ? "object lookup frozen" : "object lookup hashed",
+            10L * BENCH_KEYS, now_sec() - t);
+        JSON_MEMORY_USAGE(json_obj, &st);
+        printf("%-36s %10zu B\n", j ? "object entries frozen" : "object entries hashed",
+            st.entries);
+        if (0 == j) {
+            t = now_sec();
+            JSON_FREEZE(json_obj);
+            bench_report("object freeze", BENCH_KEYS, now_sec() - t);
+        }
+    }
+
+    FREE_JSON(json_obj);
+    free(keys);
+    if (0 == sum) {
+        printf("unexpected sum %d\n", sum);
+    }
+}
+
+/* read 16 fields of each record from a large object, one by one and batched */
+void bench_json_object_get_many(void)
+{
+    int i, j, sum, sum2;
+    char key[32];
+    char (*keys)[32];
+    const char *fields[16];
+    JSON vals[16];
+    double t;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    keys = malloc(10 * BENCH_KEYS * sizeof *keys);
+    for (i = 0; i < 10 * BENCH_KEYS; i++) {
+        sprintf(keys[i], "field.%d", (int)((i * 2654435761u) % (10 * BENCH_KEYS)));
+        sprintf(key, "field.%d", i);
+        json_obj->add_num(json_obj, key, i);
+    }
+
+    sum = 0;
+    t = now_sec();
+    for (i = 0; i < 10 * BENCH_KEYS; i += 16) {
+        for (j = 0; j < 16; j++) {
+            sum += json_obj->get_num(json_obj, keys[i + j]);
+        }
+    }
+    bench_report("object get_num per field", 10L * BENCH_KEYS, now_sec() - t);
+
+    sum2 = 0;
+    t = now_sec();
+    for (i = 0; i < 10 * BENCH_KEYS; i += 16) {
+        for (j = 0; j < 16; j++) {
+            fields[j] = keys[i + j];
+        }
+        json_obj->get_many(json_obj, fields, 16, vals);
+        for (j = 0; j < 16; j++) {
+            sum2 += *(int *)vals[j].data;
+        }
+    }
+    bench_report("object get_many of 16 fields", 10L * BENCH_KEYS, now_sec() - t);
+
+    FREE_JSON(json_obj);
+    free(keys);
+    if (sum != sum2) {
+        printf("unexpected sum %d\n", sum2);
+    }
+}
+
+/* sum the numbers of a document by recursion over iterators */
+static long long bench_iter_sum(const JSON *v)
+{
+    long long sum = 0;
+    JSONObjectIter oiter, oend;
+    JSONArrayIter aiter, aend;
+
+    if (JSON_TYPE_NUMBER == v->type) {
+        return *(int *)v->data;
+    } else if (JSON_TYPE_OBJECT == v->type) {
+        oiter = json_obj_begin(v);
+        oend = json_obj_end(v);
+        JSON_OBJECT_FOREACH(oiter, oend) {
+            sum += bench_iter_sum(&oiter.value);
+        }
+    } else if (JSON_TYPE_ARRAY == v->type) {
+        aiter = json_arr_begin(v);
+        aend = json_arr_end(v);
+        JSON_ARRAY_FOREACH(aiter, aend) {
+            sum += bench_iter_sum(&aiter.value);
+        }
+    }
+    return sum;
+}
+
+static int bench_walk_scalar(const JSON *val, const JSONWalkPos *pos, void *ctx)
+{
+    if (JSON_TYPE_NUMBER == val->type) {
+        *(long long *)ctx += *(int *)val->data;
+    }
+    return JSON_WALK_CONTINUE;
+}
+
+/* scan a document of many records, by iterators and by json_walk */
+void bench_json_walk(void)
+{
+    int i;
+    long long sum, sum2 = 0;
+    double t;
+    JSONVisitor visitor = { NULL, NULL, bench_walk_scalar };
+    JSONArray* json_arr = JSON_ARRAY_PTR();
+    JSONObject* json_obj;
+
+    for (i = 0; i < BENCH_KEYS; i++) {
+        json_obj = JSON_OBJECT_PTR();
+        json_obj->add_num(json_obj, "id", i);
+        json_obj->add_str(json_obj, "name", "record");
+        json_obj->add_num(json_obj, "a", 1);
+        json_obj->add_num(json_obj, "b", 2);
+        json_obj->add_true(json_obj, "ok");
+        json_obj->add_null(json_obj, "c");
+        json_arr->add_move(json_arr, -1, json_obj);
+        FREE_JSON(json_obj);
+    }
+
+    t = now_sec();
+    sum = bench_iter_sum((JSON *)json_arr);
+    bench_report("document scan by iterators", BENCH_KEYS, now_sec() - t);
+
+    t = now_sec();
+    JSON_WALK(json_arr, &visitor, &sum2);
+    bench_report("document scan by walk", BENCH_KEYS, now_sec() - t);
+
+    FREE_JSON(json_arr);
+    if (sum != sum2) {
+        printf("unexpected sum %lld\n", sum2);
+    }
+}
+
+/* sync a small change of a large document: full stringify against diff and patch */
+void bench_json_diff(void)
+{
+    int i, j, len;
+    char key[32];
+    char *str = NULL;
+    double t;
+    JSONArray* patch;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONObject* json_copy;
+    JSONObject* json_sec;
+
+    for (i = 0; i < BENCH_KEYS / 100; i++) {
+        json_sec = JSON_OBJECT_PTR();
+        for (j = 0; j < 100; j++) {
+            sprintf(key, "option.%d", j);
+            json_sec->add_num(json_sec, key, j);
+        }
+        sprintf(key, "section.%d", i);
+        json_obj->add_move(json_obj, key, json_sec);
+        FREE_JSON(json_sec);
+    }
+    json_copy = JSON_OBJECT_COPY_PTR(json_obj);
+    json_sec = json_copy->get(json_copy, "section.7", JSON_OBJECT_PTR());
+    json_sec->set_num(json_sec, "option.7", -1);
+    json_copy->set(json_copy, "section.7", json_sec);
+
+    t = now_sec();
+    JSON_STRINGIFY(json_copy, &str, &len);
+    bench_report("document stringify", BENCH_KEYS, now_sec() - t);
+    printf("%-36s %10d B\n", "document text", len);
+    free(str);
+
+    t = now_sec();
+    patch = JSON_DIFF(json_obj, json_copy);
+    bench_report("document diff", BENCH_KEYS, now_sec() - t);
+    str = NULL;
+    JSON_STRINGIFY(patch, &str, &len);
+    printf("%-36s %10d B\n", "patch text", len);
+    free(str);
+
+    t = now_sec();
+    JSON_PATCH_APPLY(json_obj, patch);
+    bench_report("patch apply", BENCH_KEYS, now_sec() - t);
+    if (json_obj->get_type(json_obj, "section.7") != JSON_TYPE_OBJECT) {
+        printf("unexpected patch result\n");
+    }
+
+    FREE_JSON(patch);
+    FREE_JSON(json_sec);
+    FREE_JSON(json_copy);
+    FREE_JSON(json_obj);
+}
+
+/* sum of a large array of numbers, by iterator and by the aggregate */
+void bench_json_array_sum(void)
+{
+    int i;
+    long long sum, sum2;
+    double t;
+    JSONArrayIter iter, end;
+    JSONArray* json_arr = JSON_ARRAY_PTR();
+
+    for (i = 0; i < 10 * BENCH_KEYS; i++) {
+        json_arr->add_num(json_arr, -1, i);
+    }
+
+    sum = 0;
+    t = now_sec();
+    iter = json_arr->begin(json_arr);
+    end = json_arr->end(json_arr);
+    JSON_ARRAY_FOREACH(iter, end) {
+        sum += *(int *)iter.value.data;
+    }
+    bench_report("array sum by iterator", 10L * BENCH_KEYS, now_sec() - t);
+
+    t = now_sec();
+    sum2 = json_arr->sum(json_arr);
+    bench_report("array sum", 10L * BENCH_KEYS, now_sec() - t);
+
+    FREE_JSON(json_arr);
+    if (sum != sum2) {
+        printf("unexpected sum %lld\n", sum2);
+    }
+}
+
+/* sort a large array, sorted input included, in one and several threads */
+void bench_json_array_sort(void)
+{
+    int i, j;
+    double t;
+    static const char *names[3] = { "array sort", "array sort stable", "array sort parallel" };
+    static const int flags[3] = { 0, JSON_SORT_STABLE, JSON_SORT_PARALLEL };
+    JSONArray* json_arr;
+
+    for (j = 0; j < 3; j++) {
+        json_arr = JSON_ARRAY_PTR();
+        srand(1);
+        for (i = 0; i < 10 * BENCH_KEYS; i++) {
+            json_arr->add_num(json_arr, -1, rand());
+        }
+        t = now_sec();
+        json_arr->sort_with(json_arr, json_cmp_num, flags[j]);
+        bench_report(names[j], 10L * BENCH_KEYS, now_sec() - t);
+        FREE_JSON(json_arr);
+    }
+
+    json_arr = JSON_ARRAY_PTR();
+    for (i = 0; i < 10 * BENCH_KEYS; i++) {
+        json_arr->add_num(json_arr, -1, i);
+    }
+    t = now_sec();
+    json_arr->sort(json_arr, json_cmp_num);
+    bench_report("array sort sorted input", 10L * BENCH_KEYS, now_sec() - t);
+    FREE_JSON(json_arr);
+}
+
+int main(int argc, char* argv[])
+{
+    bench_json_object_delete_churn();
+    bench_json_object_delete_all();
+    bench_json_object_get_by_key_handle();
+    bench_key_hash();
+    bench_json_object_key_lengths();
+    bench_json_build_threads();
+    bench_json_object_handles();
+    bench_json_object_frozen();
+    bench_json_object_get_many();
+    bench_json_walk();
+    bench_json_diff();
+    bench_json_array_sum();
+    bench_json_array_sort();
+    return 0;
+}
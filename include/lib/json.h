@@ -13,6 +13,12 @@ enum {
     JSON_TYPE_NULL
 };
 
+/* flags of sort_with and sort_by */
+enum {
+    JSON_SORT_STABLE = 1,   /* equal items keep their order */
+    JSON_SORT_PARALLEL = 2  /* sort a large array in several threads */
+};
+
 /*
  *  JSON class
  *  All classes in json_impl.h are based on it.
@@ -31,6 +37,31 @@ struct klass {           \
 }
 JSONClass(JSON);
 
+#include <stddef.h>
+
+/*
+ *  Memory usage of a document, in bytes requested by the library
+ *
+ *  @keys: interned key records, counted at each use
+ *  @strings: string payloads
+ *  @entries: hash table entries, empty slots included
+ *  @nodes: list nodes, sentinels and reserved nodes included
+ *  @numbers: number cells and buffers of packed arrays
+ *  @headers: hash table and list headers
+ *  @total: sum of all above
+ *
+ *  Subtrees shared by copies are counted in every document using them.
+ */
+typedef struct JSONMemoryStats {
+    size_t keys;
+    size_t strings;
+    size_t entries;
+    size_t nodes;
+    size_t numbers;
+    size_t headers;
+    size_t total;
+} JSONMemoryStats;
+
 /* private */
 void json_copy(JSON *dst, const JSON *src);
 
@@ -40,5 +71,10 @@ int json_free(void *json);
 void json_free_data(JSON *json);
 int json_stringify(const void *json, char **pstr, int *plen);
 int json_parse(const char *str, void *json);
+int json_memory_usage(const void *json, JSONMemoryStats *stats);
+int json_compact(void *json);
+int json_freeze(void *json);
+int json_is_frozen(const void *json);
+JSON json_handle_copy(const void *src);
 
 #endif
\ No newline at end of file
@@ -6,6 +6,12 @@
 #include "lib/json.h"
 
 #define DEFAULT_CAPACITY 16
+/*
+ * tables up to this capacity keep their entries inline, packed in
+ * insertion order and looked up by a linear scan
+ */
+#define HTAB_SMALL_CAPACITY 8
+#define htab_is_small(h) ((h)->capacity <= HTAB_SMALL_CAPACITY)
 
 typedef struct JSONEntry JSONEntry;
 typedef struct JSONHashTable JSONHashTable;
@@ -16,23 +22,52 @@ struct JSONEntry {
     uint64_t prev, next;
 };
 
+/*
+ * an insert that probes past this many slots rehashes the table under
+ * a seed of its own, so keys can't be made to pile up in one cluster
+ */
+#define HTAB_PROBE_LIMIT 128
+
 struct JSONHashTable {
     JSONEntry *entries;
     uint64_t capacity, size;
     uint64_t first, last;
+    uint64_t seed; /* 0: hash by the process seed stored with the key */
+    uint64_t max_probe; /* longest probe of an insert since last rehash */
+    uint64_t refcnt; /* copies sharing this table, see htab_unshare */
+    int block; /* slab class of the table itself */
+    int frozen; /* read-only, see htab_freeze */
+    uint32_t *disp; /* perfect hash of a frozen table: bucket displacements */
+    uint64_t nbuckets;
 };
 
 JSONHashTable *htab_create(uint64_t capacity);
 JSONHashTable *htab_create_copy(const JSONHashTable *src);
+JSONHashTable *htab_create_reserved(uint64_t n);
+void htab_reserve(JSONHashTable *htab, uint64_t n);
+void htab_shrink(JSONHashTable *htab);
+void htab_freeze(JSONHashTable *htab);
 void htab_free(JSONHashTable *htab);
+JSONHashTable *htab_retain(JSONHashTable *htab);
+JSONHashTable *htab_unshare(JSONHashTable *htab);
+unsigned long json_reseed_count(void);
 int htab_insert(JSONHashTable *htab, const char *key, const JSON *val);
 int htab_insert_ref(JSONHashTable *htab, const char *key, const JSON *val);
 int htab_erase(JSONHashTable *htab, const char *key);
 int htab_find(const JSONHashTable *htab, const char *key, JSON *val);
 int htab_find_ref(const JSONHashTable *htab, const char *key, JSON *val);
+const JSON *htab_view(const JSONHashTable *htab, const char *key);
+int htab_view_many(const JSONHashTable *htab, const char *const keys[], int n, JSON vals[]);
 int htab_update(JSONHashTable *htab, const char *key, const JSON *val);
 int htab_set(JSONHashTable *htab, const char *key, const JSON *val);
 int htab_set_ref(JSONHashTable *htab, const char *key, const JSON *val);
+/* lookup by a interned key from key_intern, compared by pointer only */
+int htab_erase_k(JSONHashTable *htab, const char *ikey);
+int htab_find_k(const JSONHashTable *htab, const char *ikey, JSON *val);
+int htab_find_ref_k(const JSONHashTable *htab, const char *ikey, JSON *val);
+const JSON *htab_view_k(const JSONHashTable *htab, const char *ikey);
+int htab_set_k(JSONHashTable *htab, const char *ikey, const JSON *val);
+int htab_set_ref_k(JSONHashTable *htab, const char *ikey, const JSON *val);
 
 /* define struct of iterator by type and name of data */
 typedef struct JSONHashTableIter {
@@ -6,6 +6,7 @@
 #include "lib/json.h"
 #include "lib/json_htab.h"
 #include "lib/json_list.h"
+#include "lib/json_key.h"
 
 typedef struct JSONObject JSONObject;
 typedef struct JSONString JSONString;
@@ -18,6 +19,33 @@ typedef struct JSON JSONNull;
 typedef JSONHashTableIter JSONObjectIter;
 typedef JSONLinkedListIter JSONArrayIter;
 
+/*
+ *  Columns of a array of objects, see arr_columnize
+ *
+ *  @key: a interned key, see JSON_KEY
+ *  @type: type of the column, decided by its first value that is not
+ *         null, JSON_TYPE_TRUE for booleans
+ *  @nums: values of a number or boolean column, booleans as 0 and 1
+ *  @strs: values of a string column, borrowed from the array
+ *  @nulls: a bitmap of rows without a value of <type>: not a object,
+ *          no <key>, null or another type, bit i % 8 of nulls[i / 8]
+ *
+ *  Columns of objects and arrays only have <nulls>.
+ */
+typedef struct JSONColumn {
+    JSONKey key;
+    int type;
+    int *nums;
+    const char **strs;
+    unsigned char *nulls;
+} JSONColumn;
+
+typedef struct JSONColumns {
+    int rows;
+    int ncols;
+    JSONColumn *cols;
+} JSONColumns;
+
 /*
  *  JSONObject class
  *
@@ -25,9 +53,37 @@ typedef JSONLinkedListIter JSONArrayIter;
  *  @set: set a <key-val> pair
  *  @delete: delete a <key-val> pair
  *  @get: get a <val>
+ *  @get_ref: get a borrowed <val>, see below
+ *  @get_type: get type of a <val>, 0 if <key> does not exist
+ *  @get_many: get borrowed <val>s of <n> keys at once, a missing one is
+ *             { NULL, 0 }, return the number found
+ *  @reserve: presize for at least <n> pairs
+ *  @shrink_to_fit: release slots not needed by its pairs, a table also
+ *                 shrinks by itself when deletes leave it 1/8 full
+ *  @*_k: same as above, by a key handle from json_key
  *  @begin: return a iterator to the 1st element
  *  @end: return a past-the-end iterator that points to the element
  *        following the last element of the JSONObject
+ *
+ *  add, set copy <val>. add_ref, set_ref take the data of <val>, which
+ *  still points to it and must not be freed. add_move, set_move take
+ *  the data of <val> and leave it with none: a moved-from handle may
+ *  only be freed or reassigned, any other call on it is an error.
+ *
+ *  get, get_str copy the value, which the caller owns and frees.
+ *  get_ref, get_str_ref and get_num make no copy: the value is borrowed
+ *  from the container, it must not be freed or modified, and it stays
+ *  valid only until the container is modified or freed: any add, set,
+ *  del or reserve may move it. So do the values of get_many and the
+ *  views made by json_pointer_get, json_path_eval and json_walk.
+ *  Reset the data of a view to NULL before passing it to get_ref again.
+ *
+ *  Objects and arrays are copied in O(1): copies share their data, and
+ *  a copy clones one level of it when it is modified.
+ *
+ *  json_freeze makes a document read-only, in a compact layout that
+ *  views taken before no longer point into. Modifiers of a frozen
+ *  object or array warn and leave it as it is; its copies are frozen.
  */
 /* constructor */
 JSONObject *obj_default_cstr();
@@ -36,10 +92,12 @@ JSONObject *obj_data_cstr(void *data);
 JSONObject obj_data(void *data);
 JSONObject *obj_copy_cstr(const void *src);
 JSONObject obj_copy(const void *src);
+JSON obj_handle(void);
 
 /* member functions */
 void obj_add(JSONObject *obj, const char *key, const void *val);
 void obj_add_ref(JSONObject *obj, const char *key, const void *val);
+void obj_add_move(JSONObject *obj, const char *key, void *val);
 void obj_add_str(JSONObject *obj, const char *key, const char *val);
 void obj_add_num(JSONObject *obj, const char *key, int val);
 void obj_add_true(JSONObject *obj, const char *key);
@@ -48,6 +106,7 @@ void obj_add_null(JSONObject *obj, const char *key);
 void obj_del(JSONObject *obj, const char *key);
 void obj_set(JSONObject *obj, const char *key, const void *val);
 void obj_set_ref(JSONObject *obj, const char *key, const void *val);
+void obj_set_move(JSONObject *obj, const char *key, void *val);
 void obj_set_str(JSONObject *obj, const char *key, const char *val);
 void obj_set_num(JSONObject *obj, const char *key, int val);
 void obj_set_true(JSONObject *obj, const char *key);
@@ -58,6 +117,18 @@ void *obj_get_ref(const JSONObject *obj, const char *key, void *val);
 char *obj_get_str(const JSONObject *obj, const char *key);
 char *obj_get_str_ref(const JSONObject *obj, const char *key);
 int obj_get_num(const JSONObject *obj, const char *key);
+int obj_get_type(const JSONObject *obj, const char *key);
+int obj_get_many(const JSONObject *obj, const char *const keys[], int n, JSON vals[]);
+void obj_reserve(JSONObject *obj, int n);
+void obj_shrink_to_fit(JSONObject *obj);
+void obj_del_k(JSONObject *obj, JSONKey key);
+void obj_set_k(JSONObject *obj, JSONKey key, const void *val);
+void obj_set_str_k(JSONObject *obj, JSONKey key, const char *val);
+void obj_set_num_k(JSONObject *obj, JSONKey key, int val);
+void *obj_get_k(const JSONObject *obj, JSONKey key, void *val);
+void *obj_get_ref_k(const JSONObject *obj, JSONKey key, void *val);
+char *obj_get_str_ref_k(const JSONObject *obj, JSONKey key);
+int obj_get_num_k(const JSONObject *obj, JSONKey key);
 JSONObjectIter obj_begin(const JSONObject *obj);
 JSONObjectIter obj_end(const JSONObject *obj);
 JSONObjectIter obj_iterate(JSONObjectIter iter);
@@ -70,6 +141,7 @@ struct klass { \
     /* member functions */ \
     void (*add)(JSONObject *this, const char *key, const void *val); \
     void (*add_ref)(JSONObject *this, const char *key, const void *val); \
+    void (*add_move)(JSONObject *this, const char *key, void *val); \
     void (*add_str)(JSONObject *this, const char *key, const char *val); \
     void (*add_num)(JSONObject *this, const char *key, int val); \
     void (*add_true)(JSONObject *this, const char *key); \
@@ -78,6 +150,7 @@ struct klass { \
     void (*del)(JSONObject *this, const char *key); \
     void (*set)(JSONObject *this, const char *key, const void *val); \
     void (*set_ref)(JSONObject *this, const char *key, const void *val); \
+    void (*set_move)(JSONObject *this, const char *key, void *val); \
     void (*set_str)(JSONObject *this, const char *key, const char *val); \
     void (*set_num)(JSONObject *this, const char *key, int val); \
     void (*set_true)(JSONObject *this, const char *key); \
@@ -88,37 +161,63 @@ struct klass { \
     char *(*get_str)(const JSONObject *this, const char *key); \
     char *(*get_str_ref)(const JSONObject *this, const char *key); \
     int (*get_num)(const JSONObject *this, const char *key); \
+    int (*get_type)(const JSONObject *this, const char *key); \
+    int (*get_many)(const JSONObject *this, const char *const keys[], int n, JSON vals[]); \
+    void (*reserve)(JSONObject *this, int n); \
+    void (*shrink_to_fit)(JSONObject *this); \
+    void (*del_k)(JSONObject *this, JSONKey key); \
+    void (*set_k)(JSONObject *this, JSONKey key, const void *val); \
+    void (*set_str_k)(JSONObject *this, JSONKey key, const char *val); \
+    void (*set_num_k)(JSONObject *this, JSONKey key, int val); \
+    void *(*get_k)(const JSONObject *this, JSONKey key, void *val); \
+    void *(*get_ref_k)(const JSONObject *this, JSONKey key, void *val); \
+    char *(*get_str_ref_k)(const JSONObject *this, JSONKey key); \
+    int (*get_num_k)(const JSONObject *this, JSONKey key); \
     JSONObjectIter (*begin)(const JSONObject *this); \
     JSONObjectIter (*end)(const JSONObject *this); \
 }
 JSONObjectClass(JSONObject);
 
-#define JSON_OBJECT_CLASS(__ptr, __data)     \
-do {                                         \
-    (__ptr)->type = JSON_TYPE_OBJECT;        \
-    (__ptr)->data = __data;                  \
-    (__ptr)->add = obj_add;                  \
-    (__ptr)->add_ref = obj_add_ref;          \
-    (__ptr)->add_str = obj_add_str;          \
-    (__ptr)->add_num = obj_add_num;          \
-    (__ptr)->add_true = obj_add_true;        \
-    (__ptr)->add_false = obj_add_false;      \
-    (__ptr)->add_null = obj_add_null;        \
-    (__ptr)->del = obj_del;                  \
-    (__ptr)->set = obj_set;                  \
-    (__ptr)->set_ref = obj_set_ref;          \
-    (__ptr)->set_str = obj_set_str;          \
-    (__ptr)->set_num = obj_set_num;          \
-    (__ptr)->set_true = obj_set_true;        \
-    (__ptr)->set_false = obj_set_false;      \
-    (__ptr)->set_null = obj_set_null;        \
-    (__ptr)->get = obj_get;                  \
-    (__ptr)->get_ref = obj_get_ref;          \
-    (__ptr)->get_str = obj_get_str;          \
-    (__ptr)->get_str_ref = obj_get_str_ref;  \
-    (__ptr)->get_num = obj_get_num;          \
-    (__ptr)->begin = obj_begin;              \
-    (__ptr)->end = obj_end;                  \
+#define JSON_OBJECT_CLASS(__ptr, __data)        \
+do {                                            \
+    (__ptr)->type = JSON_TYPE_OBJECT;           \
+    (__ptr)->data = __data;                     \
+    (__ptr)->add = obj_add;                     \
+    (__ptr)->add_ref = obj_add_ref;             \
+    (__ptr)->add_move = obj_add_move;           \
+    (__ptr)->add_str = obj_add_str;             \
+    (__ptr)->add_num = obj_add_num;             \
+    (__ptr)->add_true = obj_add_true;           \
+    (__ptr)->add_false = obj_add_false;         \
+    (__ptr)->add_null = obj_add_null;           \
+    (__ptr)->del = obj_del;                     \
+    (__ptr)->set = obj_set;                     \
+    (__ptr)->set_ref = obj_set_ref;             \
+    (__ptr)->set_move = obj_set_move;           \
+    (__ptr)->set_str = obj_set_str;             \
+    (__ptr)->set_num = obj_set_num;             \
+    (__ptr)->set_true = obj_set_true;           \
+    (__ptr)->set_false = obj_set_false;         \
+    (__ptr)->set_null = obj_set_null;           \
+    (__ptr)->get = obj_get;                     \
+    (__ptr)->get_ref = obj_get_ref;             \
+    (__ptr)->get_str = obj_get_str;             \
+    (__ptr)->get_str_ref = obj_get_str_ref;     \
+    (__ptr)->get_num = obj_get_num;             \
+    (__ptr)->get_type = obj_get_type;           \
+    (__ptr)->get_many = obj_get_many;           \
+    (__ptr)->reserve = obj_reserve;             \
+    (__ptr)->shrink_to_fit = obj_shrink_to_fit; \
+    (__ptr)->del_k = obj_del_k;                 \
+    (__ptr)->set_k = obj_set_k;                 \
+    (__ptr)->set_str_k = obj_set_str_k;         \
+    (__ptr)->set_num_k = obj_set_num_k;         \
+    (__ptr)->get_k = obj_get_k;                 \
+    (__ptr)->get_ref_k = obj_get_ref_k;         \
+    (__ptr)->get_str_ref_k = obj_get_str_ref_k; \
+    (__ptr)->get_num_k = obj_get_num_k;         \
+    (__ptr)->begin = obj_begin;                 \
+    (__ptr)->end = obj_end;                     \
 } while(0)
 
 
@@ -126,7 +225,8 @@ do {                                         \
  *  JSONString class
  *
  *  @set: set
- *  @get: get
+ *  @get: get a copy
+ *  @get_ref: get borrowed chars, valid until next set or free
  */
 /* constructor */
 JSONString *str_assign_cstr(char *val);
@@ -135,10 +235,12 @@ JSONString *str_data_cstr(void *data);
 JSONString str_data(void *data);
 JSONString *str_copy_cstr(const void *src);
 JSONString str_copy(const void *src);
+JSON str_handle(const char *val);
 
 /* member functions */
 void str_set(JSONString *str, const char *val);
 char *str_get(const JSONString *str);
+char *str_get_ref(const JSONString *str);
 
 #define JSONStringClass(klass) \
 struct klass { \
@@ -146,6 +248,7 @@ struct klass { \
     JSONClass(); \
     void (*set)(JSONString *this, const char *val); \
     char *(*get)(const JSONString *this); \
+    char *(*get_ref)(const JSONString *this); \
 }
 JSONStringClass(JSONString);
 
@@ -155,6 +258,7 @@ do {                                         \
     (__ptr)->data = __data;                  \
     (__ptr)->set = str_set;                  \
     (__ptr)->get = str_get;                  \
+    (__ptr)->get_ref = str_get_ref;          \
 } while(0)
 
 
@@ -171,6 +275,7 @@ JSONNumber *num_data_cstr(void *data);
 JSONNumber num_data(void *data);
 JSONNumber *num_copy_cstr(const void *src);
 JSONNumber num_copy(const void *src);
+JSON num_handle(int val);
 
 /* member functions */
 void num_set(JSONNumber *num, int val);
@@ -201,6 +306,11 @@ do {                                         \
  *  @set: set a <val>
  *  @delete: delete a <val>
  *  @get: get a <val>
+ *  @get_ref: get a borrowed <val>, see JSONObject
+ *  @add_move, @set_move: take a <val>, see JSONObject
+ *  @get_type: get type of a <val>, 0 if <pos> is out of range
+ *  @reserve: presize for at least <n> items
+ *  @shrink_to_fit: release the nodes reserved for items to come
  *  @sort: sort all items by quick sort
  *  @begin: return a iterator to the first element
  *  @end: return a past-the-end iterator that points to the element following
@@ -216,9 +326,11 @@ JSONArray *arr_data_cstr(void *data);
 JSONArray arr_data(void *data);
 JSONArray *arr_copy_cstr(const void *src);
 JSONArray arr_copy(const void *src);
+JSON arr_handle(void);
 
 /* member functions */
 void arr_add(JSONArray *arr, int pos, const void *val);
+void arr_add_move(JSONArray *arr, int pos, void *val);
 void arr_add_str(JSONArray *arr, int pos, const char *val);
 void arr_add_num(JSONArray *arr, int pos, int val);
 void arr_add_true(JSONArray *arr, int pos);
@@ -226,15 +338,32 @@ void arr_add_false(JSONArray *arr, int pos);
 void arr_add_null(JSONArray *arr, int pos);
 void arr_del(JSONArray *arr, int pos);
 void arr_set(JSONArray *arr, int pos, const void *val);
+void arr_set_move(JSONArray *arr, int pos, void *val);
 void arr_set_str(JSONArray *arr, int pos, const char *val);
 void arr_set_num(JSONArray *arr, int pos, int val);
 void arr_set_true(JSONArray *arr, int pos);
 void arr_set_false(JSONArray *arr, int pos);
 void arr_set_null(JSONArray *arr, int pos);
 void *arr_get(const JSONArray *arr, int pos, void *val);
+void *arr_get_ref(const JSONArray *arr, int pos, void *val);
 char *arr_get_str(const JSONArray *arr, int pos);
+char *arr_get_str_ref(const JSONArray *arr, int pos);
 int arr_get_num(const JSONArray *arr, int pos);
+int arr_get_type(const JSONArray *arr, int pos);
+void arr_reserve(JSONArray *arr, int n);
+void arr_shrink_to_fit(JSONArray *arr);
 void arr_qsort(JSONArray *arr, int (*compare_fn)(const void*, const void*));
+void arr_sort_with(JSONArray *arr, int (*compare_fn)(const void*, const void*), int flags);
+void arr_sort_by(JSONArray *arr, const char *path, int flags);
+int json_cmp_num(const void *a, const void *b);
+int json_cmp_str(const void *a, const void *b);
+long long arr_sum(const JSONArray *arr);
+int arr_min(const JSONArray *arr);
+int arr_max(const JSONArray *arr);
+double arr_mean(const JSONArray *arr);
+int arr_count_if(const JSONArray *arr, int (*pred)(int val));
+JSONColumns *arr_columnize(const JSONArray *arr, const char *const keys[], int n);
+void json_columns_free(JSONColumns *cols);
 JSONArrayIter arr_begin(const JSONArray *arr);
 JSONArrayIter arr_end(const JSONArray *arr);
 JSONArrayIter arr_iterate(JSONArrayIter iter);
@@ -249,6 +378,7 @@ struct klass { \
 /* public */ \
     /* member functions */ \
     void (*add)(JSONArray *this, int pos, const void *val); \
+    void (*add_move)(JSONArray *this, int pos, void *val); \
     void (*add_str)(JSONArray *this, int pos, const char *val); \
     void (*add_num)(JSONArray *this, int pos, int val); \
     void (*add_true)(JSONArray *this, int pos); \
@@ -256,15 +386,29 @@ struct klass { \
     void (*add_null)(JSONArray *this, int pos); \
     void (*del)(JSONArray *this, int pos); \
     void (*set)(JSONArray *this, int pos, const void *val); \
+    void (*set_move)(JSONArray *this, int pos, void *val); \
     void (*set_str)(JSONArray *this, int pos, const char *val); \
     void (*set_num)(JSONArray *this, int pos, int val); \
     void (*set_true)(JSONArray *this, int pos); \
     void (*set_false)(JSONArray *this, int pos); \
     void (*set_null)(JSONArray *this, int pos); \
     void *(*get)(const JSONArray *this, int pos, void *val); \
+    void *(*get_ref)(const JSONArray *this, int pos, void *val); \
     char *(*get_str)(const JSONArray *this, int pos); \
+    char *(*get_str_ref)(const JSONArray *this, int pos); \
     int (*get_num)(const JSONArray *this, int pos); \
+    int (*get_type)(const JSONArray *this, int pos); \
+    void (*reserve)(JSONArray *this, int n); \
+    void (*shrink_to_fit)(JSONArray *this); \
     void (*sort)(JSONArray *this, int (*compare_fn)(const void*, const void*)); \
+    void (*sort_with)(JSONArray *this, int (*compare_fn)(const void*, const void*), int flags); \
+    void (*sort_by)(JSONArray *this, const char *path, int flags); \
+    long long (*sum)(const JSONArray *this); \
+    int (*min)(const JSONArray *this); \
+    int (*max)(const JSONArray *this); \
+    double (*mean)(const JSONArray *this); \
+    int (*count_if)(const JSONArray *this, int (*pred)(int val)); \
+    JSONColumns *(*columnize)(const JSONArray *this, const char *const keys[], int n); \
     JSONArrayIter (*begin)(const JSONArray *this); \
     JSONArrayIter (*end)(const JSONArray *this); \
     JSONArrayIter (*rbegin)(const JSONArray *this); \
@@ -272,31 +416,46 @@ struct klass { \
 }
 JSONArrayClass(JSONArray);
 
-#define JSON_ARRAY_CLASS(__ptr, __data)     \
-do {                                        \
-    (__ptr)->type = JSON_TYPE_ARRAY;        \
-    (__ptr)->data = __data;                 \
-    (__ptr)->add = arr_add;                 \
-    (__ptr)->add_str = arr_add_str;         \
-    (__ptr)->add_num = arr_add_num;         \
-    (__ptr)->add_true = arr_add_true;       \
-    (__ptr)->add_false = arr_add_false;     \
-    (__ptr)->add_null = arr_add_null;       \
-    (__ptr)->del = arr_del;                 \
-    (__ptr)->set = arr_set;                 \
-    (__ptr)->set_str = arr_set_str;         \
-    (__ptr)->set_num = arr_set_num;         \
-    (__ptr)->set_true = arr_set_true;       \
-    (__ptr)->set_false = arr_set_false;     \
-    (__ptr)->set_null = arr_set_null;       \
-    (__ptr)->get = arr_get;                 \
-    (__ptr)->get_str = arr_get_str;         \
-    (__ptr)->get_num = arr_get_num;         \
-    (__ptr)->sort = arr_qsort;              \
-    (__ptr)->begin = arr_begin;             \
-    (__ptr)->end = arr_end;                 \
-    (__ptr)->rbegin = arr_rbegin;           \
-    (__ptr)->rend = arr_rend;               \
+#define JSON_ARRAY_CLASS(__ptr, __data)         \
+do {                                            \
+    (__ptr)->type = JSON_TYPE_ARRAY;            \
+    (__ptr)->data = __data;                     \
+    (__ptr)->add = arr_add;                     \
+    (__ptr)->add_move = arr_add_move;           \
+    (__ptr)->add_str = arr_add_str;             \
+    (__ptr)->add_num = arr_add_num;             \
+    (__ptr)->add_true = arr_add_true;           \
+    (__ptr)->add_false = arr_add_false;         \
+    (__ptr)->add_null = arr_add_null;           \
+    (__ptr)->del = arr_del;                     \
+    (__ptr)->set = arr_set;                     \
+    (__ptr)->set_move = arr_set_move;           \
+    (__ptr)->set_str = arr_set_str;             \
+    (__ptr)->set_num = arr_set_num;             \
+    (__ptr)->set_true = arr_set_true;           \
+    (__ptr)->set_false = arr_set_false;         \
+    (__ptr)->set_null = arr_set_null;           \
+    (__ptr)->get = arr_get;                     \
+    (__ptr)->get_ref = arr_get_ref;             \
+    (__ptr)->get_str = arr_get_str;             \
+    (__ptr)->get_str_ref = arr_get_str_ref;     \
+    (__ptr)->get_num = arr_get_num;             \
+    (__ptr)->get_type = arr_get_type;           \
+    (__ptr)->reserve = arr_reserve;             \
+    (__ptr)->shrink_to_fit = arr_shrink_to_fit; \
+    (__ptr)->sort = arr_qsort;                  \
+    (__ptr)->sort_with = arr_sort_with;         \
+    (__ptr)->sort_by = arr_sort_by;             \
+    (__ptr)->sum = arr_sum;                     \
+    (__ptr)->min = arr_min;                     \
+    (__ptr)->max = arr_max;                     \
+    (__ptr)->mean = arr_mean;                   \
+    (__ptr)->count_if = arr_count_if;           \
+    (__ptr)->columnize = arr_columnize;         \
+    (__ptr)->begin = arr_begin;                 \
+    (__ptr)->end = arr_end;                     \
+    (__ptr)->rbegin = arr_rbegin;               \
+    (__ptr)->rend = arr_rend;                   \
 } while(0)
 
 
@@ -306,6 +465,7 @@ do {                                        \
 /* constructor */
 JSONTrue *true_default_cstr();
 JSONTrue true_default();
+JSON true_handle(void);
 #define JSON_TRUE_CLASS(__ptr)       \
 do {                                 \
     (__ptr)->type = JSON_TYPE_TRUE;  \
@@ -319,6 +479,7 @@ do {                                 \
 /* constructor */
 JSONFalse *false_default_cstr();
 JSONFalse false_default();
+JSON false_handle(void);
 #define JSON_FALSE_CLASS(__ptr)      \
 do {                                 \
     (__ptr)->type = JSON_TYPE_FALSE; \
@@ -332,6 +493,7 @@ do {                                 \
 /* constructor */
 JSONNull *null_default_cstr();
 JSONNull null_default();
+JSON null_handle(void);
 #define JSON_NULL_CLASS(__ptr)       \
 do {                                 \
     (__ptr)->type = JSON_TYPE_NULL;  \
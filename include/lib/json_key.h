@@ -0,0 +1,58 @@
+#ifndef JSON_KEY_H
+#define JSON_KEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  Interned keys
+ *
+ *  Every distinct object key is stored once in a global refcounted
+ *  pool, together with its length and hash. The pool is sharded by
+ *  hash, each shard with its own lock, and a reference that is not
+ *  the last is dropped without locking. Hash table entries point
+ *  to the interned string, so two interned keys are equal if and only
+ *  if their pointers are equal.
+ *
+ *  An interned key is a plain NULL-terminated string; it must only be
+ *  released by key_release.
+ */
+typedef struct JSONKeyRec JSONKeyRec;
+
+struct JSONKeyRec {
+    JSONKeyRec *next; /* chain in pool bucket */
+    uint64_t hash;
+    uint32_t len;
+    uint32_t refcnt;
+    char str[];
+};
+
+#define key_rec(__key) \
+    ((JSONKeyRec *)((char *)(__key) - offsetof(JSONKeyRec, str)))
+
+/* hash of interned key */
+#define key_hash(__key) (key_rec(__key)->hash)
+/* length of interned key */
+#define key_len(__key) (key_rec(__key)->len)
+
+uint64_t key_hash_str(const char *str, size_t len);
+uint64_t key_hash_seed(const char *str, size_t len, uint64_t seed);
+uint64_t key_random_seed(void);
+const char *key_intern(const char *str);
+const char *key_intern_len(const char *str, size_t len, uint64_t hash);
+const char *key_retain(const char *key);
+void key_release(const char *key);
+
+/*
+ *  Key handle
+ *
+ *  A interned key held by the user, for repeated lookups of the same
+ *  key: its hash and length are computed once by json_key, and it is
+ *  compared by pointer in every object.
+ */
+typedef const char *JSONKey;
+
+JSONKey json_key(const char *str);
+void json_key_free(JSONKey key);
+
+#endif
@@ -6,6 +6,15 @@
 typedef struct JSONNode JSONNode;
 typedef struct JSONLinkedList JSONLinkedList;
 
+/* how list_sort orders values, FLAGS are JSON_SORT_* */
+typedef struct JSONListOrder {
+    int (*compare)(const JSON *a, const JSON *b, const void *ctx);
+    /* the part of a value compared, or NULL if it has none; NULL to compare whole values */
+    const JSON *(*key)(const JSON *val, const void *ctx);
+    const void *ctx;
+    int flags;
+} JSONListOrder;
+
 struct JSONNode {
     JSON value;
     JSONNode *next;
@@ -15,22 +24,50 @@ struct JSONNode {
 struct JSONLinkedList {
     JSONNode *head, *tail, *nil;
     int size;
+    /* nodes preallocated by list_reserve, chained by next */
+    int nspare;
+    JSONNode *spare;
+    int refcnt; /* copies sharing this list, see list_unshare */
+    JSONNode *block; /* all nodes in one array once frozen, see list_freeze */
+    int frozen;
+    /*
+     * a list of only numbers or only booleans keeps them in one buffer
+     * instead of nodes: values in packed[1 .. size], packed[0] and
+     * packed[size + 1] are where the iterators stop
+     */
+    int *packed;
+    int packed_type; /* JSON_TYPE_NUMBER, or JSON_TYPE_TRUE for booleans */
+    int packed_cap;
 };
 
 JSONLinkedList *list_create();
 JSONLinkedList *list_create_copy(const JSONLinkedList *src);
 void list_free(JSONLinkedList *list);
+JSONLinkedList *list_retain(JSONLinkedList *list);
+JSONLinkedList *list_unshare(JSONLinkedList *list);
+void list_reserve(JSONLinkedList *list, int n);
+void list_shrink(JSONLinkedList *list);
+void list_freeze(JSONLinkedList *list);
 int list_insert_tail(JSONLinkedList *list, const JSON *val);
 int list_insert(JSONLinkedList *list, int pos, const JSON *val);
+int list_insert_ref(JSONLinkedList *list, int pos, const JSON *val);
 int list_erase(JSONLinkedList *list, int pos);
 int list_find(const JSONLinkedList *list, int pos, JSON *val);
+int list_find_ref(const JSONLinkedList *list, int pos, JSON *val);
+int list_view(const JSONLinkedList *list, int pos, JSON *val);
+JSON *list_at(JSONLinkedList *list, int pos);
 int list_update(JSONLinkedList *list, int pos, const JSON *val);
 int list_set(JSONLinkedList *list, int pos, const JSON *val);
-void list_qsort(JSONLinkedList *list, int (*compare_fn)(const void *, const void *));
+int list_set_ref(JSONLinkedList *list, int pos, const JSON *val);
+void list_sort(JSONLinkedList *list, const JSONListOrder *order);
+long long list_sum(const JSONLinkedList *list, int *count);
+int list_min_max(const JSONLinkedList *list, int *min, int *max);
+int list_count_if(const JSONLinkedList *list, int (*pred)(int));
 
 typedef struct JSONLinkedListIter {
     void *index;
     JSON value;
+    int __packed; /* packed_type of a packed list, else 0 */
 } JSONLinkedListIter;
 
 typedef struct JSONLinkedListIter JSONLinkedListIter;
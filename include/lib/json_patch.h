@@ -0,0 +1,24 @@
+#ifndef JSON_PATCH_H
+#define JSON_PATCH_H
+
+#include "lib/json.h"
+#include "lib/json_impl.h"
+
+/*
+ *  JSON Patch, RFC 6902
+ *
+ *  json_diff makes the patch that turns one document into another: a
+ *  array of add, remove and replace operations, whose values share
+ *  data with the target. Subtrees shared by copies of a document are
+ *  the same by their pointers and are skipped without being walked,
+ *  arrays are compared past their common head and tail.
+ *
+ *  json_patch_apply applies every operation, test, move and copy too,
+ *  or none of them: they modify a copy of the document, which replaces
+ *  it once all succeed. Only the levels on their paths are cloned. The
+ *  root of a document keeps its type.
+ */
+JSONArray *json_diff(const void *a, const void *b);
+int json_patch_apply(void *doc, const void *patch);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef JSON_PATH_H
+#define JSON_PATH_H
+
+#include "lib/json.h"
+#include "lib/json_pointer.h"
+
+/*
+ *  JSONPath
+ *
+ *  A query is compiled once into a plan, a array of steps, each one
+ *  selecting children of the values the step before selected:
+ *
+ *    $.a, $['a']      by a interned key
+ *    $[0], $[-1]      by a index of a array
+ *    $.*, $[*]        all children
+ *    $[?(@.a == 1)]   children a filter is true for
+ *    $..a             the same as its step, after a recursive descent
+ *
+ *  Filters compare the value at a path relative to '@' with a literal,
+ *  by ==, !=, <, <=, > or >=, or only test that it exists. Conditions
+ *  are joined by && and ||, && first. Selected values are borrowed
+ *  until the document is modified or freed.
+ */
+typedef struct JSONPath JSONPath;
+typedef struct JSONPathStep JSONPathStep;
+typedef struct JSONPathCond JSONPathCond;
+
+struct JSONPathCond {
+    JSONPointer *ptr; /* path from '@' */
+    int op;
+    int type; /* of the literal */
+    int num;
+    char *str;
+    int and; /* joined to the next condition by &&, else by || */
+};
+
+struct JSONPathStep {
+    int kind;
+    int descend; /* '..' before the step */
+    const char *key; /* interned */
+    int index;
+    int nconds;
+    JSONPathCond *conds;
+};
+
+struct JSONPath {
+    int nsteps;
+    JSONPathStep steps[];
+};
+
+JSONPath *json_path_compile(const char *query);
+void json_path_free(JSONPath *path);
+int json_path_eval(const void *doc, const JSONPath *path, JSON *vals, int n);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef JSON_POINTER_H
+#define JSON_POINTER_H
+
+#include "lib/json.h"
+
+/*
+ *  JSON Pointer, RFC 6901
+ *
+ *  A pointer is compiled once: its reference tokens are unescaped and
+ *  interned, so each step of json_pointer_get is one lookup by key
+ *  handle in a object, or one index in a array. Nothing is copied: the
+ *  value is borrowed until the document is modified or freed.
+ */
+typedef struct JSONPointer JSONPointer;
+
+typedef struct JSONPointerToken {
+    const char *key; /* interned */
+    int index; /* as a array index, -1 if it is not one */
+} JSONPointerToken;
+
+struct JSONPointer {
+    int ntokens;
+    JSONPointerToken tokens[];
+};
+
+JSONPointer *json_pointer_compile(const char *str);
+void json_pointer_free(JSONPointer *ptr);
+int json_pointer_get(const void *doc, const JSONPointer *ptr, void *val);
+
+#endif
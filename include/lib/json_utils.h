@@ -1,6 +1,8 @@
 #ifndef LIB_UTILS_H
 #define LIB_UTILS_H
 
+#include <stddef.h>
+
 #define likely(x)   __builtin_expect(!!(x), 1)
 #define unlikely(x) __builtin_expect(!!(x), 0)
 
@@ -19,8 +21,32 @@ void __attribute__((format(printf, 1, 2), unused)) json_log_printf(const char* f
         __FILE__, __LINE__, __func__)
 
 /* Memory allocation and free */
+typedef void *(*JSONAllocFn)(void *ctx, size_t size);
+typedef void *(*JSONReallocFn)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+typedef void (*JSONFreeFn)(void *ctx, void *ptr);
+
+int json_set_allocator(JSONAllocFn alloc, JSONReallocFn realloc,
+    JSONFreeFn free, void *ctx);
 void *json_xmallocz(int size);
 void *json_xreallocz(void *ptr, int old_size, int new_size);
 void json_xfree(void *ptr);
+void json_xdetach(void *ptr);
+void json_memory_live(size_t *nallocs, size_t *nbytes);
+
+/* size classes of fixed-size internal objects, see json_slab_alloc */
+enum {
+    JSON_SLAB_NODE,         /* JSONNode, list sentinel included */
+    JSON_SLAB_LIST,         /* JSONLinkedList */
+    JSON_SLAB_HTAB,         /* JSONHashTable header */
+    JSON_SLAB_HTAB_SMALL,   /* JSONHashTable with its inline entries */
+    JSON_SLAB_NUMBER,       /* number cell */
+    JSON_SLAB_NR
+};
+
+void *json_slab_alloc(int cls, int size);
+void json_slab_free(int cls, void *ptr);
+
+#define json_number_create() ((int *)json_slab_alloc(JSON_SLAB_NUMBER, sizeof(int)))
+#define json_number_free(__ptr) json_slab_free(JSON_SLAB_NUMBER, __ptr)
 
 #endif
\ No newline at end of file
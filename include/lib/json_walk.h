@@ -0,0 +1,41 @@
+#ifndef JSON_WALK_H
+#define JSON_WALK_H
+
+#include "lib/json.h"
+
+/*
+ *  Document walker
+ *
+ *  json_walk visits a document depth-first, in document order, without
+ *  recursion and without copying: callbacks get borrowed pointers into
+ *  the document, and where the value is with JSONWalkPos. Objects and
+ *  arrays are passed to enter before their children and to leave after
+ *  them, every other value to scalar. A value of a packed array is
+ *  passed by a temporary JSON whose data still points into the array.
+ *
+ *  Callbacks return JSON_WALK_CONTINUE, JSON_WALK_SKIP from enter to
+ *  not visit the children (leave is still called), or JSON_WALK_STOP to
+ *  end the walk. Any callback may be NULL. Borrowed values live until
+ *  the document is modified or freed, callbacks must not modify it.
+ */
+enum {
+    JSON_WALK_CONTINUE = 0,
+    JSON_WALK_SKIP,
+    JSON_WALK_STOP
+};
+
+typedef struct JSONWalkPos {
+    const char *key; /* in the parent object, else NULL */
+    int index; /* in the parent array, else -1 */
+    int depth; /* 0 for the document */
+} JSONWalkPos;
+
+typedef struct JSONVisitor {
+    int (*enter)(const JSON *val, const JSONWalkPos *pos, void *ctx);
+    int (*leave)(const JSON *val, const JSONWalkPos *pos, void *ctx);
+    int (*scalar)(const JSON *val, const JSONWalkPos *pos, void *ctx);
+} JSONVisitor;
+
+int json_walk(const void *doc, const JSONVisitor *visitor, void *ctx);
+
+#endif
@@ -30,8 +30,20 @@ do { \
     } \
 } while (0)
 
-static json_stack(char *) g_chars_stk;
-static json_stack(char) g_char_stk;
+static __thread json_stack(char *) g_chars_stk;
+static __thread json_stack(char) g_char_stk;
+
+/*
+ * Parsing hints: member count of the last object parsed at each
+ * nesting depth. Records of the same shape (e.g. objects in an array)
+ * are presized from their predecessor instead of growing key by key.
+ * Hints are kept across documents, so they are capped: one wide object
+ * must not presize every object parsed after it on the thread.
+ */
+#define PARSE_HINT_DEPTH 64
+#define PARSE_HINT_MAX 64
+static __thread uint64_t g_obj_hint[PARSE_HINT_DEPTH];
+static __thread int g_parse_depth;
 
 static void json_stringify_number(const JSON *json, char **pstr, int *len);
 static void json_stringify_string(const JSON *json, char **pstr, int *len);
@@ -39,9 +51,11 @@ static void json_stringify_array(const JSON *json, char **pstr, int *len);
 static void json_stringify_object(const JSON *json, char **pstr, int *len);
 
 static int json_parse_object(const char **const pstr, JSON *json);
+static int json_parse_members(const char **const pstr, JSON *json);
 static int json_parse_string(const char **const pstr, JSON *json);
 static int json_parse_number(const char **const pstr, JSON *json);
 static int json_parse_array(const char **const pstr, JSON *json);
+static int json_parse_elements(const char **const pstr, JSON *json);
 static int json_parse_literal(const char **const pstr, JSON *json);
 
 void json_copy(JSON *dst, const JSON *src)
@@ -51,19 +65,21 @@ void json_copy(JSON *dst, const JSON *src)
     switch(src->type) {
         case JSON_TYPE_OBJECT:
             assert(NULL == dst->data);
-            dst->data = htab_create_copy(src->data);
+            /* shared until modified */
+            dst->data = htab_retain(src->data);
             break;
         case JSON_TYPE_STRING:
             dst->data = json_xmallocz(strlen(src->data) + 1);
             strcat(dst->data, src->data);
             break;
         case JSON_TYPE_NUMBER:
-            dst->data = json_xmallocz(sizeof (int));
+            dst->data = json_number_create();
             *(int*)(dst->data) = *(int*)(src->data);
             break;
         case JSON_TYPE_ARRAY:
             assert(NULL == dst->data);
-            dst->data = list_create_copy(src->data);
+            /* shared until modified */
+            dst->data = list_retain(src->data);
             break;
         case JSON_TYPE_TRUE:
         case JSON_TYPE_FALSE:
@@ -74,20 +90,34 @@ void json_copy(JSON *dst, const JSON *src)
     }
 }
 
+/* a handle to a copy of SRC, objects and arrays are shared until modified */
+JSON json_handle_copy(const void *src)
+{
+    JSON d = { NULL, 0 };
+
+    assert(src);
+    json_copy(&d, src);
+
+    return d;
+}
+
 void json_free_data(JSON *json)
 {
+    /* a moved-from value has no data left */
+    if (NULL == json->data) {
+        return ;
+    }
     switch(json->type) {
         case JSON_TYPE_OBJECT:
-            assert(json->data);
             htab_free(json->data);
             break;
         case JSON_TYPE_STRING:
-        case JSON_TYPE_NUMBER:
-            assert(json->data);
             json_xfree(json->data);
             break;
+        case JSON_TYPE_NUMBER:
+            json_number_free(json->data);
+            break;
         case JSON_TYPE_ARRAY:
-            assert(json->data);
             list_free(json->data);
             break;
         case JSON_TYPE_TRUE:
@@ -126,6 +156,183 @@ int json_reassign(void *dst, const void *src)
     return 0;
 }
 
+static void json_memory_add(const JSON *json, JSONMemoryStats *st)
+{
+    const JSONHashTable *h;
+    const JSONLinkedList *l;
+    JSONHashTableIter hiter, hend;
+    JSONLinkedListIter liter, lend;
+
+    if (NULL == json->data) {
+        return ;
+    }
+    switch(json->type) {
+        case JSON_TYPE_OBJECT:
+            h = json->data;
+            st->headers += sizeof(*h);
+            st->entries += (h->capacity + 1) * sizeof(JSONEntry);
+            st->entries += h->disp ? h->nbuckets * sizeof(uint32_t) : 0;
+            hiter = htab_begin(h);
+            hend = htab_end(h);
+            json_htab_foreach(hiter, hend) {
+                st->keys += sizeof(JSONKeyRec) + key_len(hiter.key) + 1;
+                json_memory_add(&hiter.value, st);
+            }
+            break;
+        case JSON_TYPE_STRING:
+            st->strings += strlen(json->data) + 1;
+            break;
+        case JSON_TYPE_NUMBER:
+            st->numbers += sizeof(int);
+            break;
+        case JSON_TYPE_ARRAY:
+            l = json->data;
+            st->headers += sizeof(*l);
+            /* packed values are counted as numbers, in one buffer */
+            if (l->packed) {
+                st->nodes += (1 + l->nspare) * sizeof(JSONNode);
+                st->numbers += (l->packed_cap + 2) * sizeof(int);
+                break;
+            }
+            st->nodes += (l->size + 1 + l->nspare) * sizeof(JSONNode);
+            liter = list_begin(l);
+            lend = list_end(l);
+            jsong_list_foreach(liter, lend) {
+                json_memory_add(&liter.value, st);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+int json_memory_usage(const void *json, JSONMemoryStats *stats)
+{
+    assert(json && stats);
+    memset(stats, 0, sizeof(*stats));
+    json_memory_add(json, stats);
+    stats->total = stats->keys + stats->strings + stats->entries +
+        stats->nodes + stats->numbers + stats->headers;
+    return 0;
+}
+
+/* shrink every container of JSON, leaving those shared with copies alone */
+static void json_compact_data(const JSON *json)
+{
+    JSONHashTable *h;
+    JSONLinkedList *l;
+    JSONHashTableIter hiter, hend;
+    JSONLinkedListIter liter, lend;
+
+    if (NULL == json->data) {
+        return ;
+    }
+    switch(json->type) {
+        case JSON_TYPE_OBJECT:
+            h = json->data;
+            if (h->frozen || __atomic_load_n(&h->refcnt, __ATOMIC_ACQUIRE) != 1) {
+                return ;
+            }
+            htab_shrink(h);
+            hiter = htab_begin(h);
+            hend = htab_end(h);
+            json_htab_foreach(hiter, hend) {
+                json_compact_data(&hiter.value);
+            }
+            break;
+        case JSON_TYPE_ARRAY:
+            l = json->data;
+            if (l->frozen || __atomic_load_n(&l->refcnt, __ATOMIC_ACQUIRE) != 1) {
+                return ;
+            }
+            list_shrink(l);
+            liter = list_begin(l);
+            lend = list_end(l);
+            jsong_list_foreach(liter, lend) {
+                json_compact_data(&liter.value);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+int json_compact(void *json)
+{
+    assert(json);
+    json_compact_data(json);
+    return 0;
+}
+
+/* freeze JSON and all below it, taking a copy of what is shared first */
+static void json_freeze_data(JSON *json)
+{
+    JSONHashTableIter hiter, hend;
+    JSONLinkedListIter liter, lend;
+
+    switch(json->type) {
+        case JSON_TYPE_OBJECT:
+            if (((JSONHashTable *)json->data)->frozen) {
+                return ;
+            }
+            json->data = htab_unshare(json->data);
+            hiter = htab_begin(json->data);
+            hend = htab_end(json->data);
+            json_htab_foreach(hiter, hend) {
+                json_freeze_data(&((JSONEntry *)hiter.index)->value);
+            }
+            htab_freeze(json->data);
+            break;
+        case JSON_TYPE_ARRAY:
+            if (((JSONLinkedList *)json->data)->frozen) {
+                return ;
+            }
+            json->data = list_unshare(json->data);
+            /* packed numbers and booleans have nothing below them */
+            if (((JSONLinkedList *)json->data)->packed) {
+                list_freeze(json->data);
+                break;
+            }
+            liter = list_begin(json->data);
+            lend = list_end(json->data);
+            jsong_list_foreach(liter, lend) {
+                json_freeze_data(&((JSONNode *)liter.index)->value);
+            }
+            list_freeze(json->data);
+            break;
+        default:
+            break;
+    }
+}
+
+int json_freeze(void *val)
+{
+    JSON *json = val;
+
+    assert(json && json->data);
+    if (json->type != JSON_TYPE_OBJECT && json->type != JSON_TYPE_ARRAY) {
+        THROW_WARNING("only a object or array can be frozen");
+        return -1;
+    }
+    json_freeze_data(json);
+    return 0;
+}
+
+int json_is_frozen(const void *val)
+{
+    const JSON *json = val;
+
+    assert(json);
+    switch(json->type) {
+        case JSON_TYPE_OBJECT:
+            return ((const JSONHashTable *)json->data)->frozen;
+        case JSON_TYPE_ARRAY:
+            return ((const JSONLinkedList *)json->data)->frozen;
+        default:
+            return 0;
+    }
+}
+
 static void
 json_stringify_number(const JSON *json, char **pstr, int *plen)
 {
@@ -287,8 +494,8 @@ json_stringify_object(const JSON *json, char **pstr, int *plen)
     int vl;
     char *v;
     const JSONHashTable *htab;
+    const JSONEntry *entry, *eentry;
     json_stack(char *) kstk, vstk;
-    JSONHashTableIter iter, end;
 
     htab = json->data;
     json_stack_init(kstk, htab->size);
@@ -297,26 +504,27 @@ json_stringify_object(const JSON *json, char **pstr, int *plen)
     *plen = 2;
 
     assert(htab);
-    iter = htab_begin(htab);
-    end = htab_end(htab);
-    json_htab_foreach(iter, end) {
+    /* walk backward, so that popping the stacks restores insertion order */
+    entry = &htab->entries[htab->last];
+    eentry = &htab->entries[htab->capacity];
+    for (; entry != eentry; entry = &htab->entries[entry->prev]) {
         vl = 0;
         v = NULL;
-        switch(iter.value.type) {
+        switch(entry->value.type) {
             case JSON_TYPE_OBJECT:
-                json_stringify_object(&iter.value, &v, &vl);
+                json_stringify_object(&entry->value, &v, &vl);
                 json_stack_push(g_chars_stk, v);
                 break;
             case JSON_TYPE_STRING:
-                json_stringify_string(&iter.value, &v, &vl);
+                json_stringify_string(&entry->value, &v, &vl);
                 json_stack_push(g_chars_stk, v);
                 break;
             case JSON_TYPE_NUMBER:
-                json_stringify_number(&iter.value, &v, &vl);
+                json_stringify_number(&entry->value, &v, &vl);
                 json_stack_push(g_chars_stk, v);
                 break;
             case JSON_TYPE_ARRAY:
-                json_stringify_array(&iter.value, &v, &vl);
+                json_stringify_array(&entry->value, &v, &vl);
                 json_stack_push(g_chars_stk, v);
                 break;
             case JSON_TYPE_TRUE:
@@ -334,9 +542,9 @@ json_stringify_object(const JSON *json, char **pstr, int *plen)
             default:
                 assert(0);
         }
-        json_stack_push(kstk, iter.key);
+        json_stack_push(kstk, entry->key);
         json_stack_push(vstk, v);
-        *plen += (vl + strlen(iter.key) + 3);
+        *plen += (vl + strlen(entry->key) + 3);
     }
     if (htab->size == 0) {
         *plen += 1;
@@ -368,7 +576,7 @@ json_stringify_array(const JSON *json, char **pstr, int *plen)
     int vl;
     char *v;
     JSONLinkedList *list;
-    JSONNode *node, *enode;
+    JSONLinkedListIter iter, end;
 
     list = json->data;
     /* create two stacks and their size are equal to size of list */
@@ -378,26 +586,27 @@ json_stringify_array(const JSON *json, char **pstr, int *plen)
     *plen = 2;
 
     assert(list);
-    node = list->tail;
-    enode = list->nil;
-    for (; node != enode; node = node->prev) {
+    /* iterators read packed lists too */
+    iter = list_rbegin(list);
+    end = list_rend(list);
+    jsong_list_reverse_foreach(iter, end) {
         vl = 0;
         v = NULL;
-        switch(node->value.type) {
+        switch(iter.value.type) {
             case JSON_TYPE_OBJECT:
-                json_stringify_object(&node->value, &v, &vl);
+                json_stringify_object(&iter.value, &v, &vl);
                 json_stack_push(g_chars_stk, v);
                 break;
             case JSON_TYPE_STRING:
-                json_stringify_string(&node->value, &v, &vl);
+                json_stringify_string(&iter.value, &v, &vl);
                 json_stack_push(g_chars_stk, v);
                 break;
             case JSON_TYPE_NUMBER:
-                json_stringify_number(&node->value, &v, &vl);
+                json_stringify_number(&iter.value, &v, &vl);
                 json_stack_push(g_chars_stk, v);
                 break;
             case JSON_TYPE_ARRAY:
-                json_stringify_array(&node->value, &v, &vl);
+                json_stringify_array(&iter.value, &v, &vl);
                 json_stack_push(g_chars_stk, v);
                 break;
             case JSON_TYPE_TRUE:
@@ -482,6 +691,7 @@ int json_stringify(const void *json, char **pstr, int *plen)
     }
     /* clear stack */
     json_stack_clear(g_chars_stk);
+    json_xdetach(*pstr);
     return l;
 }
 
@@ -494,8 +704,32 @@ static void bypass_white_space(const char **const pstr)
     *pstr = str;
 }
 
+static JSONHashTable *json_parse_object_create(void)
+{
+    if (g_parse_depth < PARSE_HINT_DEPTH) {
+        return htab_create_reserved(g_obj_hint[g_parse_depth]);
+    }
+    return htab_create(1);
+}
+
 static int
 json_parse_object(const char **const pstr, JSON *json)
+{
+    int res;
+    const JSONHashTable *htab = json->data;
+
+    g_parse_depth++;
+    res = json_parse_members(pstr, json);
+    g_parse_depth--;
+    if (!res && g_parse_depth < PARSE_HINT_DEPTH) {
+        g_obj_hint[g_parse_depth] = htab->size < PARSE_HINT_MAX ?
+            htab->size : PARSE_HINT_MAX;
+    }
+    return res;
+}
+
+static int
+json_parse_members(const char **const pstr, JSON *json)
 {
     const char *str = *pstr;
     int64_t old_stk_top, tmp_stk_top;
@@ -531,7 +765,7 @@ json_parse_object(const char **const pstr, JSON *json)
             case '{':
                 sub.type = JSON_TYPE_OBJECT;
                 assert(NULL == sub.data); /* for test */
-                sub.data = htab_create(1);
+                sub.data = json_parse_object_create();
                 if (json_parse_object(&str, &sub)) {
                     htab_free(sub.data);
                     goto parse_obj_err;
@@ -606,6 +840,17 @@ parse_obj_err:
 
 static int
 json_parse_array(const char **const pstr, JSON *json)
+{
+    int res;
+
+    g_parse_depth++;
+    res = json_parse_elements(pstr, json);
+    g_parse_depth--;
+    return res;
+}
+
+static int
+json_parse_elements(const char **const pstr, JSON *json)
 {
     const char *str = *pstr;
     JSON sub;
@@ -620,7 +865,7 @@ json_parse_array(const char **const pstr, JSON *json)
             case '{':
                 sub.type = JSON_TYPE_OBJECT;
                 assert(NULL == sub.data); /* for test */
-                sub.data = htab_create(1);
+                sub.data = json_parse_object_create();
                 if (json_parse_object(&str, &sub)) {
                     htab_free(sub.data);
                     goto parse_arr_err;
@@ -849,7 +1094,7 @@ json_parse_number(const char **const pstr, JSON *json)
                 res = 10 * res + sign * (int)(*str - '0');
                 break;
             default:
-                json->data = json_xmallocz(sizeof(int));
+                json->data = json_number_create();
                 *(int*)json->data = res;
                 *pstr = str;
                 return 0;
@@ -896,7 +1141,7 @@ json_parse_entry(const char *str, JSON *json)
         case '{':
             assert(json->type == JSON_TYPE_OBJECT);
             assert(NULL == json->data); /* for test */
-            json->data = htab_create(1);
+            json->data = json_parse_object_create();
             if (json_parse_object(&str, json)) {
                 htab_free(json->data);
                 return str;
@@ -993,6 +1238,7 @@ int json_parse(const char *str, void *val)
     json->data = NULL;
 
     json_stack_init(g_char_stk, 256);
+    g_parse_depth = 0;
     if (!!(err = json_parse_entry(str, json))) {
         parse_fail_print(str, err);
         /* parse failed and restore it */
@@ -5,37 +5,22 @@
 #include <assert.h>
 
 #include "lib/json_htab.h"
+#include "lib/json_key.h"
 #include "lib/json_utils.h"
 
 
-#define FNV_OFFSET_BASIS 14695981039346656037UL
-#define FNV_PRIME 1099511628211UL
-
-/* Return 64-bit FNV-1a hash for key (NULL-terminated). See description: */
-/* https://en.wikipedia.org/wiki/Fowler–Noll–Vo_hash_function */
-static uint64_t hash_key(const char *key)
-{
-    uint64_t hash = FNV_OFFSET_BASIS;
-    for (const char *p = key; *p; p++) {
-        hash ^= (uint64_t)*(unsigned char*)p;
-        hash *= FNV_PRIME;
-    }
-    return hash;
-}
-
 static void entry_clear(JSONEntry *e)
 {
     assert(e);
-    json_xfree(e->key);
+    key_release(e->key);
     json_free_data(&e->value);
     memset(e, 0, sizeof(*e));
 }
 
 static void entry_copy(JSONEntry *d, const JSONEntry *s)
 {
-    /* copy key */
-    d->key = json_xmallocz(strlen(s->key) + 1);
-    strcat(d->key, s->key);
+    /* share interned key */
+    d->key = (char *)key_retain(s->key);
     /* copy value */
     json_copy(&(d->value), &(s->value));
     /* copy index */
@@ -43,10 +28,9 @@ static void entry_copy(JSONEntry *d, const JSONEntry *s)
     d->next = s->next;
 }
 
+/* append entry at p to the tail of the insertion-ordered chain */
 static void entry_placed_in(JSONHashTable *h, uint64_t p)
 {
-    uint64_t i;
-
     if (h->first == h->capacity) {
         h->entries[p].prev = h->capacity;
         h->entries[p].next = h->capacity;
@@ -54,32 +38,30 @@ static void entry_placed_in(JSONHashTable *h, uint64_t p)
         h->last = p;
         return ;
     }
-    if (p < h->first) {
-        /* new p of begin in hash table */
-        h->entries[h->first].prev = p;
-        h->entries[p].prev = h->capacity;
-        h->entries[p].next = h->first;
-        h->first = p;
-        return ;
+    h->entries[h->last].next = p;
+    h->entries[p].prev = h->last;
+    h->entries[p].next = h->capacity;
+    h->last = p;
+    return ;
+}
+
+/* move entry from slot s into the empty slot d, keeping its chain position */
+static void entry_moved_in(JSONHashTable *h, uint64_t s, uint64_t d)
+{
+    JSONEntry *e = &h->entries[s];
+
+    if (e->prev == h->capacity) {
+        h->first = d;
+    } else {
+        h->entries[e->prev].next = d;
     }
-    if (h->last < p) {
-        /* new p of end in hash table */
-        h->entries[h->last].next = p;
-        h->entries[p].prev = h->last;
-        h->entries[p].next = h->capacity;
-        h->last = p;
-        return ;
+    if (e->next == h->capacity) {
+        h->last = d;
+    } else {
+        h->entries[e->next].prev = d;
     }
-    /* h->begin < p < h->end */
-    i = h->first;
-    for (; i < p; i = h->entries[i].next);
-    JSONEntry *prev = &h->entries[h->entries[i].prev];
-    JSONEntry *next = &h->entries[i];
-    h->entries[p].prev = next->prev;
-    h->entries[p].next = prev->next;
-    prev->next = p;
-    next->prev = p;
-    return ;
+    h->entries[d] = *e;
+    memset(e, 0, sizeof(*e));
 }
 
 static void entry_removed_in(JSONHashTable *h, uint64_t p)
@@ -108,15 +90,34 @@ static void entry_removed_in(JSONHashTable *h, uint64_t p)
     return ;
 }
 
+/* entries stored in the same allocation as the table itself */
+#define htab_inline_entries(h) ((JSONEntry *)((JSONHashTable *)(h) + 1))
+#define htab_has_inline_entries(h) \
+    ((h)->block == JSON_SLAB_HTAB_SMALL && (h)->entries == htab_inline_entries(h))
+
 JSONHashTable *htab_create(uint64_t c)
 {
     JSONHashTable *h;
-    h = json_xmallocz(sizeof *h);
-    h->entries = json_xmallocz((c + 1)*sizeof(JSONEntry));
+
+    if (c <= HTAB_SMALL_CAPACITY) {
+        /* one allocation: table header followed by its inline entries */
+        c = HTAB_SMALL_CAPACITY;
+        h = json_slab_alloc(JSON_SLAB_HTAB_SMALL,
+            sizeof *h + (c + 1)*sizeof(JSONEntry));
+        h->block = JSON_SLAB_HTAB_SMALL;
+        h->entries = htab_inline_entries(h);
+    } else {
+        /* round up to power of 2 for masking */
+        for (; c & (c - 1); c = (c | (c - 1)) + 1);
+        h = json_slab_alloc(JSON_SLAB_HTAB, sizeof *h);
+        h->block = JSON_SLAB_HTAB;
+        h->entries = json_xmallocz((c + 1)*sizeof(JSONEntry));
+    }
     h->size = 0;
     h->capacity = c;
     h->first = c;
     h->last = c;
+    h->refcnt = 1;
 
     return h;
 }
@@ -142,6 +143,8 @@ JSONHashTable *htab_create_copy(const JSONHashTable *s)
     d->size = s->size;
     d->first = s->first;
     d->last = s->last;
+    d->seed = s->seed;
+    d->max_probe = s->max_probe;
 
     return d;
 }
@@ -151,6 +154,10 @@ void htab_free(JSONHashTable *h)
     JSONEntry *curr, *end, *next;
 
     assert(h);
+    /* other copies still share it */
+    if (__atomic_sub_fetch(&h->refcnt, 1, __ATOMIC_ACQ_REL) != 0) {
+        return ;
+    }
     /* entries clear */
     curr = &h->entries[h->first];
     end = &h->entries[h->capacity];
@@ -161,21 +168,130 @@ void htab_free(JSONHashTable *h)
     }
 
     /* entries free */
-    json_xfree(h->entries);
+    if (!htab_has_inline_entries(h)) {
+        json_xfree(h->entries);
+    }
+    if (h->disp) {
+        json_xfree(h->disp);
+    }
 
     /* hash table free */
-    json_xfree(h);
+    json_slab_free(h->block, h);
 }
 
-static void htab_grow(JSONHashTable *h, uint64_t c)
+/* number of tables rehashed under a new seed, see htab_reseed */
+static unsigned long g_reseeds;
+
+unsigned long json_reseed_count(void)
 {
-    uint64_t i;
+    return __atomic_load_n(&g_reseeds, __ATOMIC_RELAXED);
+}
+
+/* hash of key K of LEN bytes with process HASH, used to place it in H */
+static inline uint64_t htab_hash(const JSONHashTable *h, const char *k, size_t len, uint64_t hash)
+{
+    return h->seed ? key_hash_seed(k, len, h->seed) : hash;
+}
+
+#define htab_key_hash(h, k) htab_hash(h, k, key_len(k), key_hash(k))
+
+/* frozen tables are read-only, every modifier checks this first */
+static int htab_frozen(const JSONHashTable *h)
+{
+    if (h->frozen) {
+        THROW_WARNING("try to modify a frozen hash table");
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * The minimal perfect hash of a frozen table: keys are split into
+ * buckets by the low half of their hash, and a key of a bucket with
+ * displacement D lives in slot htab_phf_slot(hash, D) of [0, size).
+ * A bucket of one key points to its slot directly by HTAB_PHF_DIRECT.
+ */
+#define HTAB_PHF_DIRECT 0x80000000u
+#define HTAB_PHF_TRIES (1u << 24)
+#define htab_phf_bucket(h, hash) ((((hash) & 0xffffffffu) * (h)->nbuckets) >> 32)
+
+static inline uint64_t htab_phf_slot(uint64_t hash, uint32_t d, uint64_t n)
+{
+    uint64_t x = (hash ^ (d * 0x9e3779b97f4a7c15ULL)) * 0xbf58476d1ce4e5b9ULL;
+    return ((x >> 32) * n) >> 32;
+}
+
+static inline uint64_t htab_phf_probe(const JSONHashTable *h, uint64_t hash)
+{
+    uint32_t d = h->disp[htab_phf_bucket(h, hash)];
+    return d & HTAB_PHF_DIRECT ? d & ~HTAB_PHF_DIRECT : htab_phf_slot(hash, d, h->capacity);
+}
+
+/* a O(1) copy: share H until one of the copies is modified */
+JSONHashTable *htab_retain(JSONHashTable *h)
+{
+    __atomic_add_fetch(&h->refcnt, 1, __ATOMIC_RELAXED);
+    return h;
+}
+
+/*
+ * Return a table owned only by the caller, to be modified in place of
+ * H. A shared H is cloned one level deep: its values are copies, which
+ * share their own tables and lists in turn.
+ */
+JSONHashTable *htab_unshare(JSONHashTable *h)
+{
+    JSONHashTable *c;
+
+    /* a frozen table is never modified, its copies keep sharing it */
+    if (h->frozen || 1 == __atomic_load_n(&h->refcnt, __ATOMIC_ACQUIRE)) {
+        return h;
+    }
+    c = htab_create_copy(h);
+    htab_free(h);
+    return c;
+}
+
+/* turn H into a small table, its entries packed in insertion order */
+static void htab_pack(JSONHashTable *h)
+{
+    uint64_t i, p, c = HTAB_SMALL_CAPACITY;
+    JSONEntry *entries, *old = h->entries;
+
+    assert(h->size <= c && !htab_is_small(h));
+    if (JSON_SLAB_HTAB_SMALL == h->block) {
+        /* back into the inline entries it was created with */
+        entries = htab_inline_entries(h);
+        memset(entries, 0, (c + 1)*sizeof(JSONEntry));
+    } else {
+        entries = json_xmallocz((c + 1)*sizeof(JSONEntry));
+    }
+
+    for (i = 0, p = h->first; p != h->capacity; i++, p = old[p].next) {
+        entries[i] = old[p];
+        entries[i].prev = i ? i - 1 : c;
+        entries[i].next = i + 1 < h->size ? i + 1 : c;
+    }
+
+    h->entries = entries;
+    h->capacity = c;
+    h->first = h->size ? 0 : c;
+    h->last = h->size ? h->size - 1 : c;
+    h->max_probe = 0;
+    json_xfree(old);
+}
+
+/* rehash H into capacity C, which may be smaller than its capacity */
+static void htab_resize(JSONHashTable *h, uint64_t c)
+{
+    uint64_t i, n;
     JSONHashTable old = *h;
     JSONHashTableIter iter, end;
 
-    /* if capacity is up to max valid value, stop growing */
-    if (c < h->capacity) {
-        c = h->capacity;
+    if (c <= HTAB_SMALL_CAPACITY) {
+        if (!htab_is_small(h)) {
+            htab_pack(h);
+        }
         return ;
     }
 
@@ -184,58 +300,328 @@ static void htab_grow(JSONHashTable *h, uint64_t c)
     h->capacity = c;
     h->first = c;
     h->last = c;
+    h->max_probe = 0;
 
     /* shallow copy to improve performance */
     iter = htab_begin(&old);
     end = htab_end(&old);
     json_htab_foreach(iter, end) {
-        i = (uint64_t)(hash_key(iter.key) & (c - 1));
+        i = (uint64_t)(htab_key_hash(h, iter.key) & (c - 1));
         /* unsafe */
-        while(h->entries[i].key)
+        for (n = 0; h->entries[i].key; n++)
         {
             i = (i + 1) & (c - 1);
         }
+        if (n > h->max_probe) {
+            h->max_probe = n;
+        }
         h->entries[i] = *(JSONEntry*)iter.index;
         entry_placed_in(h, i);
     }
 
-    /* free old entries */
-    json_xfree(old.entries);
+    /* free old entries, inline ones are released with the table */
+    if (JSON_SLAB_HTAB_SMALL != h->block || old.entries != htab_inline_entries(h)) {
+        json_xfree(old.entries);
+    }
 }
 
-static uint64_t htab_find_id(const JSONHashTable *h, const char *k)
+/* rebuild H in place under a fresh seed of its own */
+static void htab_reseed(JSONHashTable *h)
+{
+    h->seed = key_random_seed();
+    htab_resize(h, h->capacity);
+    __atomic_add_fetch(&g_reseeds, 1, __ATOMIC_RELAXED);
+}
+
+/* smallest capacity that holds N entries without growing */
+static uint64_t htab_capacity_for(uint64_t n)
+{
+    uint64_t c;
+
+    if (n <= HTAB_SMALL_CAPACITY) {
+        return HTAB_SMALL_CAPACITY;
+    }
+    for (c = HTAB_SMALL_CAPACITY << 1; (c >> 1) + 1 < n; c <<= 1);
+    return c;
+}
+
+JSONHashTable *htab_create_reserved(uint64_t n)
 {
-    uint64_t i = hash_key(k) & (h->capacity - 1);
-    uint64_t n = 0;
+    return htab_create(htab_capacity_for(n));
+}
+
+void htab_reserve(JSONHashTable *h, uint64_t n)
+{
+    uint64_t c = htab_capacity_for(n);
+
+    if (htab_frozen(h)) {
+        return ;
+    }
+    if (c > h->capacity) {
+        htab_resize(h, c);
+    }
+}
+
+/* release the slots H does not need for its entries */
+void htab_shrink(JSONHashTable *h)
+{
+    uint64_t c = htab_capacity_for(h->size);
+
+    if (htab_frozen(h)) {
+        return ;
+    }
+    if (c < h->capacity) {
+        htab_resize(h, c);
+    }
+}
+
+/*
+ * a table grows when over 1/2 full and shrinks when under 1/8 full,
+ * to 1/4 full, so a size going up and down does not rehash each time
+ */
+static void htab_trim(JSONHashTable *h)
+{
+    if (!htab_is_small(h) && h->size < (h->capacity >> 3)) {
+        htab_resize(h, htab_capacity_for(h->size << 1));
+    }
+}
+
+/*
+ * Place the entries of H by a perfect hash, return 0 on success. The
+ * buckets of several keys look for a displacement sending all their
+ * keys to free slots, largest first, while most slots are still free;
+ * each lone key then takes one of the slots left.
+ */
+static int htab_phf_build(JSONHashTable *h)
+{
+    int ret = -1;
+    uint32_t d;
+    uint64_t n = h->size, b, i, k, m, p, s, smax;
+    uint64_t *idx, *hash, *slot, *start, *member, *order, *map;
+    uint8_t *taken;
+    JSONEntry *entries;
+
+    h->nbuckets = n / 2 + 1;
+    h->disp = json_xmallocz(h->nbuckets * sizeof(uint32_t));
+    idx = json_xmallocz(n * sizeof(uint64_t));
+    hash = json_xmallocz(n * sizeof(uint64_t));
+    slot = json_xmallocz(n * sizeof(uint64_t));
+    member = json_xmallocz(n * sizeof(uint64_t));
+    start = json_xmallocz((h->nbuckets + 2) * sizeof(uint64_t));
+    order = json_xmallocz(h->nbuckets * sizeof(uint64_t));
+    taken = json_xmallocz(n);
+
+    /* entries in slot order, grouped by bucket */
+    for (k = 0, i = 0; i < h->capacity; i++) {
+        if (h->entries[i].key) {
+            idx[k] = i;
+            hash[k] = key_hash(h->entries[i].key);
+            start[htab_phf_bucket(h, hash[k]) + 2] += 1;
+            k++;
+        }
+    }
+    for (smax = 0, b = 0; b < h->nbuckets; b++) {
+        smax = start[b + 2] > smax ? start[b + 2] : smax;
+        start[b + 2] += start[b + 1];
+    }
+    for (k = 0; k < n; k++) {
+        member[start[htab_phf_bucket(h, hash[k]) + 1]++] = k;
+    }
+
+    /* buckets from the largest */
+    for (m = 0, s = smax; s > 0; s--) {
+        for (b = 0; b < h->nbuckets; b++) {
+            if (start[b + 1] - start[b] == s) {
+                order[m++] = b;
+            }
+        }
+    }
+
+    for (p = 0, b = 0; b < m; b++) {
+        i = start[order[b]];
+        s = start[order[b] + 1] - i;
+        if (1 == s) {
+            /* lone keys take what is left */
+            for (; taken[p]; p++);
+            taken[p] = 1;
+            slot[member[i]] = p;
+            h->disp[order[b]] = HTAB_PHF_DIRECT | (uint32_t)p;
+            continue;
+        }
+        for (d = 0; d < HTAB_PHF_TRIES; d++) {
+            for (k = 0; k < s; k++) {
+                slot[member[i + k]] = htab_phf_slot(hash[member[i + k]], d, n);
+                if (taken[slot[member[i + k]]]) {
+                    break;
+                }
+                taken[slot[member[i + k]]] = 1;
+            }
+            if (k == s) {
+                break;
+            }
+            /* give back the slots of this try */
+            while (k-- > 0) {
+                taken[slot[member[i + k]]] = 0;
+            }
+        }
+        if (d == HTAB_PHF_TRIES) {
+            /* keys of one hash can't be split, keep the hash table */
+            json_xfree(h->disp);
+            h->disp = NULL;
+            goto out;
+        }
+        h->disp[order[b]] = d;
+    }
+
+    /* move entries to their slots, keeping the insertion order chain */
+    map = json_xmallocz((h->capacity + 1)*sizeof(uint64_t));
+    for (k = 0; k < n; k++) {
+        map[idx[k]] = slot[k];
+    }
+    map[h->capacity] = n;
+    entries = json_xmallocz((n + 1)*sizeof(JSONEntry));
+    for (k = 0; k < n; k++) {
+        entries[slot[k]] = h->entries[idx[k]];
+        entries[slot[k]].prev = map[entries[slot[k]].prev];
+        entries[slot[k]].next = map[entries[slot[k]].next];
+    }
+    h->first = map[h->first];
+    h->last = map[h->last];
+    json_xfree(map);
+    json_xfree(h->entries);
+    h->entries = entries;
+    h->capacity = n;
+    h->max_probe = 0;
+    ret = 0;
+
+out:
+    json_xfree(idx);
+    json_xfree(hash);
+    json_xfree(slot);
+    json_xfree(member);
+    json_xfree(start);
+    json_xfree(order);
+    json_xfree(taken);
+    return ret;
+}
+
+/*
+ * Make H read-only. A small table keeps its packed entries, a larger
+ * one is rebuilt with a minimal perfect hash: each key owns one slot
+ * of [0, size), a lookup is one probe and one key compare.
+ */
+void htab_freeze(JSONHashTable *h)
+{
+    if (h->frozen) {
+        return ;
+    }
+    if (h->size <= HTAB_SMALL_CAPACITY) {
+        htab_resize(h, HTAB_SMALL_CAPACITY);
+    } else if (h->size < HTAB_PHF_DIRECT) {
+        htab_phf_build(h);
+    }
+    h->frozen = 1;
+}
+
+/* interned key E equals key K of LEN bytes with HASH */
+static inline int key_equal(const char *e, const char *k, size_t len, uint64_t hash)
+{
+    return e == k ||
+        (key_hash(e) == hash && key_len(e) == len && 0 == memcmp(e, k, len));
+}
+
+/* N gets the number of slots probed past the home slot */
+static uint64_t htab_probe(const JSONHashTable *h, const char *k, size_t len, uint64_t hash, uint64_t *pn)
+{
+    uint64_t i, n;
+
+    /* small table: entries are packed in [0, size), scan them in order */
+    if (htab_is_small(h)) {
+        for (i = 0; i < h->size; i++) {
+            if (key_equal(h->entries[i].key, k, len, hash)) {
+                return i;
+            }
+        }
+        return i;
+    }
+    /* frozen table: every slot is taken, by the only key it may hold */
+    if (h->disp) {
+        i = htab_phf_probe(h, hash);
+        return key_equal(h->entries[i].key, k, len, hash) ? i : h->capacity;
+    }
+
+    i = htab_hash(h, k, len, hash) & (h->capacity - 1);
+    n = 0;
     for (;;) {
         if (n >= h->capacity) { /* capacity is equal to 1 */
             return h->capacity;
         }
         if (NULL == h->entries[i].key ||
-            0 == strcmp(h->entries[i].key, k)) {
+            key_equal(h->entries[i].key, k, len, hash)) {
             break;
         }
         i = (i + 1) & (h->capacity - 1);
         n++;
     }
+    if (pn) {
+        *pn = n;
+    }
     return i;
 }
 
-int htab_insert_ref(JSONHashTable *h, const char *k, const JSON *v)
+static uint64_t htab_find_id(const JSONHashTable *h, const char *k)
 {
-    /* if size of hash table will exceed half of capacity, grow it */
-    if (h->size > (h->capacity >> 1)) {
-        htab_grow(h, h->capacity << 1);
+    size_t len = strlen(k);
+    return htab_probe(h, k, len, key_hash_str(k, len), NULL);
+}
+
+/* return a free slot for new key K, or capacity if K already exists */
+static uint64_t htab_insert_id(JSONHashTable *h, const char *k, size_t len, uint64_t hash)
+{
+    uint64_t i, n = 0;
+
+    i = htab_probe(h, k, len, hash, &n);
+    if (i != h->capacity && h->entries[i].key) {
+        return h->capacity;
+    }
+    if (htab_is_small(h)) {
+        /* full small table is promoted to a real hash table */
+        if (h->size < h->capacity) {
+            return i;
+        }
+        htab_resize(h, h->capacity << 1);
+    } else if (h->size > (h->capacity >> 1)) {
+        /* if size of hash table will exceed half of capacity, grow it */
+        htab_resize(h, h->capacity << 1);
+    } else if (n > HTAB_PROBE_LIMIT) {
+        /* a cluster this long is flooding, not chance: rehash it away */
+        htab_reseed(h);
+    } else {
+        if (n > h->max_probe) {
+            h->max_probe = n;
+        }
+        return i;
     }
+    return htab_probe(h, k, len, hash, NULL);
+}
+
+int htab_insert_ref(JSONHashTable *h, const char *k, const JSON *v)
+{
+    uint64_t i, hash;
+    size_t len;
 
-    uint64_t i = htab_find_id(h, k);
-    if (h->entries[i].key) {
+    if (htab_frozen(h)) {
+        return -1;
+    }
+    len = strlen(k);
+    hash = key_hash_str(k, len);
+    i = htab_insert_id(h, k, len, hash);
+    if (i == h->capacity) {
         THROW_WARNING("hash table try to insert <value> by existed <key>");
         return -1;
     }
-    /* insert a key */
-    h->entries[i].key = json_xmallocz(strlen(k) + 1);
-    strcat(h->entries[i].key, k);
+    /* insert a interned key */
+    h->entries[i].key = (char *)key_intern_len(k, len, hash);
     /* insert a value */
     h->entries[i].value = *v;
     /* plus 1 in size */
@@ -248,25 +634,26 @@ int htab_insert_ref(JSONHashTable *h, const char *k, const JSON *v)
 
 int htab_insert(JSONHashTable *h, const char *k, const JSON *v)
 {
-    uint64_t i;
+    uint64_t i, hash;
+    size_t len;
 
+    if (htab_frozen(h)) {
+        return -1;
+    }
     if (NULL == v) {
         THROW_WARNING("VAL is not initialized");
         return -1;
     }
-    /* if size of hash table will exceed half of capacity, grow it */
-    if (h->size > (h->capacity >> 1)) {
-        htab_grow(h, h->capacity << 1);
-    }
 
-    i = htab_find_id(h, k);
-    if (h->entries[i].key) {
+    len = strlen(k);
+    hash = key_hash_str(k, len);
+    i = htab_insert_id(h, k, len, hash);
+    if (i == h->capacity) {
         THROW_WARNING("hash table try to insert <value> by existed <key>");
         return -1;
     }
-    /* insert a key */
-    h->entries[i].key = json_xmallocz(strlen(k) + 1);
-    strcat(h->entries[i].key, k);
+    /* insert a interned key */
+    h->entries[i].key = (char *)key_intern_len(k, len, hash);
     /* insert a value */
     json_copy(&(h->entries[i].value), v);
     /* plus 1 in size */
@@ -277,67 +664,72 @@ int htab_insert(JSONHashTable *h, const char *k, const JSON *v)
     return 0;
 }
 
-static void entries_reorder(JSONHashTable *htab, uint64_t start, uint64_t middle, uint64_t end)
+/* interned key K is always found by pointer, its hash is stored with it */
+static uint64_t htab_probe_key(const JSONHashTable *h, const char *k)
 {
-    uint64_t e2m, e2m_id, k;
+    uint64_t i, n;
 
-    /* the last element had been moved 'forward' */
-    if (middle == end)
-        return ;
-
-    for (e2m = end; e2m != middle; e2m = (e2m - 1) & (htab->capacity - 1)) {
-        e2m_id = hash_key(htab->entries[e2m].key) & (htab->capacity - 1);
-        for (k = e2m_id; k != e2m;k = (k + 1) & (htab->capacity - 1)) {
-            if (k == middle) {
-                entry_removed_in(htab, e2m);
-                htab->entries[middle] = htab->entries[e2m];
-                entry_placed_in(htab, middle);
-
-                memset(&htab->entries[e2m], 0, sizeof(htab->entries[e2m]));
-                entries_reorder(htab, start, e2m, end);
-                return ;
+    if (htab_is_small(h)) {
+        for (i = 0; i < h->size; i++) {
+            if (h->entries[i].key == k) {
+                return i;
             }
         }
+        return i;
+    }
+    if (h->disp) {
+        i = htab_phf_probe(h, key_hash(k));
+        return h->entries[i].key == k ? i : h->capacity;
     }
 
-    /* there are no more elements to move 'forward' */
-    return ;
+    i = htab_key_hash(h, k) & (h->capacity - 1);
+    for (n = 0; n < h->capacity; n++) {
+        if (NULL == h->entries[i].key || h->entries[i].key == k) {
+            return i;
+        }
+        i = (i + 1) & (h->capacity - 1);
+    }
+    return h->capacity;
 }
 
-int htab_erase(JSONHashTable *htab, const char *key)
+#define htab_found(h, i) ((i) != (h)->capacity && (h)->entries[i].key)
+
+static void htab_erase_at(JSONHashTable *htab, uint64_t i)
 {
-    uint64_t i, s, e;
+    uint64_t j, home, mask;
 
     /* remove a element */
-    i = htab_find_id(htab, key);
-    if (i == htab->capacity || NULL == htab->entries[i].key) {
-        THROW_WARNING("hash table try to find index by non-existent key");
-        return -1;
-    }
     entry_removed_in(htab, i);
     entry_clear(&htab->entries[i]);
     htab->size -= 1;
 
-    /* reorder */
-    s = hash_key(key) & (htab->capacity - 1);
-    e = (i + 1) & (htab->capacity - 1);
-    for (;;) {
-        if (NULL == htab->entries[e].key) {
-            e = (e - 1) & (htab->capacity - 1);
-            break;
+    /* small table: close the gap, entries stay packed in order */
+    if (htab_is_small(htab)) {
+        for (j = i + 1; j <= htab->size; j++) {
+            entry_moved_in(htab, j, j - 1);
         }
-        e = (e + 1) & (htab->capacity - 1);
+        return ;
     }
-    entries_reorder(htab, s, i, e);
 
-    return 0;
+    /*
+     * backward-shift deletion: walk the rest of the cluster once and
+     * pull back every entry whose home slot does not lie cyclically
+     * in (i, j], so no probe chain is broken by the new hole at i
+     */
+    mask = htab->capacity - 1;
+    for (j = (i + 1) & mask; htab->entries[j].key; j = (j + 1) & mask) {
+        home = htab_key_hash(htab, htab->entries[j].key) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            entry_moved_in(htab, j, i);
+            i = j;
+        }
+    }
 }
 
 /* check if type of val matches type of found element */
-int htab_find(const JSONHashTable *htab, const char *key, JSON *val)
+static int htab_find_at(const JSONHashTable *htab, uint64_t i, JSON *val, int ref)
 {
-    uint64_t i = htab_find_id(htab, key);
-    if (i == htab->capacity || NULL == htab->entries[i].key) {
+    if (!htab_found(htab, i)) {
         THROW_WARNING("hash table try to find index by non-existent key");
         return -1;
     }
@@ -350,62 +742,159 @@ int htab_find(const JSONHashTable *htab, const char *key, JSON *val)
     if (val->data) {
         json_free_data(val);
     }
-    json_copy(val, &(htab->entries[i].value));
+    if (ref) {
+        *val = htab->entries[i].value;
+    } else {
+        json_copy(val, &(htab->entries[i].value));
+    }
 
     return 0;
 }
 
-int htab_find_ref(const JSONHashTable *htab, const char *key, JSON *val)
+static int htab_update_at(JSONHashTable *htab, uint64_t i, const JSON *val, int ref)
 {
-    uint64_t i = htab_find_id(htab, key);
-    if (i == htab->capacity || NULL == htab->entries[i].key) {
-        THROW_WARNING("hash table try to find index by non-existent key");
+    if (htab_frozen(htab)) {
         return -1;
     }
-
-    if (val->type != htab->entries[i].value.type) {
-        THROW_WARNING("type of VAL can't match type of found element");
+    if (!htab_found(htab, i)) {
+        THROW_WARNING("hash table try to find index by non-existent key");
         return -1;
     }
-    /* free exist data */
-    if (val->data) {
-        json_free_data(val);
+
+    /* free old entry data */
+    json_free_data(&(htab->entries[i].value));
+    /* update type and value */
+    if (ref) {
+        htab->entries[i].value = *val;
+    } else {
+        json_copy(&(htab->entries[i].value), val);
     }
-    *val = htab->entries[i].value;
 
     return 0;
 }
 
-int htab_update(JSONHashTable *htab, const char *key, const JSON *val)
+int htab_erase(JSONHashTable *htab, const char *key)
 {
-    uint64_t i = htab_find_id(htab, key);
-    if (i == htab->capacity || NULL == htab->entries[i].key) {
+    uint64_t i;
+
+    if (htab_frozen(htab)) {
+        return -1;
+    }
+    i = htab_find_id(htab, key);
+    if (!htab_found(htab, i)) {
         THROW_WARNING("hash table try to find index by non-existent key");
         return -1;
     }
+    htab_erase_at(htab, i);
+    htab_trim(htab);
+    return 0;
+}
 
-    /* free old entry data */
-    json_free_data(&(htab->entries[i].value));
-    /* update type and value */
-    json_copy(&(htab->entries[i].value), val);
+int htab_erase_k(JSONHashTable *htab, const char *ikey)
+{
+    uint64_t i;
 
+    if (htab_frozen(htab)) {
+        return -1;
+    }
+    i = htab_probe_key(htab, ikey);
+    if (!htab_found(htab, i)) {
+        THROW_WARNING("hash table try to find index by non-existent key");
+        return -1;
+    }
+    htab_erase_at(htab, i);
+    htab_trim(htab);
     return 0;
 }
 
-int htab_update_ref(JSONHashTable *htab, const char *key, const JSON *val)
+int htab_find(const JSONHashTable *htab, const char *key, JSON *val)
+{
+    return htab_find_at(htab, htab_find_id(htab, key), val, 0);
+}
+
+int htab_find_ref(const JSONHashTable *htab, const char *key, JSON *val)
+{
+    return htab_find_at(htab, htab_find_id(htab, key), val, 1);
+}
+
+/* borrowed value of KEY, or NULL if KEY does not exist */
+const JSON *htab_view(const JSONHashTable *htab, const char *key)
 {
     uint64_t i = htab_find_id(htab, key);
-    if (i == htab->capacity || NULL == htab->entries[i].key) {
-        THROW_WARNING("hash table try to find index by non-existent key");
-        return -1;
+    return htab_found(htab, i) ? &htab->entries[i].value : NULL;
+}
+
+int htab_find_k(const JSONHashTable *htab, const char *ikey, JSON *val)
+{
+    return htab_find_at(htab, htab_probe_key(htab, ikey), val, 0);
+}
+
+int htab_find_ref_k(const JSONHashTable *htab, const char *ikey, JSON *val)
+{
+    return htab_find_at(htab, htab_probe_key(htab, ikey), val, 1);
+}
+
+const JSON *htab_view_k(const JSONHashTable *htab, const char *ikey)
+{
+    uint64_t i = htab_probe_key(htab, ikey);
+    return htab_found(htab, i) ? &htab->entries[i].value : NULL;
+}
+
+/* keys looked up together: hashed and prefetched before any is probed */
+#define HTAB_BATCH 16
+
+/* borrowed values of N keys into VALS, { NULL, 0 } for a missing key */
+int htab_view_many(const JSONHashTable *htab, const char *const keys[], int n, JSON vals[])
+{
+    size_t len[HTAB_BATCH];
+    uint64_t hash[HTAB_BATCH], home[HTAB_BATCH], i;
+    int b, j, m, found = 0;
+
+    for (b = 0; b < n; b += HTAB_BATCH) {
+        m = n - b < HTAB_BATCH ? n - b : HTAB_BATCH;
+        /* hash the batch and start loading every home slot */
+        for (j = 0; j < m; j++) {
+            len[j] = strlen(keys[b + j]);
+            hash[j] = key_hash_str(keys[b + j], len[j]);
+            if (htab_is_small(htab)) {
+                continue;
+            }
+            home[j] = htab->disp ? htab_phf_probe(htab, hash[j]) :
+                htab_hash(htab, keys[b + j], len[j], hash[j]) & (htab->capacity - 1);
+            __builtin_prefetch(&htab->entries[home[j]]);
+        }
+        /* then the keys in them, compared by their header first */
+        if (!htab_is_small(htab)) {
+            for (j = 0; j < m; j++) {
+                if (htab->entries[home[j]].key) {
+                    __builtin_prefetch(key_rec(htab->entries[home[j]].key));
+                }
+            }
+        }
+        /* the misses are in flight together, resolve the probes */
+        for (j = 0; j < m; j++) {
+            i = htab_probe(htab, keys[b + j], len[j], hash[j], NULL);
+            if (htab_found(htab, i)) {
+                vals[b + j] = htab->entries[i].value;
+                found++;
+            } else {
+                vals[b + j].data = NULL;
+                vals[b + j].type = 0;
+            }
+        }
     }
 
-    /* free old entry data */
-    json_free_data(&(htab->entries[i].value));
-    /* update type and value */
-    htab->entries[i].value = *val;
+    return found;
+}
 
-    return 0;
+int htab_update(JSONHashTable *htab, const char *key, const JSON *val)
+{
+    return htab_update_at(htab, htab_find_id(htab, key), val, 0);
+}
+
+int htab_update_ref(JSONHashTable *htab, const char *key, const JSON *val)
+{
+    return htab_update_at(htab, htab_find_id(htab, key), val, 1);
 }
 
 int htab_set(JSONHashTable *htab, const char *key, const JSON *val)
@@ -413,8 +902,8 @@ int htab_set(JSONHashTable *htab, const char *key, const JSON *val)
     uint64_t i = htab_find_id(htab, key);
 
     /* free old entry data if exist */
-    if (htab->entries[i].key) {
-        if (htab_update(htab, key, val)) {
+    if (htab_found(htab, i)) {
+        if (htab_update_at(htab, i, val, 0)) {
             THROW_WARNING("HTAB set using update method error");
             return -1;
         }
@@ -434,8 +923,8 @@ int htab_set_ref(JSONHashTable *htab, const char *key, const JSON *val)
     uint64_t i = htab_find_id(htab, key);
 
     /* free old entry data if exist */
-    if (htab->entries[i].key) {
-        if (htab_update_ref(htab, key, val)) {
+    if (htab_found(htab, i)) {
+        if (htab_update_at(htab, i, val, 1)) {
             THROW_WARNING("HTAB set using update method error");
             return -1;
         }
@@ -450,6 +939,48 @@ int htab_set_ref(JSONHashTable *htab, const char *key, const JSON *val)
     return 0;
 }
 
+static int htab_set_at_k(JSONHashTable *htab, const char *ikey, const JSON *val, int ref)
+{
+    uint64_t i;
+
+    if (htab_frozen(htab)) {
+        return -1;
+    }
+    i = htab_probe_key(htab, ikey);
+
+    if (htab_found(htab, i)) {
+        if (htab_update_at(htab, i, val, ref)) {
+            THROW_WARNING("HTAB set using update method error");
+            return -1;
+        }
+        return 0;
+    }
+
+    /* not found: insert, sharing the interned key */
+    i = htab_insert_id(htab, ikey, key_len(ikey), key_hash(ikey));
+    htab->entries[i].key = (char *)key_retain(ikey);
+    if (ref) {
+        htab->entries[i].value = *val;
+    } else {
+        json_copy(&(htab->entries[i].value), val);
+    }
+    htab->size += 1;
+    entry_placed_in(htab, i);
+
+    return 0;
+}
+
+int htab_set_k(JSONHashTable *htab, const char *ikey, const JSON *val)
+{
+    return htab_set_at_k(htab, ikey, val, 0);
+}
+
+/* take data of VAL if it returns 0 */
+int htab_set_ref_k(JSONHashTable *htab, const char *ikey, const JSON *val)
+{
+    return htab_set_at_k(htab, ikey, val, 1);
+}
+
 JSONHashTableIter htab_begin(const JSONHashTable *h)
 {
     JSONHashTableIter iter = {
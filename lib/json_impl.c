@@ -8,6 +8,13 @@
 #include "lib/json_htab.h"
 #include "lib/json_utils.h"
 
+/*
+ * copies of a object or array share its data until one of them is
+ * modified, every member function that modifies data calls these first
+ */
+#define obj_unshare(obj) ((obj)->data = htab_unshare((obj)->data))
+#define arr_unshare(arr) ((arr)->data = list_unshare((arr)->data))
+
 JSONObject *obj_default_cstr()
 {
     JSONObject *d;
@@ -55,7 +62,7 @@ JSONObject *obj_copy_cstr(const void *val)
     assert(s->data);
 
     d = json_xmallocz(sizeof *d);
-    JSON_OBJECT_CLASS(d, htab_create_copy(s->data));
+    JSON_OBJECT_CLASS(d, htab_retain(s->data));
 
     return d;
 }
@@ -69,20 +76,36 @@ JSONObject obj_copy(const void *val)
     assert(s->type == JSON_TYPE_OBJECT);
     assert(s->data);
 
-    JSON_OBJECT_CLASS(&d, htab_create_copy(s->data));
+    JSON_OBJECT_CLASS(&d, htab_retain(s->data));
+
+    return d;
+}
+
+/* a compact handle: the data and the type, no member functions */
+JSON obj_handle(void)
+{
+    JSON d = { htab_create(1), JSON_TYPE_OBJECT };
 
     return d;
 }
 
 void obj_add(JSONObject *obj, const char *key, const void *val)
 {
+    JSON json = { NULL, 0 };
+
     assert(obj->data && key && val);
-    htab_insert(obj->data, key, val);
+    /* copy before unsharing, so obj may be added to itself */
+    json_copy(&json, val);
+    obj_unshare(obj);
+    if (htab_insert_ref(obj->data, key, &json)) {
+        json_free_data(&json);
+    }
 }
 
 void obj_add_ref(JSONObject *obj, const char *key, const void *val)
 {
     assert(obj->data && key && val);
+    obj_unshare(obj);
     htab_insert_ref(obj->data, key, val);
 }
 
@@ -94,6 +117,7 @@ void obj_add_str(JSONObject *obj, const char *key, const char *val)
     };
 
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_insert(obj->data, key, &json);
 }
 
@@ -105,6 +129,7 @@ void obj_add_num(JSONObject *obj, const char *key, int val)
     };
 
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_insert(obj->data, key, &json);
 }
 
@@ -116,6 +141,7 @@ void obj_add_true(JSONObject *obj, const char *key)
     };
 
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_insert(obj->data, key, &json);
 }
 
@@ -127,6 +153,7 @@ void obj_add_false(JSONObject *obj, const char *key)
     };
 
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_insert(obj->data, key, &json);
 }
 
@@ -138,27 +165,57 @@ void obj_add_null(JSONObject *obj, const char *key)
     };
 
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_insert(obj->data, key, &json);
 }
 
+/* take data of VAL, which is left empty */
+void obj_add_move(JSONObject *obj, const char *key, void *val)
+{
+    assert(obj->data && key && val);
+    obj_unshare(obj);
+    if (0 == htab_insert_ref(obj->data, key, val)) {
+        ((JSON *)val)->data = NULL;
+    }
+}
+
 void obj_del(JSONObject *obj, const char *key)
 {
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_erase(obj->data, key);
 }
 
 void obj_set(JSONObject *obj, const char *key, const void *val)
 {
+    JSON json = { NULL, 0 };
+
     assert(obj->data && key && val);
-    htab_set(obj->data, key, val);
+    /* copy before unsharing, so obj may be set in itself */
+    json_copy(&json, val);
+    obj_unshare(obj);
+    if (htab_set_ref(obj->data, key, &json)) {
+        json_free_data(&json);
+    }
 }
 
 void obj_set_ref(JSONObject *obj, const char *key, const void *val)
 {
     assert(obj->data && key && val);
+    obj_unshare(obj);
     htab_set_ref(obj->data, key, val);
 }
 
+/* take data of VAL, which is left empty */
+void obj_set_move(JSONObject *obj, const char *key, void *val)
+{
+    assert(obj->data && key && val);
+    obj_unshare(obj);
+    if (0 == htab_set_ref(obj->data, key, val)) {
+        ((JSON *)val)->data = NULL;
+    }
+}
+
 void obj_set_str(JSONObject *obj, const char *key, const char *val)
 {
     JSON json = {
@@ -167,6 +224,7 @@ void obj_set_str(JSONObject *obj, const char *key, const char *val)
     };
 
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_set(obj->data, key, &json);
 }
 
@@ -178,6 +236,7 @@ void obj_set_num(JSONObject *obj, const char *key, int val)
     };
 
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_set(obj->data, key, &json);
 }
 
@@ -189,6 +248,7 @@ void obj_set_true(JSONObject *obj, const char *key)
     };
 
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_set(obj->data, key, &json);
 }
 
@@ -200,6 +260,7 @@ void obj_set_false(JSONObject *obj, const char *key)
     };
 
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_set(obj->data, key, &json);
 }
 
@@ -211,6 +272,7 @@ void obj_set_null(JSONObject *obj, const char *key)
     };
 
     assert(obj->data && key);
+    obj_unshare(obj);
     htab_set(obj->data, key, &json);
 }
 
@@ -239,6 +301,9 @@ char *obj_get_str(const JSONObject *obj, const char *key)
 
     assert(obj->data && key);
     htab_find(obj->data, key, &json);
+    if (json.data) {
+        json_xdetach(json.data);
+    }
 
     return json.data;
 }
@@ -256,20 +321,141 @@ char *obj_get_str_ref(const JSONObject *obj, const char *key)
     return json.data;
 }
 
+/* read the number in place, no copy is made */
 int obj_get_num(const JSONObject *obj, const char *key)
 {
-    int num;
     JSON json = {
         .type = JSON_TYPE_NUMBER,
         .data = NULL
     };
 
     assert(obj->data && key);
-    htab_find(obj->data, key, &json);
-    num = *(int *)json.data;
+    if (htab_find_ref(obj->data, key, &json)) {
+        return 0;
+    }
+
+    return *(int *)json.data;
+}
+
+/* type of the value of KEY, 0 if KEY does not exist */
+int obj_get_type(const JSONObject *obj, const char *key)
+{
+    const JSON *v;
+
+    assert(obj->data && key);
+    v = htab_view(obj->data, key);
+
+    return v ? v->type : 0;
+}
+
+/* the keys are hashed and their slots loaded together, see htab_view_many */
+int obj_get_many(const JSONObject *obj, const char *const keys[], int n, JSON vals[])
+{
+    assert(obj->data && n >= 0 && (0 == n || (keys && vals)));
+    return htab_view_many(obj->data, keys, n, vals);
+}
+
+void obj_reserve(JSONObject *obj, int n)
+{
+    assert(obj->data && n >= 0);
+    obj_unshare(obj);
+    htab_reserve(obj->data, n);
+}
+
+void obj_shrink_to_fit(JSONObject *obj)
+{
+    assert(obj->data);
+    obj_unshare(obj);
+    htab_shrink(obj->data);
+}
+
+void obj_del_k(JSONObject *obj, JSONKey key)
+{
+    assert(obj->data && key);
+    obj_unshare(obj);
+    htab_erase_k(obj->data, key);
+}
+
+void obj_set_k(JSONObject *obj, JSONKey key, const void *val)
+{
+    JSON json = { NULL, 0 };
+
+    assert(obj->data && key && val);
+    /* copy before unsharing, so obj may be set in itself */
+    json_copy(&json, val);
+    obj_unshare(obj);
+    if (htab_set_ref_k(obj->data, key, &json)) {
+        json_free_data(&json);
+    }
+}
+
+void obj_set_str_k(JSONObject *obj, JSONKey key, const char *val)
+{
+    JSON json = {
+        .type = JSON_TYPE_STRING,
+        .data = (char *)val
+    };
+
+    assert(obj->data && key);
+    obj_unshare(obj);
+    htab_set_k(obj->data, key, &json);
+}
+
+void obj_set_num_k(JSONObject *obj, JSONKey key, int val)
+{
+    JSON json = {
+        .type = JSON_TYPE_NUMBER,
+        .data = &val
+    };
+
+    assert(obj->data && key);
+    obj_unshare(obj);
+    htab_set_k(obj->data, key, &json);
+}
+
+void *obj_get_k(const JSONObject *obj, JSONKey key, void *val)
+{
+    assert(obj->data && key && val);
+    htab_find_k(obj->data, key, val);
+
+    return val;
+}
+
+void *obj_get_ref_k(const JSONObject *obj, JSONKey key, void *val)
+{
+    assert(obj->data && key && val);
+    htab_find_ref_k(obj->data, key, val);
+
+    return val;
+}
+
+char *obj_get_str_ref_k(const JSONObject *obj, JSONKey key)
+{
+    JSON json = {
+        .type = JSON_TYPE_STRING,
+        .data = NULL
+    };
+
+    assert(obj->data && key);
+    htab_find_ref_k(obj->data, key, &json);
+
+    return json.data;
+}
+
+/* read the number in place, no copy is made */
+int obj_get_num_k(const JSONObject *obj, JSONKey key)
+{
+    JSON json = {
+        .type = JSON_TYPE_NUMBER,
+        .data = NULL
+    };
 
-    json_xfree(json.data);
-    return num;
+    assert(obj->data && key);
+    if (htab_find_ref_k(obj->data, key, &json)) {
+        return 0;
+    }
+
+    return *(int *)json.data;
 }
 
 JSONObjectIter obj_begin(const JSONObject *obj)
@@ -337,7 +523,7 @@ JSONArray *arr_copy_cstr(const void *val)
     assert(s->data);
 
     d = json_xmallocz(sizeof *d);
-    JSON_ARRAY_CLASS(d, list_create_copy(s->data));
+    JSON_ARRAY_CLASS(d, list_retain(s->data));
 
     return d;
 }
@@ -351,15 +537,39 @@ JSONArray arr_copy(const void *val)
     assert(s->type == JSON_TYPE_ARRAY);
     assert(s->data);
 
-    JSON_ARRAY_CLASS(&d, list_create_copy(s->data));
+    JSON_ARRAY_CLASS(&d, list_retain(s->data));
+
+    return d;
+}
+
+JSON arr_handle(void)
+{
+    JSON d = { list_create(), JSON_TYPE_ARRAY };
 
     return d;
 }
 
 void arr_add(JSONArray *arr, int pos, const void *val)
+{
+    JSON json = { NULL, 0 };
+
+    assert(arr->data && val);
+    /* copy before unsharing, so arr may be added to itself */
+    json_copy(&json, val);
+    arr_unshare(arr);
+    if (list_insert_ref(arr->data, pos, &json)) {
+        json_free_data(&json);
+    }
+}
+
+/* take data of VAL, which is left empty */
+void arr_add_move(JSONArray *arr, int pos, void *val)
 {
     assert(arr->data && val);
-    list_insert(arr->data, pos, val);
+    arr_unshare(arr);
+    if (0 == list_insert_ref(arr->data, pos, val)) {
+        ((JSON *)val)->data = NULL;
+    }
 }
 
 void arr_add_str(JSONArray *arr, int pos, const char *val)
@@ -370,6 +580,7 @@ void arr_add_str(JSONArray *arr, int pos, const char *val)
     };
 
     assert(arr->data);
+    arr_unshare(arr);
     list_insert(arr->data, pos, &json);
 }
 
@@ -381,6 +592,7 @@ void arr_add_num(JSONArray *arr, int pos, int val)
     };
 
     assert(arr->data);
+    arr_unshare(arr);
     list_insert(arr->data, pos, &json);
 }
 
@@ -392,6 +604,7 @@ void arr_add_true(JSONArray *arr, int pos)
     };
 
     assert(arr->data);
+    arr_unshare(arr);
     list_insert(arr->data, pos, &json);
 }
 
@@ -403,6 +616,7 @@ void arr_add_false(JSONArray *arr, int pos)
     };
 
     assert(arr->data);
+    arr_unshare(arr);
     list_insert(arr->data, pos, &json);
 }
 
@@ -414,19 +628,38 @@ void arr_add_null(JSONArray *arr, int pos)
     };
 
     assert(arr->data);
+    arr_unshare(arr);
     list_insert(arr->data, pos, &json);
 }
 
 void arr_del(JSONArray *arr, int pos)
 {
     assert(arr->data);
+    arr_unshare(arr);
     list_erase(arr->data, pos);
 }
 
 void arr_set(JSONArray *arr, int pos, const void *val)
+{
+    JSON json = { NULL, 0 };
+
+    assert(arr->data && val);
+    /* copy before unsharing, so arr may be set in itself */
+    json_copy(&json, val);
+    arr_unshare(arr);
+    if (list_set_ref(arr->data, pos, &json)) {
+        json_free_data(&json);
+    }
+}
+
+/* take data of VAL, which is left empty */
+void arr_set_move(JSONArray *arr, int pos, void *val)
 {
     assert(arr->data && val);
-    list_set(arr->data, pos, val);
+    arr_unshare(arr);
+    if (0 == list_set_ref(arr->data, pos, val)) {
+        ((JSON *)val)->data = NULL;
+    }
 }
 
 void arr_set_str(JSONArray *arr, int pos, const char *val)
@@ -437,6 +670,7 @@ void arr_set_str(JSONArray *arr, int pos, const char *val)
     };
 
     assert(arr->data);
+    arr_unshare(arr);
     list_set(arr->data, pos, &json);
 }
 
@@ -448,6 +682,7 @@ void arr_set_num(JSONArray *arr, int pos, int val)
     };
 
     assert(arr->data);
+    arr_unshare(arr);
     list_set(arr->data, pos, &json);
 }
 void arr_set_true(JSONArray *arr, int pos)
@@ -458,6 +693,7 @@ void arr_set_true(JSONArray *arr, int pos)
     };
 
     assert(arr->data);
+    arr_unshare(arr);
     list_set(arr->data, pos, &json);
 }
 
@@ -469,6 +705,7 @@ void arr_set_false(JSONArray *arr, int pos)
     };
 
     assert(arr->data);
+    arr_unshare(arr);
     list_set(arr->data, pos, &json);
 }
 
@@ -480,6 +717,7 @@ void arr_set_null(JSONArray *arr, int pos)
     };
 
     assert(arr->data);
+    arr_unshare(arr);
     list_set(arr->data, pos, &json);
 }
 
@@ -500,30 +738,322 @@ char *arr_get_str(const JSONArray *arr, int pos)
 
     assert(arr->data);
     list_find(arr->data, pos, &json);
+    if (json.data) {
+        json_xdetach(json.data);
+    }
+
+    return json.data;
+}
+
+void *arr_get_ref(const JSONArray *arr, int pos, void *val)
+{
+    assert(arr->data && val);
+    list_find_ref(arr->data, pos, val);
+
+    return val;
+}
+
+char *arr_get_str_ref(const JSONArray *arr, int pos)
+{
+    JSON json = {
+        .type = JSON_TYPE_STRING,
+        .data = NULL
+    };
+
+    assert(arr->data);
+    list_find_ref(arr->data, pos, &json);
 
     return json.data;
 }
 
+/* read the number in place, no copy is made */
 int arr_get_num(const JSONArray *arr, int pos)
 {
-    int num;
     JSON json = {
         .type = JSON_TYPE_NUMBER,
         .data = NULL
     };
 
     assert(arr->data);
-    list_find(arr->data, pos, &json);
-    num = *(int *)json.data;
+    if (list_find_ref(arr->data, pos, &json)) {
+        return 0;
+    }
+
+    return *(int *)json.data;
+}
+
+/* type of the item at POS, 0 if POS is out of range */
+int arr_get_type(const JSONArray *arr, int pos)
+{
+    JSON v;
 
-    json_xfree(json.data);
-    return num;
+    assert(arr->data);
+    if (list_view(arr->data, pos, &v)) {
+        return 0;
+    }
+    return v.type;
+}
+
+void arr_reserve(JSONArray *arr, int n)
+{
+    assert(arr->data && n >= 0);
+    arr_unshare(arr);
+    list_reserve(arr->data, n);
+}
+
+void arr_shrink_to_fit(JSONArray *arr)
+{
+    assert(arr->data);
+    arr_unshare(arr);
+    list_shrink(arr->data);
+}
+
+/* comparators on data of two numbers or of two strings, for sort */
+int json_cmp_num(const void *a, const void *b)
+{
+    return (*(const int *)a > *(const int *)b) - (*(const int *)a < *(const int *)b);
+}
+
+int json_cmp_str(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+static int sort_cmp_data(const JSON *a, const JSON *b, const void *ctx)
+{
+    int (*const *compare_fn)(const void *, const void *) = ctx;
+
+    return (*compare_fn)(a->data, b->data);
+}
+
+void arr_sort_with(JSONArray *arr, int (*compare_fn)(const void *, const void *), int flags)
+{
+    JSONListOrder order = {
+        .compare = sort_cmp_data,
+        .ctx = &compare_fn,
+        .flags = flags
+    };
+
+    assert(arr->data && compare_fn);
+    arr_unshare(arr);
+    list_sort(arr->data, &order);
 }
 
 void arr_qsort(JSONArray *arr, int (*compare_fn)(const void *, const void *))
 {
+    arr_sort_with(arr, compare_fn, 0);
+}
+
+/* interned keys of a path of sort_by */
+typedef struct ArrSortPath {
+    int depth;
+    const char **keys;
+} ArrSortPath;
+
+static const JSON *sort_path_key(const JSON *v, const void *ctx)
+{
+    int i;
+    const ArrSortPath *path = ctx;
+
+    for (i = 0; v && i < path->depth; i++) {
+        v = JSON_TYPE_OBJECT == v->type ? htab_view_k(v->data, path->keys[i]) : NULL;
+    }
+    return v;
+}
+
+/* rank of the types in sort_by, a missing value is the last one */
+static int sort_type_rank(int type)
+{
+    switch (type) {
+        case JSON_TYPE_NUMBER:
+            return 0;
+        case JSON_TYPE_STRING:
+            return 1;
+        case JSON_TYPE_FALSE:
+            return 2;
+        case JSON_TYPE_TRUE:
+            return 3;
+        case JSON_TYPE_NULL:
+            return 4;
+        case JSON_TYPE_OBJECT:
+        case JSON_TYPE_ARRAY:
+            return 5;
+        default:
+            return 6;
+    }
+}
+
+static int sort_cmp_typed(const JSON *a, const JSON *b, const void *ctx)
+{
+    int ra = sort_type_rank(a->type), rb = sort_type_rank(b->type);
+
+    if (ra != rb) {
+        return ra - rb;
+    }
+    switch (a->type) {
+        case JSON_TYPE_NUMBER:
+            return json_cmp_num(a->data, b->data);
+        case JSON_TYPE_STRING:
+            return json_cmp_str(a->data, b->data);
+        default:
+            return 0;
+    }
+}
+
+void arr_sort_by(JSONArray *arr, const char *path, int flags)
+{
+    int i;
+    const char *p, *dot;
+    ArrSortPath sp = { 0, NULL };
+    JSONListOrder order = {
+        .compare = sort_cmp_typed,
+        .key = sort_path_key,
+        .ctx = &sp,
+        .flags = flags
+    };
+
+    assert(arr->data);
+    arr_unshare(arr);
+    if (path && *path) {
+        for (sp.depth = 1, p = path; *p; p++) {
+            sp.depth += '.' == *p;
+        }
+        sp.keys = json_xmallocz(sp.depth * sizeof(char *));
+        for (i = 0, p = path; i < sp.depth; i++, p = dot + 1) {
+            dot = strchr(p, '.');
+            dot = dot ? dot : p + strlen(p);
+            sp.keys[i] = key_intern_len(p, dot - p, key_hash_str(p, dot - p));
+        }
+    }
+    list_sort(arr->data, &order);
+    for (i = 0; i < sp.depth; i++) {
+        key_release(sp.keys[i]);
+    }
+    if (sp.keys) {
+        json_xfree(sp.keys);
+    }
+}
+
+long long arr_sum(const JSONArray *arr)
+{
+    int count;
+
+    assert(arr->data);
+    return list_sum(arr->data, &count);
+}
+
+int arr_min(const JSONArray *arr)
+{
+    int min, max;
+
+    assert(arr->data);
+    if (0 == list_min_max(arr->data, &min, &max)) {
+        return 0;
+    }
+    return min;
+}
+
+int arr_max(const JSONArray *arr)
+{
+    int min, max;
+
+    assert(arr->data);
+    if (0 == list_min_max(arr->data, &min, &max)) {
+        return 0;
+    }
+    return max;
+}
+
+double arr_mean(const JSONArray *arr)
+{
+    int count;
+    long long sum;
+
     assert(arr->data);
-    list_qsort(arr->data, compare_fn);
+    sum = list_sum(arr->data, &count);
+    return count ? (double)sum / count : 0;
+}
+
+int arr_count_if(const JSONArray *arr, int (*pred)(int val))
+{
+    assert(arr->data && pred);
+    return list_count_if(arr->data, pred);
+}
+
+/* put the value V of row R into column C, or mark the row null */
+static void column_put(JSONColumn *c, int rows, int r, const JSON *v)
+{
+    int type;
+
+    type = v ? v->type : JSON_TYPE_NULL;
+    type = JSON_TYPE_FALSE == type ? JSON_TYPE_TRUE : type;
+    if (0 == c->type && type != JSON_TYPE_NULL) {
+        c->type = type;
+        if (JSON_TYPE_NUMBER == type || JSON_TYPE_TRUE == type) {
+            c->nums = json_xmallocz(rows * sizeof(int));
+        } else if (JSON_TYPE_STRING == type) {
+            c->strs = json_xmallocz(rows * sizeof(char *));
+        }
+    }
+    if (type != c->type) {
+        c->nulls[r / 8] |= 1 << (r % 8);
+    } else if (JSON_TYPE_NUMBER == type) {
+        c->nums[r] = *(int *)v->data;
+    } else if (JSON_TYPE_TRUE == type) {
+        c->nums[r] = JSON_TYPE_TRUE == v->type;
+    } else if (JSON_TYPE_STRING == type) {
+        c->strs[r] = v->data;
+    }
+}
+
+/* one lookup by interned key per row and key, no value is copied */
+JSONColumns *arr_columnize(const JSONArray *arr, const char *const keys[], int n)
+{
+    int i, r;
+    JSONColumns *cols;
+    JSONArrayIter iter, end;
+
+    assert(arr->data && keys && n >= 0);
+    cols = json_xmallocz(sizeof(*cols));
+    cols->rows = ((JSONLinkedList *)arr->data)->size;
+    cols->ncols = n;
+    cols->cols = json_xmallocz((n ? n : 1) * sizeof(JSONColumn));
+    for (i = 0; i < n; i++) {
+        cols->cols[i].key = key_intern(keys[i]);
+        cols->cols[i].nulls = json_xmallocz(cols->rows / 8 + 1);
+    }
+
+    r = 0;
+    iter = list_begin(arr->data);
+    end = list_end(arr->data);
+    jsong_list_foreach(iter, end) {
+        for (i = 0; i < n; i++) {
+            column_put(&cols->cols[i], cols->rows, r,
+                JSON_TYPE_OBJECT == iter.value.type ?
+                htab_view_k(iter.value.data, cols->cols[i].key) : NULL);
+        }
+        r++;
+    }
+    return cols;
+}
+
+void json_columns_free(JSONColumns *cols)
+{
+    int i;
+
+    assert(cols);
+    for (i = 0; i < cols->ncols; i++) {
+        key_release(cols->cols[i].key);
+        if (cols->cols[i].nums) {
+            json_xfree(cols->cols[i].nums);
+        }
+        if (cols->cols[i].strs) {
+            json_xfree(cols->cols[i].strs);
+        }
+        json_xfree(cols->cols[i].nulls);
+    }
+    json_xfree(cols->cols);
+    json_xfree(cols);
 }
 
 JSONArrayIter arr_begin(const JSONArray *arr)
@@ -632,10 +1162,21 @@ JSONString str_copy(const void *val)
     return d;
 }
 
+JSON str_handle(const char *val)
+{
+    JSON d = { json_xmallocz(strlen(val) + 1), JSON_TYPE_STRING };
+
+    strcat(d.data, val);
+
+    return d;
+}
+
 void str_set(JSONString *str, const char *val)
 {
-    assert(str->data);
-    json_xfree(str->data);
+    /* a moved-from string has no data left */
+    if (str->data) {
+        json_xfree(str->data);
+    }
 
     str->data = json_xmallocz(strlen(val) + 1);
     strcat(str->data, val);
@@ -646,16 +1187,23 @@ char *str_get(const JSONString *str)
     assert(str->data);
     char *chars = json_xmallocz(strlen(str->data) + 1);
     strcat(chars, str->data);
+    json_xdetach(chars);
 
     return chars;
 }
 
+char *str_get_ref(const JSONString *str)
+{
+    assert(str->data);
+    return str->data;
+}
+
 JSONNumber *num_assign_cstr(int val)
 {
     JSONNumber *d;
 
     d = json_xmallocz(sizeof *d);
-    JSON_NUMBER_CLASS(d, json_xmallocz(sizeof (int)));
+    JSON_NUMBER_CLASS(d, json_number_create());
 
     *(int *)d->data = val;
 
@@ -666,7 +1214,7 @@ JSONNumber num_assign(int val)
 {
     JSONNumber d;
 
-    JSON_NUMBER_CLASS(&d, json_xmallocz(sizeof (int)));
+    JSON_NUMBER_CLASS(&d, json_number_create());
     *(int *)d.data = val;
 
     return d;
@@ -698,7 +1246,7 @@ JSONNumber *num_copy_cstr(const void *val)
 
     s = val;
     d = json_xmallocz(sizeof *d);
-    JSON_NUMBER_CLASS(d, json_xmallocz(sizeof (int)));
+    JSON_NUMBER_CLASS(d, json_number_create());
 
     assert(s->data);
     assert(s->type == d->type);
@@ -707,9 +1255,21 @@ JSONNumber *num_copy_cstr(const void *val)
     return d;
 }
 
+JSON num_handle(int val)
+{
+    JSON d = { json_number_create(), JSON_TYPE_NUMBER };
+
+    *(int *)d.data = val;
+
+    return d;
+}
+
 void num_set(JSONNumber *num, int val)
 {
-    assert(num->data);
+    /* a moved-from number has no data left */
+    if (NULL == num->data) {
+        num->data = json_number_create();
+    }
     *(int *)num->data = val;
 }
 
@@ -737,6 +1297,13 @@ JSONTrue true_default()
     return d;
 }
 
+JSON true_handle(void)
+{
+    JSON d = { NULL, JSON_TYPE_TRUE };
+
+    return d;
+}
+
 JSONFalse *false_default_cstr()
 {
     JSONFalse *d;
@@ -755,6 +1322,13 @@ JSONFalse false_default()
     return d;
 }
 
+JSON false_handle(void)
+{
+    JSON d = { NULL, JSON_TYPE_FALSE };
+
+    return d;
+}
+
 JSONNull *null_default_cstr()
 {
     JSONNull *d;
@@ -771,4 +1345,11 @@ JSONNull null_default()
     JSON_NULL_CLASS(&d);
 
     return d;
-}
\ No newline at end of file
+}
+
+JSON null_handle(void)
+{
+    JSON d = { NULL, JSON_TYPE_NULL };
+
+    return d;
+}
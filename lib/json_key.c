@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lib/json_key.h"
+#include "lib/json_utils.h"
+
+
+#define POOL_MIN_BUCKETS 32
+#define POOL_SHARD_BITS 4
+#define POOL_SHARDS (1 << POOL_SHARD_BITS)
+
+/*
+ * Global key pool, chained hash tables of JSONKeyRec in shards picked
+ * by the top bits of the hash, so threads interning different keys
+ * rarely take the same lock. The lock of a shard guards its buckets
+ * and every refcnt transition from or to 0 of its keys; other refcnt
+ * changes are atomic. Each shard has a cache line of its own.
+ */
+typedef struct PoolShard {
+    JSONKeyRec **buckets;
+    uint64_t nbuckets, size;
+    pthread_mutex_t lock;
+} __attribute__((aligned(64))) PoolShard;
+
+static PoolShard g_pool[POOL_SHARDS];
+
+#define pool_shard(__hash) (&g_pool[(__hash) >> (64 - POOL_SHARD_BITS)])
+
+__attribute__((constructor))
+static void pool_init(void)
+{
+    int i;
+
+    for (i = 0; i < POOL_SHARDS; i++) {
+        pthread_mutex_init(&g_pool[i].lock, NULL);
+    }
+}
+
+/* per-process hash seed, keys sent by peers can't be aimed at a bucket */
+static uint64_t g_seed;
+
+static const uint64_t g_secret[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+__attribute__((constructor))
+static void key_seed_init(void)
+{
+    FILE *fp = fopen("/dev/urandom", "rb");
+
+    if (fp) {
+        if (fread(&g_seed, sizeof(g_seed), 1, fp) != 1) {
+            g_seed = 0;
+        }
+        fclose(fp);
+    }
+    if (0 == g_seed) {
+        /* no entropy source: at least differ between runs */
+        g_seed = (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32) ^
+            (uint64_t)(uintptr_t)&fp;
+    }
+}
+
+/* 64x64 -> 128 bit multiply, A gets the low and B the high half */
+static inline void wy_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl, lo, hi;
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    *a = lo;
+    *b = hi;
+#endif
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+    wy_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t wy_r8(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t wy_r4(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/* 1 to 3 bytes */
+static inline uint64_t wy_r3(const unsigned char *p, size_t k)
+{
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+/*
+ * Return 64-bit hash for key of LEN bytes under SEED, it consumes 16 bytes
+ * (48 bytes for long keys) per step. It follows wyhash final4, see:
+ * https://github.com/wangyi-fudan/wyhash
+ */
+uint64_t key_hash_seed(const char *key, size_t len, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *)key;
+    uint64_t a, b, see1, see2;
+    size_t i;
+
+    seed ^= wy_mix(seed ^ g_secret[0], g_secret[1]);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wy_r4(p) << 32) | wy_r4(p + ((len >> 3) << 2));
+            b = (wy_r4(p + len - 4) << 32) | wy_r4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = wy_r3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        i = len;
+        if (i > 48) {
+            see1 = see2 = seed;
+            do {
+                seed = wy_mix(wy_r8(p) ^ g_secret[1], wy_r8(p + 8) ^ seed);
+                see1 = wy_mix(wy_r8(p + 16) ^ g_secret[2], wy_r8(p + 24) ^ see1);
+                see2 = wy_mix(wy_r8(p + 32) ^ g_secret[3], wy_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wy_mix(wy_r8(p) ^ g_secret[1], wy_r8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wy_r8(p + i - 16);
+        b = wy_r8(p + i - 8);
+    }
+    a ^= g_secret[1];
+    b ^= seed;
+    wy_mum(&a, &b);
+    return wy_mix(a ^ g_secret[0] ^ len, b ^ g_secret[1]);
+}
+
+/* hash under the process seed, stored with every interned key */
+uint64_t key_hash_str(const char *key, size_t len)
+{
+    return key_hash_seed(key, len, g_seed);
+}
+
+/* a fresh non-zero seed, derived from the process seed by splitmix64 */
+uint64_t key_random_seed(void)
+{
+    static uint64_t counter;
+    uint64_t z;
+
+    z = g_seed + __atomic_add_fetch(&counter, 0x9e3779b97f4a7c15ULL, __ATOMIC_RELAXED);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return z ? z : 1;
+}
+
+static void pool_grow(PoolShard *sh)
+{
+    uint64_t i, n;
+    JSONKeyRec **buckets, *r, *next;
+
+    n = sh->nbuckets ? sh->nbuckets << 1 : POOL_MIN_BUCKETS;
+    buckets = json_xmallocz(n * sizeof(*buckets));
+    for (i = 0; i < sh->nbuckets; i++) {
+        for (r = sh->buckets[i]; r; r = next) {
+            next = r->next;
+            r->next = buckets[r->hash & (n - 1)];
+            buckets[r->hash & (n - 1)] = r;
+        }
+    }
+    if (sh->buckets) {
+        json_xfree(sh->buckets);
+    }
+    sh->buckets = buckets;
+    sh->nbuckets = n;
+}
+
+const char *key_intern_len(const char *str, size_t len, uint64_t hash)
+{
+    PoolShard *sh = pool_shard(hash);
+    JSONKeyRec *r, **b;
+
+    pthread_mutex_lock(&sh->lock);
+    if (sh->size >= sh->nbuckets) {
+        pool_grow(sh);
+    }
+    b = &sh->buckets[hash & (sh->nbuckets - 1)];
+    for (r = *b; r; r = r->next) {
+        if (r->hash == hash && r->len == len &&
+            0 == memcmp(r->str, str, len)) {
+            __atomic_add_fetch(&r->refcnt, 1, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&sh->lock);
+            return r->str;
+        }
+    }
+    /* first reference: create a record */
+    r = json_xmallocz(sizeof(*r) + len + 1);
+    memcpy(r->str, str, len);
+    r->hash = hash;
+    r->len = len;
+    r->refcnt = 1;
+    r->next = *b;
+    *b = r;
+    sh->size += 1;
+    pthread_mutex_unlock(&sh->lock);
+
+    return r->str;
+}
+
+const char *key_intern(const char *str)
+{
+    size_t len = strlen(str);
+    return key_intern_len(str, len, key_hash_str(str, len));
+}
+
+const char *key_retain(const char *key)
+{
+    __atomic_add_fetch(&key_rec(key)->refcnt, 1, __ATOMIC_RELAXED);
+    return key;
+}
+
+void key_release(const char *key)
+{
+    JSONKeyRec *r = key_rec(key), **b;
+    PoolShard *sh = pool_shard(r->hash);
+    uint32_t n = __atomic_load_n(&r->refcnt, __ATOMIC_RELAXED);
+
+    /* drop a reference that is not the last one without locking */
+    while (n > 1) {
+        if (__atomic_compare_exchange_n(&r->refcnt, &n, n - 1, 0,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return ;
+        }
+    }
+
+    pthread_mutex_lock(&sh->lock);
+    if (__atomic_sub_fetch(&r->refcnt, 1, __ATOMIC_ACQ_REL) != 0) {
+        pthread_mutex_unlock(&sh->lock);
+        return ;
+    }
+    /* last reference: unlink and free the record */
+    b = &sh->buckets[r->hash & (sh->nbuckets - 1)];
+    for (; *b != r; b = &(*b)->next) {
+        assert(*b);
+    }
+    *b = r->next;
+    sh->size -= 1;
+    /* a empty shard holds no memory, see json_set_allocator */
+    if (0 == sh->size) {
+        json_xfree(sh->buckets);
+        sh->buckets = NULL;
+        sh->nbuckets = 0;
+    }
+    pthread_mutex_unlock(&sh->lock);
+
+    json_xfree(r);
+}
+
+JSONKey json_key(const char *str)
+{
+    assert(str);
+    return key_intern(str);
+}
+
+void json_key_free(JSONKey key)
+{
+    assert(key);
+    key_release(key);
+}
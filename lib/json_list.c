@@ -2,26 +2,214 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "lib/json_list.h"
 #include "lib/json_utils.h"
 
+/* the aggregates read packed numbers four at a time */
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 9)
+#define LIST_VECTOR
+typedef int list_vint __attribute__((vector_size(16)));
+typedef long long list_vllong __attribute__((vector_size(32)));
+#endif
+
 
 static JSONNode *node_create()
 {
-    return json_xmallocz(sizeof(JSONNode));
+    return json_slab_alloc(JSON_SLAB_NODE, sizeof(JSONNode));
 }
 
 static void node_free(JSONNode *n)
 {
     assert(n);
     json_free_data(&(n->value));
-    json_xfree(n);
+    json_slab_free(JSON_SLAB_NODE, n);
+}
+
+/* take a node reserved by list_reserve, or create a new one */
+static JSONNode *list_node_create(JSONLinkedList *l)
+{
+    JSONNode *n = l->spare;
+
+    if (NULL == n) {
+        return node_create();
+    }
+    l->spare = n->next;
+    l->nspare -= 1;
+    n->next = NULL;
+    return n;
+}
+
+/* frozen lists are read-only, every modifier checks this first */
+static int list_frozen(const JSONLinkedList *l)
+{
+    if (l->frozen) {
+        THROW_WARNING("try to modify a frozen list");
+        return 1;
+    }
+    return 0;
+}
+
+/* packed_type a value of TYPE could be stored with, 0 if it needs a node */
+static int packed_kind(int type)
+{
+    switch (type) {
+        case JSON_TYPE_NUMBER:
+            return JSON_TYPE_NUMBER;
+        case JSON_TYPE_TRUE:
+        case JSON_TYPE_FALSE:
+            return JSON_TYPE_TRUE;
+        default:
+            return 0;
+    }
+}
+
+/* what V, a number or a boolean, is stored as in a packed list */
+static int packed_value(const JSON *v)
+{
+    return JSON_TYPE_NUMBER == v->type ? *(int *)v->data : JSON_TYPE_TRUE == v->type;
+}
+
+/* the value at P of a packed list of KIND, borrowed */
+static JSON packed_json(int kind, int *p)
+{
+    JSON v;
+
+    if (JSON_TYPE_NUMBER == kind) {
+        v.type = JSON_TYPE_NUMBER;
+        v.data = p;
+    } else {
+        v.type = *p ? JSON_TYPE_TRUE : JSON_TYPE_FALSE;
+        v.data = NULL;
+    }
+    return v;
+}
+
+/* make room for N values in the buffer of packed L */
+static void packed_reserve(JSONLinkedList *l, int n)
+{
+    int cap;
+
+    if (n <= l->packed_cap) {
+        return ;
+    }
+    for (cap = l->packed_cap ? l->packed_cap : 8; cap < n; cap <<= 1);
+    if (NULL == l->packed) {
+        l->packed = json_xmallocz((cap + 2) * sizeof(int));
+    } else {
+        l->packed = json_xreallocz(l->packed,
+            (l->packed_cap + 2) * sizeof(int), (cap + 2) * sizeof(int));
+    }
+    l->packed_cap = cap;
+}
+
+/* fit the buffer of packed L to its values */
+static void packed_shrink(JSONLinkedList *l)
+{
+    if (l->packed_cap == l->size) {
+        return ;
+    }
+    l->packed = json_xreallocz(l->packed,
+        (l->packed_cap + 2) * sizeof(int), (l->size + 2) * sizeof(int));
+    l->packed[l->size + 1] = 0;
+    l->packed_cap = l->size;
+}
+
+/* index in the buffer of packed L of the value at POS */
+static int packed_index(const JSONLinkedList *l, int pos)
+{
+    return (pos >= 0 ? pos : l->size + pos) + 1;
+}
+
+/* release the nodes reserved for elements that never came */
+static void list_free_spare(JSONLinkedList *l)
+{
+    JSONNode *curr, *next;
+
+    for (curr = l->spare; curr; curr = next) {
+        next = curr->next;
+        json_slab_free(JSON_SLAB_NODE, curr);
+    }
+    l->spare = NULL;
+    l->nspare = 0;
+}
+
+/* link N before IN */
+static void node_link(JSONNode *in, JSONNode *n)
+{
+    n->next = in;
+    n->prev = in->prev;
+    in->prev->next = n;
+    in->prev = n;
+}
+
+/*
+ * move the nodes of L, all numbers or all booleans, into a buffer of
+ * packed values, the room reserved for nodes is reserved in it instead
+ */
+static void list_pack(JSONLinkedList *l, int kind)
+{
+    int i, n;
+    JSONNode *curr, *next;
+
+    n = l->size + l->nspare;
+    list_free_spare(l);
+    l->packed_type = kind;
+    packed_reserve(l, n > 0 ? n : 1);
+    for (i = 1, curr = l->head; curr != l->nil; i++, curr = next) {
+        next = curr->next;
+        l->packed[i] = packed_value(&curr->value);
+        node_free(curr);
+    }
+    l->nil->next = l->nil->prev = l->nil;
+    l->head = l->tail = l->nil;
+}
+
+/* move the values of packed L back into nodes, for a value of another type */
+static void list_unpack(JSONLinkedList *l)
+{
+    int i;
+    JSONNode *n;
+
+    for (i = 1; i <= l->size; i++) {
+        n = node_create();
+        n->value = packed_json(l->packed_type, &l->packed[i]);
+        if (JSON_TYPE_NUMBER == n->value.type) {
+            n->value.data = json_number_create();
+            *(int *)n->value.data = l->packed[i];
+        }
+        node_link(l->nil, n);
+    }
+    json_xfree(l->packed);
+    l->packed = NULL;
+    l->packed_type = 0;
+    l->packed_cap = 0;
+    l->head = l->nil->next;
+    l->tail = l->nil->prev;
+}
+
+/* true if every value of L is a number, or every value is a boolean */
+static int list_packable(const JSONLinkedList *l)
+{
+    int kind;
+    const JSONNode *n;
+
+    if (0 == l->size) {
+        return 0;
+    }
+    kind = packed_kind(l->head->value.type);
+    for (n = l->head; kind && n != l->nil; n = n->next) {
+        if (packed_kind(n->value.type) != kind) {
+            return 0;
+        }
+    }
+    return kind;
 }
 
 JSONLinkedList *list_create()
 {
-    JSONLinkedList *l = json_xmallocz(sizeof *l);
+    JSONLinkedList *l = json_slab_alloc(JSON_SLAB_LIST, sizeof *l);
 
     /* create a dummy node */
     JSONNode *n = node_create();
@@ -31,6 +219,7 @@ JSONLinkedList *list_create()
     l->head =
     l->tail = n;
     l->size = 0;
+    l->refcnt = 1;
 
     return l;
 }
@@ -42,6 +231,13 @@ JSONLinkedList *list_create_copy(const JSONLinkedList *s)
     JSONNode *nn;
 
     d = list_create();
+    if (s->packed) {
+        d->packed_type = s->packed_type;
+        packed_reserve(d, s->size > 0 ? s->size : 1);
+        memcpy(&d->packed[1], &s->packed[1], s->size * sizeof(int));
+        d->size = s->size;
+        return d;
+    }
 
     in = s->head; /* start in head */
     en = s->nil; /* end */
@@ -68,6 +264,22 @@ void list_free(JSONLinkedList *l)
     JSONNode *curr, *end, *next;
 
     assert(l);
+    /* other copies still share it */
+    if (__atomic_sub_fetch(&l->refcnt, 1, __ATOMIC_ACQ_REL) != 0) {
+        return ;
+    }
+    /* a frozen list has its nodes in one block */
+    if (l->block) {
+        for (curr = l->head; curr != l->nil; curr = curr->next) {
+            json_free_data(&curr->value);
+        }
+        json_xfree(l->block);
+        json_slab_free(JSON_SLAB_LIST, l);
+        return ;
+    }
+    if (l->packed) {
+        json_xfree(l->packed);
+    }
     /* nodes free */
     curr = l->head; /* start in head */
     end = l->nil; /* end */
@@ -76,20 +288,152 @@ void list_free(JSONLinkedList *l)
         next = curr->next;
         node_free(curr);
     }
-    json_xfree(l->nil);
-    json_xfree(l);
+    list_free_spare(l);
+    json_slab_free(JSON_SLAB_NODE, l->nil);
+    json_slab_free(JSON_SLAB_LIST, l);
+}
+
+/* a O(1) copy: share L until one of the copies is modified */
+JSONLinkedList *list_retain(JSONLinkedList *l)
+{
+    __atomic_add_fetch(&l->refcnt, 1, __ATOMIC_RELAXED);
+    return l;
+}
+
+/* return a list owned only by the caller, cloning L if it is shared */
+JSONLinkedList *list_unshare(JSONLinkedList *l)
+{
+    JSONLinkedList *c;
+
+    /* a frozen list is never modified, its copies keep sharing it */
+    if (l->frozen || 1 == __atomic_load_n(&l->refcnt, __ATOMIC_ACQUIRE)) {
+        return l;
+    }
+    c = list_create_copy(l);
+    list_free(l);
+    return c;
+}
+
+void list_reserve(JSONLinkedList *l, int n)
+{
+    JSONNode *nn;
+
+    if (list_frozen(l)) {
+        return ;
+    }
+    if (l->packed) {
+        packed_reserve(l, n);
+        return ;
+    }
+    /* preallocate nodes for elements that are still to come */
+    for (n -= l->size + l->nspare; n > 0; n--) {
+        nn = node_create();
+        nn->next = l->spare;
+        l->spare = nn;
+        l->nspare += 1;
+    }
+}
+
+/* release the room reserved for elements that never came */
+void list_shrink(JSONLinkedList *l)
+{
+    int kind;
+
+    if (list_frozen(l)) {
+        return ;
+    }
+    list_free_spare(l);
+    /* a list left with only numbers or only booleans is packed again */
+    if (NULL == l->packed && (kind = list_packable(l))) {
+        list_pack(l, kind);
+    }
+    if (l->packed) {
+        packed_shrink(l);
+    }
+}
+
+/* make L read-only, its nodes moved into one array in order */
+void list_freeze(JSONLinkedList *l)
+{
+    int i;
+    JSONNode *b, *n, *next;
+
+    if (l->frozen) {
+        return ;
+    }
+    list_shrink(l);
+    l->frozen = 1;
+    /* packed values are in one array already */
+    if (l->packed) {
+        return ;
+    }
+    b = json_xmallocz((l->size + 1) * sizeof(JSONNode));
+    for (i = 0, n = l->head; n != l->nil; i++, n = next) {
+        next = n->next;
+        b[i].value = n->value;
+        b[i].prev = i ? &b[i - 1] : &b[l->size];
+        b[i].next = &b[i + 1];
+        json_slab_free(JSON_SLAB_NODE, n);
+    }
+    /* the last node is the sentinel */
+    b[l->size].prev = l->size ? &b[l->size - 1] : &b[l->size];
+    b[l->size].next = l->size ? &b[0] : &b[l->size];
+    json_slab_free(JSON_SLAB_NODE, l->nil);
+
+    l->nil = &b[l->size];
+    l->head = l->nil->next;
+    l->tail = l->nil->prev;
+    l->block = b;
+}
+
+/*
+ * insert V at POS of L if it can be kept packed, the first number or
+ * boolean of an empty list packs it, return 1 if V needs a node
+ */
+static int list_insert_packed(JSONLinkedList *l, int pos, const JSON *v, int ref)
+{
+    int i, kind;
+
+    kind = packed_kind(v->type);
+    if (0 == l->size && kind) {
+        if (NULL == l->packed) {
+            list_pack(l, kind);
+        }
+        l->packed_type = kind;
+    }
+    if (NULL == l->packed) {
+        return 1;
+    }
+    if (kind != l->packed_type) {
+        list_unpack(l);
+        return 1;
+    }
+    i = pos >= 0 ? pos + 1 : l->size + pos + 2;
+    packed_reserve(l, l->size + 1);
+    memmove(&l->packed[i + 1], &l->packed[i], (l->size + 1 - i) * sizeof(int));
+    l->packed[i] = packed_value(v);
+    l->size += 1;
+    if (ref) {
+        json_free_data((JSON *)v);
+    }
+    return 0;
 }
 
 int list_insert_tail(JSONLinkedList *l, const JSON *v)
 {
-    JSONNode *n = node_create();
+    JSONNode *n;
+
+    if (list_frozen(l)) {
+        return -1;
+    }
+    if (0 == list_insert_packed(l, -1, v, 1)) {
+        return 0;
+    }
+    n = list_node_create(l);
     n->value = *v;
 
     /* insert into tail */
-    n->next = l->nil;
-    n->prev = l->nil->prev;
-    l->nil->prev->next = n;
-    l->nil->prev = n;
+    node_link(l->nil, n);
 
     /* set list properties */
     l->head = l->nil->next;
@@ -98,19 +442,29 @@ int list_insert_tail(JSONLinkedList *l, const JSON *v)
     return 0;
 }
 
-int list_insert(JSONLinkedList *l, int pos, const JSON *v)
+static int list_insert_at(JSONLinkedList *l, int pos, const JSON *v, int ref)
 {
     int i;
     JSONNode *n;
     JSONNode *in;
 
+    if (list_frozen(l)) {
+        return -1;
+    }
     if (pos > l->size || pos < -l->size-1) {
         THROW_WARNING("try to insert in illegal POS");
         return -1;
     }
+    if (0 == list_insert_packed(l, pos, v, ref)) {
+        return 0;
+    }
 
-    n = node_create();
-    json_copy(&n->value, v);
+    n = list_node_create(l);
+    if (ref) {
+        n->value = *v;
+    } else {
+        json_copy(&n->value, v);
+    }
 
     if (pos >= 0) {
         /* head */
@@ -145,11 +499,25 @@ int list_insert(JSONLinkedList *l, int pos, const JSON *v)
     return 0;
 }
 
+int list_insert(JSONLinkedList *l, int pos, const JSON *v)
+{
+    return list_insert_at(l, pos, v, 0);
+}
+
+/* take data of V instead of copying it */
+int list_insert_ref(JSONLinkedList *l, int pos, const JSON *v)
+{
+    return list_insert_at(l, pos, v, 1);
+}
+
 int list_erase(JSONLinkedList *l, int pos)
 {
     int i;
     JSONNode *in;
 
+    if (list_frozen(l)) {
+        return -1;
+    }
     if ( 0 == l->size) {
         THROW_WARNING("emptry LIST try to erase");
         return -1;
@@ -159,8 +527,12 @@ int list_erase(JSONLinkedList *l, int pos)
         return -1;
     }
 
+    if (l->packed) {
+        i = packed_index(l, pos);
+        memmove(&l->packed[i], &l->packed[i + 1], (l->size + 1 - i) * sizeof(int));
+    }
     /* remove from head by position */
-    if (pos >= 0) {
+    else if (pos >= 0) {
         /* head */
         in = l->nil->next;
         /* find node */
@@ -193,20 +565,23 @@ int list_erase(JSONLinkedList *l, int pos)
     return 0;
 }
 
-/* val: deep copy */
-/* you must initialize 'val->data' in your code */
-int list_find(const JSONLinkedList *l, int pos, JSON *val)
+/* borrowed element at POS into VAL, -1 if POS is out of range */
+int list_view(const JSONLinkedList *l, int pos, JSON *val)
 {
     int i;
     JSONNode *n;
 
-    if ( 0 == l->size) {
-        THROW_WARNING("empty l try to find");
+    if (pos >= l->size || pos < -l->size) {
         return -1;
     }
-    if ( pos >= l->size || pos < -l->size) {
-        THROW_WARNING("try to find in illegal position");
-        return -1;
+    /* packed and frozen lists are indexed directly */
+    if (l->packed) {
+        *val = packed_json(l->packed_type, &l->packed[packed_index(l, pos)]);
+        return 0;
+    }
+    if (l->block) {
+        *val = l->block[pos >= 0 ? pos : l->size + pos].value;
+        return 0;
     }
 
     /* find from head by position */
@@ -217,13 +592,48 @@ int list_find(const JSONLinkedList *l, int pos, JSON *val)
         }
     }
     /* find from tail by position */
-    else if (pos <= -1) {
+    else {
         n = l->tail;
         for (i = -1; i > pos; i--) {
             n = n->prev;
         }
     }
-    if (val->type != n->value.type) {
+    *val = n->value;
+    return 0;
+}
+
+/*
+ * element at POS of a node list, to be modified in place, NULL if POS
+ * is out of range or L is packed: a packed value has no JSON of its own
+ */
+JSON *list_at(JSONLinkedList *l, int pos)
+{
+    int i;
+    JSONNode *n;
+
+    if (l->packed || pos < 0 || pos >= l->size) {
+        return NULL;
+    }
+    n = l->head;
+    for (i = 0; i < pos; i++) {
+        n = n->next;
+    }
+    return &n->value;
+}
+
+static int list_find_at(const JSONLinkedList *l, int pos, JSON *val, int ref)
+{
+    JSON v;
+
+    if ( 0 == l->size) {
+        THROW_WARNING("empty l try to find");
+        return -1;
+    }
+    if (list_view(l, pos, &v)) {
+        THROW_WARNING("try to find in illegal position");
+        return -1;
+    }
+    if (val->type != v.type) {
         THROW_WARNING("type of VAL can't match type of found element");
         return -1;
     }
@@ -231,15 +641,35 @@ int list_find(const JSONLinkedList *l, int pos, JSON *val)
     if (val->data) {
         json_free_data(val);
     }
-    json_copy(val, &n->value);
+    if (ref) {
+        *val = v;
+    } else {
+        json_copy(val, &v);
+    }
     return 0;
 }
 
-int list_update(JSONLinkedList *l, int pos, const JSON *v)
+/* val: deep copy */
+/* you must initialize 'val->data' in your code */
+int list_find(const JSONLinkedList *l, int pos, JSON *val)
+{
+    return list_find_at(l, pos, val, 0);
+}
+
+/* val: borrowed, it shares data with the element and must not be freed */
+int list_find_ref(const JSONLinkedList *l, int pos, JSON *val)
+{
+    return list_find_at(l, pos, val, 1);
+}
+
+static int list_update_at(JSONLinkedList *l, int pos, const JSON *v, int ref)
 {
     int i;
     JSONNode *n;
 
+    if (list_frozen(l)) {
+        return -1;
+    }
     if (0 == l->size) {
         THROW_WARNING("empty l try to update");
         return -1;
@@ -248,6 +678,16 @@ int list_update(JSONLinkedList *l, int pos, const JSON *v)
         THROW_WARNING("try to update in illegal position");
         return -1;
     }
+    if (l->packed && packed_kind(v->type) == l->packed_type) {
+        l->packed[packed_index(l, pos)] = packed_value(v);
+        if (ref) {
+            json_free_data((JSON *)v);
+        }
+        return 0;
+    }
+    if (l->packed) {
+        list_unpack(l);
+    }
     /* find from head by position */
     if (pos >= 0) {
         n = l->head;
@@ -266,11 +706,20 @@ int list_update(JSONLinkedList *l, int pos, const JSON *v)
     /* free old node data */
     json_free_data(&n->value);
     /* update type and value */
-    json_copy(&n->value, v);
+    if (ref) {
+        n->value = *v;
+    } else {
+        json_copy(&n->value, v);
+    }
     return 0;
 }
 
-int list_set(JSONLinkedList *l, int pos, const JSON *v)
+int list_update(JSONLinkedList *l, int pos, const JSON *v)
+{
+    return list_update_at(l, pos, v, 0);
+}
+
+static int list_set_at(JSONLinkedList *l, int pos, const JSON *v, int ref)
 {
 
     if (pos > l->size || pos < -l->size - 1) {
@@ -279,13 +728,13 @@ int list_set(JSONLinkedList *l, int pos, const JSON *v)
     }
 
     if (pos == l->size || pos == -l->size - 1) {
-        if (list_insert(l, pos, v)) {
+        if (list_insert_at(l, pos, v, ref)) {
             THROW_WARNING("LIST set using insert method error");
             return -1;
         }
     }
     else {
-        if (list_update(l, pos, v)) {
+        if (list_update_at(l, pos, v, ref)) {
             THROW_WARNING("LIST set using update method error");
             return -1;
         }
@@ -294,55 +743,433 @@ int list_set(JSONLinkedList *l, int pos, const JSON *v)
     return 0;
 }
 
-static void node_swap(JSONNode *n1, JSONNode *n2)
+int list_set(JSONLinkedList *l, int pos, const JSON *v)
+{
+    return list_set_at(l, pos, v, 0);
+}
+
+/* take data of V instead of copying it */
+int list_set_ref(JSONLinkedList *l, int pos, const JSON *v)
+{
+    return list_set_at(l, pos, v, 1);
+}
+
+/* a value being sorted and the part of it compared */
+typedef struct ListSortItem {
+    JSON value;
+    JSON key;
+} ListSortItem;
+
+/* a slice of a sort run by one thread */
+typedef struct ListSortTask {
+    ListSortItem *a, *tmp;
+    int n, m;
+    const JSONListOrder *o;
+} ListSortTask;
+
+#define LIST_SORT_SMALL 16
+#define LIST_SORT_PARALLEL_MIN (1 << 14)
+#define LIST_SORT_THREADS 8
+
+static inline int sort_cmp(const JSONListOrder *o, const ListSortItem *a, const ListSortItem *b)
+{
+    return o->compare(&a->key, &b->key, o->ctx);
+}
+
+static inline void sort_swap(ListSortItem *a, ListSortItem *b)
+{
+    ListSortItem t = *a;
+    *a = *b;
+    *b = t;
+}
+
+/* stable, for short runs */
+static void sort_insertion(ListSortItem *a, int n, const JSONListOrder *o)
+{
+    int i, j;
+    ListSortItem t;
+
+    for (i = 1; i < n; i++) {
+        t = a[i];
+        for (j = i; j > 0 && sort_cmp(o, &t, &a[j - 1]) < 0; j--) {
+            a[j] = a[j - 1];
+        }
+        a[j] = t;
+    }
+}
+
+static void sort_sift(ListSortItem *a, int i, int n, const JSONListOrder *o)
+{
+    int c;
+
+    for (; (c = 2 * i + 1) < n; i = c) {
+        if (c + 1 < n && sort_cmp(o, &a[c], &a[c + 1]) < 0) {
+            c++;
+        }
+        if (sort_cmp(o, &a[i], &a[c]) >= 0) {
+            return ;
+        }
+        sort_swap(&a[i], &a[c]);
+    }
+}
+
+static void sort_heap(ListSortItem *a, int n, const JSONListOrder *o)
+{
+    int i;
+
+    for (i = n / 2 - 1; i >= 0; i--) {
+        sort_sift(a, i, n, o);
+    }
+    for (i = n - 1; i > 0; i--) {
+        sort_swap(&a[0], &a[i]);
+        sort_sift(a, 0, i, o);
+    }
+}
+
+/* quick sort on a median of three, heap sort once it goes DEPTH deep */
+static void sort_intro(ListSortItem *a, int n, int depth, const JSONListOrder *o)
+{
+    int i, j, m;
+
+    while (n > LIST_SORT_SMALL) {
+        if (0 == depth--) {
+            sort_heap(a, n, o);
+            return ;
+        }
+        m = n / 2;
+        if (sort_cmp(o, &a[m], &a[0]) < 0) {
+            sort_swap(&a[m], &a[0]);
+        }
+        if (sort_cmp(o, &a[n - 1], &a[m]) < 0) {
+            sort_swap(&a[n - 1], &a[m]);
+            if (sort_cmp(o, &a[m], &a[0]) < 0) {
+                sort_swap(&a[m], &a[0]);
+            }
+        }
+        /* the pivot waits in a[0], items equal to it go to both sides */
+        sort_swap(&a[0], &a[m]);
+        for (i = 0, j = n; ; ) {
+            while (++i < n && sort_cmp(o, &a[i], &a[0]) < 0);
+            while (sort_cmp(o, &a[--j], &a[0]) > 0);
+            if (i >= j) {
+                break;
+            }
+            sort_swap(&a[i], &a[j]);
+        }
+        sort_swap(&a[0], &a[j]);
+        /* recurse into the smaller side, loop on the larger one */
+        if (j < n - j - 1) {
+            sort_intro(a, j, depth, o);
+            a += j + 1;
+            n -= j + 1;
+        } else {
+            sort_intro(a + j + 1, n - j - 1, depth, o);
+            n = j;
+        }
+    }
+    sort_insertion(a, n, o);
+}
+
+/* merge the sorted runs A[0, N) and A[N, N + M) through TMP */
+static void sort_merge_runs(ListSortItem *a, int n, int m, ListSortItem *tmp,
+    const JSONListOrder *o)
+{
+    int i = 0, j = n, k = 0;
+
+    if (0 == n || 0 == m || sort_cmp(o, &a[n - 1], &a[n]) <= 0) {
+        return ;
+    }
+    while (i < n && j < n + m) {
+        tmp[k++] = sort_cmp(o, &a[j], &a[i]) < 0 ? a[j++] : a[i++];
+    }
+    while (i < n) {
+        tmp[k++] = a[i++];
+    }
+    memcpy(a, tmp, k * sizeof(*a));
+}
+
+static void sort_merge(ListSortItem *a, int n, ListSortItem *tmp, const JSONListOrder *o)
 {
-    void* tmp;
+    if (n <= LIST_SORT_SMALL) {
+        sort_insertion(a, n, o);
+        return ;
+    }
+    sort_merge(a, n / 2, tmp, o);
+    sort_merge(a + n / 2, n - n / 2, tmp, o);
+    sort_merge_runs(a, n / 2, n - n / 2, tmp, o);
+}
+
+static void sort_run(ListSortItem *a, int n, ListSortItem *tmp, const JSONListOrder *o)
+{
+    int depth, i;
 
-    if (n1 == n2) {
+    if (o->flags & JSON_SORT_STABLE) {
+        sort_merge(a, n, tmp, o);
         return ;
     }
+    for (depth = 0, i = n; i > 1; i >>= 1) {
+        depth += 2;
+    }
+    sort_intro(a, n, depth, o);
+}
 
-    tmp = n1->value.data;
-    n1->value.data = n2->value.data;
-    n2->value.data = tmp;
-    return ;
+static void *sort_task(void *arg)
+{
+    ListSortTask *t = arg;
+
+    if (t->m < 0) {
+        sort_run(t->a, t->n, t->tmp, t->o);
+    } else {
+        sort_merge_runs(t->a, t->n, t->m, t->tmp, t->o);
+    }
+    return NULL;
 }
 
-static void list_qsort_recur(
-    int (*compare_fn)(const void*, const void*),
-    JSONNode *head,
-    JSONNode *pivot,
-    JSONNode *tail)
+/* run TASKS in threads, the first one in the caller */
+static void sort_tasks(ListSortTask *tasks, int ntasks)
 {
-    JSONNode *ln, *rn;
+    int i;
+    pthread_t threads[LIST_SORT_THREADS];
 
-    if (head == tail || tail->next == head) {
+    for (i = 1; i < ntasks; i++) {
+        if (pthread_create(&threads[i], NULL, sort_task, &tasks[i])) {
+            sort_task(&tasks[i]);
+            tasks[i].o = NULL;
+        }
+    }
+    sort_task(&tasks[0]);
+    for (i = 1; i < ntasks; i++) {
+        if (tasks[i].o) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+/*
+ * split A into one slice per thread, sort the slices at once, then merge
+ * them pairwise, the merges of one round at once too
+ */
+static void sort_parallel(ListSortItem *a, int n, ListSortItem *tmp, const JSONListOrder *o)
+{
+    int i, k, w, nt, nbounds;
+    int bounds[LIST_SORT_THREADS + 1];
+    ListSortTask tasks[LIST_SORT_THREADS];
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    /* asked for threads: at least two of them */
+    nt = ncpu < 2 ? 2 : ncpu > LIST_SORT_THREADS ? LIST_SORT_THREADS : (int)ncpu;
+    for (i = 0; i <= nt; i++) {
+        bounds[i] = (int)((long long)n * i / nt);
+    }
+    for (i = 0; i < nt; i++) {
+        tasks[i] = (ListSortTask){ &a[bounds[i]], &tmp[bounds[i]],
+            bounds[i + 1] - bounds[i], -1, o };
+    }
+    sort_tasks(tasks, nt);
+
+    for (w = 1, nbounds = nt; w < nt; w <<= 1) {
+        for (i = 0, k = 0; i + w < nbounds; i += 2 * w, k++) {
+            tasks[k] = (ListSortTask){ &a[bounds[i]], &tmp[bounds[i]],
+                bounds[i + w] - bounds[i],
+                bounds[i + 2 * w < nbounds ? i + 2 * w : nbounds] - bounds[i + w], o };
+        }
+        sort_tasks(tasks, k);
+    }
+}
+
+/* sort L by ORDER, whole values move so their types go with them */
+void list_sort(JSONLinkedList *l, const JSONListOrder *o)
+{
+    int i, n = l->size;
+    int *buf = NULL;
+    const JSON *k;
+    JSONNode *node;
+    ListSortItem *a, *tmp = NULL;
+
+    if (list_frozen(l)) {
         return ;
     }
+    if (n < 2) {
+        return ;
+    }
+    a = json_xmallocz(n * sizeof(*a));
+    /* packed values are sorted from a copy of the buffer */
+    if (l->packed) {
+        buf = json_xmallocz(n * sizeof(int));
+        memcpy(buf, &l->packed[1], n * sizeof(int));
+        for (i = 0; i < n; i++) {
+            a[i].value = packed_json(l->packed_type, &buf[i]);
+        }
+    } else {
+        for (i = 0, node = l->head; i < n; i++, node = node->next) {
+            a[i].value = node->value;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        k = o->key ? o->key(&a[i].value, o->ctx) : &a[i].value;
+        if (k) {
+            a[i].key = *k;
+        }
+    }
 
-    ln = head;
-    rn = tail;
-    while (ln != rn) {
-        while (ln != rn && compare_fn(pivot->value.data, rn->value.data) <= 0) {
-            rn = rn->prev;
+    if ((o->flags & JSON_SORT_STABLE) || (o->flags & JSON_SORT_PARALLEL)) {
+        tmp = json_xmallocz(n * sizeof(*tmp));
+    }
+    if ((o->flags & JSON_SORT_PARALLEL) && n >= LIST_SORT_PARALLEL_MIN) {
+        sort_parallel(a, n, tmp, o);
+    } else {
+        sort_run(a, n, tmp, o);
+    }
+
+    if (l->packed) {
+        for (i = 0; i < n; i++) {
+            l->packed[i + 1] = packed_value(&a[i].value);
         }
-        while (ln != rn && compare_fn(ln->value.data, pivot->value.data) <= 0) {
-            ln = ln->next;
+        json_xfree(buf);
+    } else {
+        for (i = 0, node = l->head; i < n; i++, node = node->next) {
+            node->value = a[i].value;
         }
-        node_swap(ln, rn);
     }
-    node_swap(rn, pivot);
-    list_qsort_recur(compare_fn, head, head, rn->prev);
-    list_qsort_recur(compare_fn, rn->next, rn->next, tail);
+    if (tmp) {
+        json_xfree(tmp);
+    }
+    json_xfree(a);
 }
 
-void list_qsort(JSONLinkedList *list, int (*compare_fn)(const void*, const void*))
+static long long packed_sum(const int *p, int n)
 {
-    list_qsort_recur(compare_fn, list->head, list->head, list->tail);
+    int i = 0;
+    long long s = 0;
+#ifdef LIST_VECTOR
+    list_vint v;
+    list_vllong acc = {0, 0, 0, 0};
+
+    for (; i + 4 <= n; i += 4) {
+        memcpy(&v, &p[i], sizeof(v));
+        acc += __builtin_convertvector(v, list_vllong);
+    }
+    s = acc[0] + acc[1] + acc[2] + acc[3];
+#endif
+    for (; i < n; i++) {
+        s += p[i];
+    }
+    return s;
+}
+
+/* N > 0 */
+static void packed_min_max(const int *p, int n, int *min, int *max)
+{
+    int i = 0, lo = p[0], hi = p[0];
+#ifdef LIST_VECTOR
+    int j;
+    list_vint v, vlo, vhi, m;
+
+    if (n >= 4) {
+        memcpy(&vlo, p, sizeof(vlo));
+        vhi = vlo;
+        for (i = 4; i + 4 <= n; i += 4) {
+            memcpy(&v, &p[i], sizeof(v));
+            m = v < vlo;
+            vlo = (v & m) | (vlo & ~m);
+            m = v > vhi;
+            vhi = (v & m) | (vhi & ~m);
+        }
+        for (j = 0; j < 4; j++) {
+            lo = vlo[j] < lo ? vlo[j] : lo;
+            hi = vhi[j] > hi ? vhi[j] : hi;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        lo = p[i] < lo ? p[i] : lo;
+        hi = p[i] > hi ? p[i] : hi;
+    }
+    *min = lo;
+    *max = hi;
+}
+
+/* sum of the numbers of L, other values are skipped */
+long long list_sum(const JSONLinkedList *l, int *count)
+{
+    long long s = 0;
+    const JSONNode *n;
+
+    if (l->packed) {
+        *count = JSON_TYPE_NUMBER == l->packed_type ? l->size : 0;
+        return *count ? packed_sum(&l->packed[1], l->size) : 0;
+    }
+    *count = 0;
+    for (n = l->head; n != l->nil; n = n->next) {
+        if (JSON_TYPE_NUMBER == n->value.type) {
+            s += *(int *)n->value.data;
+            *count += 1;
+        }
+    }
+    return s;
+}
+
+/* smallest and largest numbers of L, return how many numbers there are */
+int list_min_max(const JSONLinkedList *l, int *min, int *max)
+{
+    int v, count = 0;
+    const JSONNode *n;
+
+    if (l->packed) {
+        if (JSON_TYPE_NUMBER != l->packed_type || 0 == l->size) {
+            return 0;
+        }
+        packed_min_max(&l->packed[1], l->size, min, max);
+        return l->size;
+    }
+    for (n = l->head; n != l->nil; n = n->next) {
+        if (JSON_TYPE_NUMBER != n->value.type) {
+            continue;
+        }
+        v = *(int *)n->value.data;
+        if (0 == count++) {
+            *min = *max = v;
+        }
+        *min = v < *min ? v : *min;
+        *max = v > *max ? v : *max;
+    }
+    return count;
+}
+
+/* how many numbers of L PRED is true for */
+int list_count_if(const JSONLinkedList *l, int (*pred)(int))
+{
+    int i, count = 0;
+    const JSONNode *n;
+
+    if (l->packed) {
+        if (JSON_TYPE_NUMBER != l->packed_type) {
+            return 0;
+        }
+        for (i = 1; i <= l->size; i++) {
+            count += 0 != pred(l->packed[i]);
+        }
+        return count;
+    }
+    for (n = l->head; n != l->nil; n = n->next) {
+        if (JSON_TYPE_NUMBER == n->value.type) {
+            count += 0 != pred(*(int *)n->value.data);
+        }
+    }
+    return count;
 }
 
 JSONLinkedListIter list_begin(const JSONLinkedList *l)
 {
+    if (l->packed) {
+        JSONLinkedListIter iter =
+        {
+            .index = &l->packed[1],
+            .value = packed_json(l->packed_type, &l->packed[1]),
+            .__packed = l->packed_type
+        };
+        return iter;
+    }
     JSONLinkedListIter iter =
     {
         .index = l->head,
@@ -352,6 +1179,13 @@ JSONLinkedListIter list_begin(const JSONLinkedList *l)
 }
 JSONLinkedListIter list_end(const JSONLinkedList *l)
 {
+    if (l->packed) {
+        JSONLinkedListIter iter =
+        {
+            .index = &l->packed[l->size + 1]
+        };
+        return iter;
+    }
     JSONLinkedListIter iter =
     {
         .index = l->nil
@@ -360,12 +1194,26 @@ JSONLinkedListIter list_end(const JSONLinkedList *l)
 }
 JSONLinkedListIter list_iterate(JSONLinkedListIter iter)
 {
+    if (iter.__packed) {
+        iter.index = (int *)iter.index + 1;
+        iter.value = packed_json(iter.__packed, iter.index);
+        return iter;
+    }
     iter.index = ((JSONNode *)iter.index)->next;
     iter.value = ((JSONNode *)iter.index)->value;
     return iter;
 }
 JSONLinkedListIter list_rbegin(const JSONLinkedList *l)
 {
+    if (l->packed) {
+        JSONLinkedListIter iter =
+        {
+            .index = &l->packed[l->size],
+            .value = packed_json(l->packed_type, &l->packed[l->size]),
+            .__packed = l->packed_type
+        };
+        return iter;
+    }
     JSONLinkedListIter iter =
     {
         .index = l->tail,
@@ -375,6 +1223,13 @@ JSONLinkedListIter list_rbegin(const JSONLinkedList *l)
 }
 JSONLinkedListIter list_rend(const JSONLinkedList *l)
 {
+    if (l->packed) {
+        JSONLinkedListIter iter =
+        {
+            .index = &l->packed[0]
+        };
+        return iter;
+    }
     JSONLinkedListIter iter =
     {
         .index = l->nil
@@ -383,6 +1238,11 @@ JSONLinkedListIter list_rend(const JSONLinkedList *l)
 }
 JSONLinkedListIter list_riterate(JSONLinkedListIter iter)
 {
+    if (iter.__packed) {
+        iter.index = (int *)iter.index - 1;
+        iter.value = packed_json(iter.__packed, iter.index);
+        return iter;
+    }
     iter.index = ((JSONNode *)iter.index)->prev;
     iter.value = ((JSONNode *)iter.index)->value;
     return iter;
@@ -0,0 +1,492 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "lib/json_patch.h"
+#include "lib/json_pointer.h"
+#include "lib/json_htab.h"
+#include "lib/json_list.h"
+#include "lib/json_key.h"
+#include "lib/json_utils.h"
+
+
+/* a JSON Pointer being built by json_diff */
+typedef struct PatchPath {
+    char *buf;
+    int len;
+    int cap;
+} PatchPath;
+
+typedef struct PatchDiff {
+    JSONLinkedList *ops;
+    PatchPath path;
+} PatchDiff;
+
+/* append token TOK of LEN bytes, escaped, return the length before it */
+static int patch_push(PatchPath *p, const char *tok, size_t len)
+{
+    size_t i;
+    int old = p->len;
+    int cap = p->cap;
+
+    while (cap < p->len + 2 * (int)len + 2) {
+        cap <<= 1;
+    }
+    if (cap != p->cap) {
+        p->buf = json_xreallocz(p->buf, p->cap, cap);
+        p->cap = cap;
+    }
+    p->buf[p->len++] = '/';
+    for (i = 0; i < len; i++) {
+        if ('~' == tok[i] || '/' == tok[i]) {
+            p->buf[p->len++] = '~';
+            p->buf[p->len++] = '~' == tok[i] ? '0' : '1';
+        } else {
+            p->buf[p->len++] = tok[i];
+        }
+    }
+    p->buf[p->len] = '\0';
+    return old;
+}
+
+static int patch_push_index(PatchPath *p, int index)
+{
+    char num[16];
+
+    return patch_push(p, num, snprintf(num, sizeof(num), "%d", index));
+}
+
+#define patch_pop(p, old) ((p)->buf[(p)->len = (old)] = '\0')
+
+/* A and B have the same value, members of objects in any order */
+static int patch_equal(const JSON *a, const JSON *b)
+{
+    const JSONHashTable *ha, *hb;
+    const JSONLinkedList *la, *lb;
+    const JSON *v;
+    JSONHashTableIter hiter, hend;
+    JSONLinkedListIter aiter, aend, biter;
+
+    if (a->type != b->type) {
+        return 0;
+    }
+    /* shared by copies, or true, false and null */
+    if (a->data == b->data) {
+        return 1;
+    }
+    switch (a->type) {
+        case JSON_TYPE_NUMBER:
+            return *(int *)a->data == *(int *)b->data;
+        case JSON_TYPE_STRING:
+            return 0 == strcmp(a->data, b->data);
+        case JSON_TYPE_OBJECT:
+            ha = a->data;
+            hb = b->data;
+            if (ha->size != hb->size) {
+                return 0;
+            }
+            hiter = htab_begin(ha);
+            hend = htab_end(ha);
+            json_htab_foreach(hiter, hend) {
+                v = htab_view_k(hb, hiter.key);
+                if (NULL == v || !patch_equal(&hiter.value, v)) {
+                    return 0;
+                }
+            }
+            return 1;
+        case JSON_TYPE_ARRAY:
+            la = a->data;
+            lb = b->data;
+            if (la->size != lb->size) {
+                return 0;
+            }
+            if (la->packed && lb->packed && la->packed_type == lb->packed_type) {
+                return 0 == memcmp(&la->packed[1], &lb->packed[1], la->size * sizeof(int));
+            }
+            aiter = list_begin(la);
+            aend = list_end(la);
+            biter = list_begin(lb);
+            jsong_list_foreach(aiter, aend) {
+                if (!patch_equal(&aiter.value, &biter.value)) {
+                    return 0;
+                }
+                biter = list_iterate(biter);
+            }
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+/* append operation OP at the current path, with a copy of VAL if any */
+static void patch_op(PatchDiff *d, const char *op, const JSON *val)
+{
+    JSON o = obj_handle();
+    JSON s = {
+        .type = JSON_TYPE_STRING,
+        .data = (char *)op
+    };
+
+    htab_insert(o.data, "op", &s);
+    s.data = d->path.buf;
+    htab_insert(o.data, "path", &s);
+    if (val) {
+        htab_insert(o.data, "value", val);
+    }
+    list_insert_ref(d->ops, -1, &o);
+}
+
+static void patch_diff(PatchDiff *d, const JSON *a, const JSON *b);
+
+/* changed and removed members in the order of A, then added ones */
+static void patch_diff_object(PatchDiff *d, const JSONHashTable *ha, const JSONHashTable *hb)
+{
+    int old;
+    const JSON *v;
+    JSONHashTableIter iter, end;
+
+    iter = htab_begin(ha);
+    end = htab_end(ha);
+    json_htab_foreach(iter, end) {
+        old = patch_push(&d->path, iter.key, key_len(iter.key));
+        v = htab_view_k(hb, iter.key);
+        if (v) {
+            patch_diff(d, &iter.value, v);
+        } else {
+            patch_op(d, "remove", NULL);
+        }
+        patch_pop(&d->path, old);
+    }
+    iter = htab_begin(hb);
+    end = htab_end(hb);
+    json_htab_foreach(iter, end) {
+        if (NULL == htab_view_k(ha, iter.key)) {
+            old = patch_push(&d->path, iter.key, key_len(iter.key));
+            patch_op(d, "add", &iter.value);
+            patch_pop(&d->path, old);
+        }
+    }
+}
+
+/* borrowed values of L, indexed */
+static JSON *patch_values(const JSONLinkedList *l)
+{
+    int i = 0;
+    JSON *vals;
+    JSONLinkedListIter iter, end;
+
+    vals = json_xmallocz((l->size + 1) * sizeof(JSON));
+    iter = list_begin(l);
+    end = list_end(l);
+    jsong_list_foreach(iter, end) {
+        vals[i++] = iter.value;
+    }
+    return vals;
+}
+
+/*
+ * past the common head and tail, elements left in both are changed in
+ * place, the rest of A is removed from the back or the rest of B added
+ */
+static void patch_diff_array(PatchDiff *d, const JSONLinkedList *la, const JSONLinkedList *lb)
+{
+    int i, old, ma, mb;
+    int p = 0, s = 0, na = la->size, nb = lb->size;
+    JSON *av = patch_values(la), *bv = patch_values(lb);
+
+    while (p < na && p < nb && patch_equal(&av[p], &bv[p])) {
+        p++;
+    }
+    while (s < na - p && s < nb - p && patch_equal(&av[na - 1 - s], &bv[nb - 1 - s])) {
+        s++;
+    }
+    ma = na - p - s;
+    mb = nb - p - s;
+    for (i = p; i < p + ma && i < p + mb; i++) {
+        old = patch_push_index(&d->path, i);
+        patch_diff(d, &av[i], &bv[i]);
+        patch_pop(&d->path, old);
+    }
+    for (i = p + ma - 1; i >= p + mb; i--) {
+        old = patch_push_index(&d->path, i);
+        patch_op(d, "remove", NULL);
+        patch_pop(&d->path, old);
+    }
+    for (i = p + ma; i < p + mb; i++) {
+        old = patch_push_index(&d->path, i);
+        patch_op(d, "add", &bv[i]);
+        patch_pop(&d->path, old);
+    }
+    json_xfree(av);
+    json_xfree(bv);
+}
+
+static void patch_diff(PatchDiff *d, const JSON *a, const JSON *b)
+{
+    if (a->type != b->type ||
+        (JSON_TYPE_OBJECT != a->type && JSON_TYPE_ARRAY != a->type)) {
+        if (!patch_equal(a, b)) {
+            patch_op(d, "replace", b);
+        }
+        return ;
+    }
+    /* a subtree shared by copies is not walked */
+    if (a->data == b->data) {
+        return ;
+    }
+    if (JSON_TYPE_OBJECT == a->type) {
+        patch_diff_object(d, a->data, b->data);
+    } else {
+        patch_diff_array(d, a->data, b->data);
+    }
+}
+
+/* the patch that turns A into B */
+JSONArray *json_diff(const void *a, const void *b)
+{
+    PatchDiff d;
+
+    assert(a && b);
+    d.ops = list_create();
+    d.path.cap = 64;
+    d.path.len = 0;
+    d.path.buf = json_xmallocz(d.path.cap);
+    patch_diff(&d, a, b);
+    json_xfree(d.path.buf);
+
+    return arr_data_cstr(d.ops);
+}
+
+/* member or element T of V, unsharing V first: it is modified in place */
+static JSON *patch_child(JSON *v, const JSONPointerToken *t)
+{
+    if (JSON_TYPE_OBJECT == v->type) {
+        v->data = htab_unshare(v->data);
+        return (JSON *)htab_view_k(v->data, t->key);
+    }
+    if (JSON_TYPE_ARRAY == v->type && t->index >= 0) {
+        v->data = list_unshare(v->data);
+        return list_at(v->data, t->index);
+    }
+    return NULL;
+}
+
+/* the container of the last token of PTR, unshared, NULL if there is none */
+static JSON *patch_parent(JSON *doc, const JSONPointer *ptr)
+{
+    int i;
+    JSON *v = doc;
+
+    for (i = 0; v && i + 1 < ptr->ntokens; i++) {
+        v = patch_child(v, &ptr->tokens[i]);
+    }
+    if (NULL == v) {
+        THROW_WARNING("patch path does not exist");
+        return NULL;
+    }
+    if (JSON_TYPE_OBJECT == v->type) {
+        v->data = htab_unshare(v->data);
+    } else if (JSON_TYPE_ARRAY == v->type) {
+        v->data = list_unshare(v->data);
+    } else {
+        THROW_WARNING("patch path goes through a scalar");
+        return NULL;
+    }
+    return v;
+}
+
+/* the document becomes a copy of VAL */
+static int patch_root(JSON *doc, const JSON *val)
+{
+    if (doc->type != val->type) {
+        THROW_WARNING("patch can't change type of the document root");
+        return -1;
+    }
+    json_free_data(doc);
+    doc->data = NULL;
+    json_copy(doc, val);
+    return 0;
+}
+
+/* add a copy of VAL at PTR, or replace the value there */
+static int patch_add(JSON *doc, const JSONPointer *ptr, const JSON *val, int replace)
+{
+    int pos;
+    JSON *p;
+    JSONLinkedList *l;
+    const JSONPointerToken *t;
+
+    if (0 == ptr->ntokens) {
+        return patch_root(doc, val);
+    }
+    if (NULL == (p = patch_parent(doc, ptr))) {
+        return -1;
+    }
+    t = &ptr->tokens[ptr->ntokens - 1];
+    if (JSON_TYPE_OBJECT == p->type) {
+        if (replace && NULL == htab_view_k(p->data, t->key)) {
+            THROW_WARNING("patch try to replace a non-existent member");
+            return -1;
+        }
+        return htab_set_k(p->data, t->key, val);
+    }
+
+    l = p->data;
+    /* "-" is past the last element */
+    pos = t->index < 0 && 0 == strcmp(t->key, "-") ? l->size : t->index;
+    if (pos < 0 || pos > l->size || (replace && pos == l->size)) {
+        THROW_WARNING("patch index is out of the array");
+        return -1;
+    }
+    return replace ? list_update(l, pos, val) : list_insert(l, pos, val);
+}
+
+static int patch_remove(JSON *doc, const JSONPointer *ptr)
+{
+    JSON *p;
+    JSONLinkedList *l;
+    const JSONPointerToken *t;
+
+    if (0 == ptr->ntokens) {
+        THROW_WARNING("patch can't remove the document root");
+        return -1;
+    }
+    if (NULL == (p = patch_parent(doc, ptr))) {
+        return -1;
+    }
+    t = &ptr->tokens[ptr->ntokens - 1];
+    if (JSON_TYPE_OBJECT == p->type) {
+        return htab_erase_k(p->data, t->key);
+    }
+    l = p->data;
+    if (t->index < 0 || t->index >= l->size) {
+        THROW_WARNING("patch index is out of the array");
+        return -1;
+    }
+    return list_erase(l, t->index);
+}
+
+/* FROM is a proper prefix of PTR: a value can't be moved into itself */
+static int patch_is_prefix(const JSONPointer *from, const JSONPointer *ptr)
+{
+    int i;
+
+    if (from->ntokens >= ptr->ntokens) {
+        return 0;
+    }
+    for (i = 0; i < from->ntokens; i++) {
+        if (from->tokens[i].key != ptr->tokens[i].key) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* move or copy the value at FROM to PTR */
+static int patch_transfer(JSON *doc, const JSONPointer *from, const JSONPointer *ptr, int move)
+{
+    int ret;
+    JSON view, val = { NULL, 0 };
+
+    if (json_pointer_get(doc, from, &view)) {
+        THROW_WARNING("patch from does not exist");
+        return -1;
+    }
+    if (move && patch_is_prefix(from, ptr)) {
+        THROW_WARNING("patch can't move a value into itself");
+        return -1;
+    }
+    /* the view does not survive the modifications below */
+    json_copy(&val, &view);
+    ret = (move && patch_remove(doc, from)) || patch_add(doc, ptr, &val, 0) ? -1 : 0;
+    json_free_data(&val);
+
+    return ret;
+}
+
+static int patch_apply_op(JSON *doc, const JSON *op)
+{
+    int ret = -1;
+    JSON view;
+    const JSON *name, *path, *from, *val;
+    JSONPointer *ptr, *src;
+
+    if (JSON_TYPE_OBJECT != op->type) {
+        THROW_WARNING("patch operation is not a object");
+        return -1;
+    }
+    name = htab_view(op->data, "op");
+    path = htab_view(op->data, "path");
+    from = htab_view(op->data, "from");
+    val = htab_view(op->data, "value");
+    if (NULL == name || JSON_TYPE_STRING != name->type ||
+        NULL == path || JSON_TYPE_STRING != path->type) {
+        THROW_WARNING("patch operation without op or path");
+        return -1;
+    }
+    if (NULL == (ptr = json_pointer_compile(path->data))) {
+        return -1;
+    }
+
+    if (0 == strcmp(name->data, "remove")) {
+        ret = patch_remove(doc, ptr);
+    } else if (0 == strcmp(name->data, "move") || 0 == strcmp(name->data, "copy")) {
+        if (NULL == from || JSON_TYPE_STRING != from->type) {
+            THROW_WARNING("patch operation without from");
+        } else if ((src = json_pointer_compile(from->data))) {
+            ret = patch_transfer(doc, src, ptr, 0 == strcmp(name->data, "move"));
+            json_pointer_free(src);
+        }
+    } else if (NULL == val) {
+        THROW_WARNING("patch operation without value");
+    } else if (0 == strcmp(name->data, "add")) {
+        ret = patch_add(doc, ptr, val, 0);
+    } else if (0 == strcmp(name->data, "replace")) {
+        ret = patch_add(doc, ptr, val, 1);
+    } else if (0 == strcmp(name->data, "test")) {
+        if (json_pointer_get(doc, ptr, &view) || !patch_equal(&view, val)) {
+            THROW_WARNING("patch test failed");
+        } else {
+            ret = 0;
+        }
+    } else {
+        THROW_WARNING("patch operation is unknown");
+    }
+    json_pointer_free(ptr);
+
+    return ret;
+}
+
+/* apply PATCH to DOC, all its operations or none, return -1 if one fails */
+int json_patch_apply(void *doc, const void *patch)
+{
+    JSON work = { NULL, 0 };
+    const JSON *p = patch;
+    JSONLinkedListIter iter, end;
+
+    assert(doc && patch);
+    if (JSON_TYPE_ARRAY != p->type) {
+        THROW_WARNING("patch is not a array");
+        return -1;
+    }
+    if (json_is_frozen(doc)) {
+        THROW_WARNING("patch can't modify a frozen document");
+        return -1;
+    }
+
+    /* a copy shares the document, each path clones what it modifies */
+    json_copy(&work, doc);
+    iter = list_begin(p->data);
+    end = list_end(p->data);
+    jsong_list_foreach(iter, end) {
+        if (patch_apply_op(&work, &iter.value)) {
+            json_free_data(&work);
+            return -1;
+        }
+    }
+    json_free_data(doc);
+    ((JSON *)doc)->data = work.data;
+
+    return 0;
+}
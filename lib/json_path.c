@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "lib/json_path.h"
+#include "lib/json_htab.h"
+#include "lib/json_list.h"
+#include "lib/json_key.h"
+#include "lib/json_utils.h"
+
+
+/* kinds of steps */
+enum {
+    PATH_KEY = 1,
+    PATH_INDEX,
+    PATH_ALL,
+    PATH_FILTER
+};
+
+/* operators of conditions */
+enum {
+    PATH_EXISTS = 0,
+    PATH_EQ,
+    PATH_NE,
+    PATH_LT,
+    PATH_LE,
+    PATH_GT,
+    PATH_GE
+};
+
+/* state of a parse, BUF and PBUF are long enough for any token */
+typedef struct PathParser {
+    const char *p;
+    char *buf;
+    char *pbuf;
+} PathParser;
+
+/* values found by a evaluation, only the first N are kept */
+typedef struct PathOut {
+    JSON *vals;
+    int n;
+    int count;
+} PathOut;
+
+static void path_skip_space(PathParser *ps)
+{
+    while (' ' == *ps->p || '\t' == *ps->p) {
+        ps->p++;
+    }
+}
+
+/* a name after '.', into BUF */
+static int path_name(PathParser *ps, size_t *plen)
+{
+    size_t n = 0;
+
+    while (*ps->p && !strchr(".[]()=!<>&| \t'\"", *ps->p)) {
+        ps->buf[n++] = *ps->p++;
+    }
+    *plen = n;
+    return n ? 0 : -1;
+}
+
+/* a quoted name or string, into BUF without its quotes and escapes */
+static int path_quoted(PathParser *ps, size_t *plen)
+{
+    size_t n = 0;
+    char q = *ps->p++;
+
+    for (; *ps->p && *ps->p != q; ps->p++) {
+        if ('\\' == *ps->p && ps->p[1]) {
+            ps->p++;
+        }
+        ps->buf[n++] = *ps->p;
+    }
+    if (*ps->p != q) {
+        return -1;
+    }
+    ps->p++;
+    *plen = n;
+    return 0;
+}
+
+static int path_int(PathParser *ps, int *val)
+{
+    char *end;
+    long v = strtol(ps->p, &end, 10);
+
+    if (end == ps->p || v < INT_MIN || v > INT_MAX) {
+        return -1;
+    }
+    ps->p = end;
+    *val = (int)v;
+    return 0;
+}
+
+static int path_match(PathParser *ps, const char *tok)
+{
+    size_t len = strlen(tok);
+
+    if (strncmp(ps->p, tok, len)) {
+        return 0;
+    }
+    ps->p += len;
+    return 1;
+}
+
+/* append the token in BUF to the pointer in PBUF, escaped */
+static void path_pointer_token(PathParser *ps, size_t len)
+{
+    size_t i;
+    char *d = ps->pbuf + strlen(ps->pbuf);
+
+    *d++ = '/';
+    for (i = 0; i < len; i++) {
+        if ('~' == ps->buf[i] || '/' == ps->buf[i]) {
+            *d++ = '~';
+            *d++ = '~' == ps->buf[i] ? '0' : '1';
+        } else {
+            *d++ = ps->buf[i];
+        }
+    }
+    *d = '\0';
+}
+
+/* @.a[0]['b'] op literal */
+static int path_cond(PathParser *ps, JSONPathCond *c)
+{
+    int i;
+    size_t len;
+    static const char *ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+    static const int opv[] = { PATH_EQ, PATH_NE, PATH_LE, PATH_GE, PATH_LT, PATH_GT };
+
+    path_skip_space(ps);
+    if (*ps->p++ != '@') {
+        return -1;
+    }
+    ps->pbuf[0] = '\0';
+    for (;;) {
+        if ('.' == *ps->p) {
+            ps->p++;
+            if (path_name(ps, &len)) {
+                return -1;
+            }
+        } else if ('[' == *ps->p) {
+            ps->p++;
+            if ('\'' == *ps->p || '"' == *ps->p) {
+                if (path_quoted(ps, &len)) {
+                    return -1;
+                }
+            } else if (path_int(ps, &i) || i < 0) {
+                return -1;
+            } else {
+                len = sprintf(ps->buf, "%d", i);
+            }
+            if (*ps->p++ != ']') {
+                return -1;
+            }
+        } else {
+            break;
+        }
+        path_pointer_token(ps, len);
+    }
+    c->ptr = json_pointer_compile(ps->pbuf);
+
+    path_skip_space(ps);
+    for (i = 0; i < 6 && !path_match(ps, ops[i]); i++);
+    if (6 == i) {
+        c->op = PATH_EXISTS;
+        return 0;
+    }
+    c->op = opv[i];
+    path_skip_space(ps);
+    if ('\'' == *ps->p || '"' == *ps->p) {
+        if (path_quoted(ps, &len)) {
+            return -1;
+        }
+        c->type = JSON_TYPE_STRING;
+        c->str = json_xmallocz(len + 1);
+        memcpy(c->str, ps->buf, len);
+    } else if (path_match(ps, "true")) {
+        c->type = JSON_TYPE_TRUE;
+    } else if (path_match(ps, "false")) {
+        c->type = JSON_TYPE_FALSE;
+    } else if (path_match(ps, "null")) {
+        c->type = JSON_TYPE_NULL;
+    } else if (0 == path_int(ps, &c->num)) {
+        c->type = JSON_TYPE_NUMBER;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* ?(cond && cond || cond), S->conds grown as they come */
+static int path_filter(PathParser *ps, JSONPathStep *s)
+{
+    int paren;
+
+    paren = '(' == *ps->p;
+    ps->p += paren;
+    for (;;) {
+        s->conds = json_xreallocz(s->conds, s->nconds * sizeof(JSONPathCond),
+            (s->nconds + 1) * sizeof(JSONPathCond));
+        s->nconds += 1;
+        if (path_cond(ps, &s->conds[s->nconds - 1])) {
+            return -1;
+        }
+        path_skip_space(ps);
+        if (path_match(ps, "&&")) {
+            s->conds[s->nconds - 1].and = 1;
+        } else if (!path_match(ps, "||")) {
+            break;
+        }
+    }
+    if (paren && *ps->p++ != ')') {
+        return -1;
+    }
+    return 0;
+}
+
+/* one step: .name .* [n] [*] ['name'] [?(...)], each may follow '..' */
+static int path_step(PathParser *ps, JSONPathStep *s)
+{
+    size_t len;
+
+    if ('.' == ps->p[0] && '.' == ps->p[1]) {
+        s->descend = 1;
+        ps->p += 2;
+    } else if ('.' == ps->p[0]) {
+        ps->p += 1;
+    } else if (ps->p[0] != '[') {
+        return -1;
+    }
+    if ('[' != *ps->p) {
+        if (path_match(ps, "*")) {
+            s->kind = PATH_ALL;
+            return 0;
+        }
+        if (path_name(ps, &len)) {
+            return -1;
+        }
+        s->kind = PATH_KEY;
+        s->key = key_intern_len(ps->buf, len, key_hash_str(ps->buf, len));
+        return 0;
+    }
+
+    ps->p++;
+    path_skip_space(ps);
+    if (path_match(ps, "*")) {
+        s->kind = PATH_ALL;
+    } else if ('?' == *ps->p) {
+        ps->p++;
+        s->kind = PATH_FILTER;
+        if (path_filter(ps, s)) {
+            return -1;
+        }
+    } else if ('\'' == *ps->p || '"' == *ps->p) {
+        if (path_quoted(ps, &len)) {
+            return -1;
+        }
+        s->kind = PATH_KEY;
+        s->key = key_intern_len(ps->buf, len, key_hash_str(ps->buf, len));
+    } else if (0 == path_int(ps, &s->index)) {
+        s->kind = PATH_INDEX;
+    } else {
+        return -1;
+    }
+    path_skip_space(ps);
+    return *ps->p++ == ']' ? 0 : -1;
+}
+
+static void path_free_steps(JSONPathStep *steps, int n)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        if (steps[i].key) {
+            key_release(steps[i].key);
+        }
+        for (j = 0; j < steps[i].nconds; j++) {
+            if (steps[i].conds[j].ptr) {
+                json_pointer_free(steps[i].conds[j].ptr);
+            }
+            if (steps[i].conds[j].str) {
+                json_xfree(steps[i].conds[j].str);
+            }
+        }
+        if (steps[i].conds) {
+            json_xfree(steps[i].conds);
+        }
+    }
+}
+
+JSONPath *json_path_compile(const char *query)
+{
+    int n = 0, err = 0;
+    size_t len;
+    JSONPath *path;
+    JSONPathStep *steps = NULL;
+    PathParser ps;
+
+    assert(query);
+    len = strlen(query);
+    ps.p = query;
+    ps.buf = json_xmallocz(len + 16);
+    ps.pbuf = json_xmallocz(2 * len + 16);
+    if (*ps.p++ != '$') {
+        err = 1;
+    }
+    while (!err && *ps.p) {
+        steps = json_xreallocz(steps, n * sizeof(*steps), (n + 1) * sizeof(*steps));
+        err = path_step(&ps, &steps[n++]);
+    }
+    json_xfree(ps.buf);
+    json_xfree(ps.pbuf);
+    if (err) {
+        THROW_WARNING("illegal JSONPath query");
+        path_free_steps(steps, n);
+        if (steps) {
+            json_xfree(steps);
+        }
+        return NULL;
+    }
+
+    path = json_xmallocz(sizeof(*path) + n * sizeof(*steps));
+    path->nsteps = n;
+    if (steps) {
+        memcpy(path->steps, steps, n * sizeof(*steps));
+        json_xfree(steps);
+    }
+    return path;
+}
+
+void json_path_free(JSONPath *path)
+{
+    assert(path);
+    path_free_steps(path->steps, path->nsteps);
+    json_xfree(path);
+}
+
+static int path_test(const JSONPathCond *c, const JSON *v)
+{
+    int r, ordered;
+    JSON x;
+
+    if (json_pointer_get(v, c->ptr, &x)) {
+        return 0;
+    }
+    if (PATH_EXISTS == c->op) {
+        return 1;
+    }
+    if (x.type != c->type) {
+        return PATH_NE == c->op;
+    }
+    /* only numbers and strings are ordered */
+    ordered = 1;
+    if (JSON_TYPE_NUMBER == x.type) {
+        r = (*(int *)x.data > c->num) - (*(int *)x.data < c->num);
+    } else if (JSON_TYPE_STRING == x.type) {
+        r = strcmp(x.data, c->str);
+    } else {
+        r = 0;
+        ordered = 0;
+    }
+    switch (c->op) {
+        case PATH_EQ:
+            return 0 == r;
+        case PATH_NE:
+            return r != 0;
+        case PATH_LT:
+            return ordered && r < 0;
+        case PATH_LE:
+            return ordered && r <= 0;
+        case PATH_GT:
+            return ordered && r > 0;
+        default:
+            return ordered && r >= 0;
+    }
+}
+
+/* the conditions of S on V, a || of groups joined by && */
+static int path_filter_test(const JSONPathStep *s, const JSON *v)
+{
+    int i, group = 1;
+
+    for (i = 0; i < s->nconds; i++) {
+        group = group && path_test(&s->conds[i], v);
+        if (!s->conds[i].and) {
+            if (group) {
+                return 1;
+            }
+            group = 1;
+        }
+    }
+    return 0;
+}
+
+static void path_eval_at(const JSONPath *path, int i, const JSON *v, PathOut *out);
+
+/* step I from V */
+static void path_select(const JSONPath *path, int i, const JSON *v, PathOut *out)
+{
+    JSON c;
+    const JSON *pc;
+    const JSONPathStep *s = &path->steps[i];
+    JSONHashTableIter hiter, hend;
+    JSONLinkedListIter liter, lend;
+
+    if (PATH_KEY == s->kind) {
+        if (JSON_TYPE_OBJECT == v->type && (pc = htab_view_k(v->data, s->key))) {
+            path_eval_at(path, i + 1, pc, out);
+        }
+    } else if (PATH_INDEX == s->kind) {
+        if (JSON_TYPE_ARRAY == v->type && 0 == list_view(v->data, s->index, &c)) {
+            path_eval_at(path, i + 1, &c, out);
+        }
+    } else if (JSON_TYPE_OBJECT == v->type) {
+        hiter = htab_begin(v->data);
+        hend = htab_end(v->data);
+        json_htab_foreach(hiter, hend) {
+            if (PATH_ALL == s->kind || path_filter_test(s, &hiter.value)) {
+                path_eval_at(path, i + 1, &hiter.value, out);
+            }
+        }
+    } else if (JSON_TYPE_ARRAY == v->type) {
+        liter = list_begin(v->data);
+        lend = list_end(v->data);
+        jsong_list_foreach(liter, lend) {
+            if (PATH_ALL == s->kind || path_filter_test(s, &liter.value)) {
+                path_eval_at(path, i + 1, &liter.value, out);
+            }
+        }
+    }
+}
+
+/* step I from V and from every container below it, in document order */
+static void path_descend(const JSONPath *path, int i, const JSON *v, PathOut *out)
+{
+    JSONHashTableIter hiter, hend;
+    JSONLinkedListIter liter, lend;
+
+    path_select(path, i, v, out);
+    if (JSON_TYPE_OBJECT == v->type) {
+        hiter = htab_begin(v->data);
+        hend = htab_end(v->data);
+        json_htab_foreach(hiter, hend) {
+            if (JSON_TYPE_OBJECT == hiter.value.type || JSON_TYPE_ARRAY == hiter.value.type) {
+                path_descend(path, i, &hiter.value, out);
+            }
+        }
+    } else if (JSON_TYPE_ARRAY == v->type) {
+        liter = list_begin(v->data);
+        lend = list_end(v->data);
+        jsong_list_foreach(liter, lend) {
+            if (JSON_TYPE_OBJECT == liter.value.type || JSON_TYPE_ARRAY == liter.value.type) {
+                path_descend(path, i, &liter.value, out);
+            }
+        }
+    }
+}
+
+static void path_eval_at(const JSONPath *path, int i, const JSON *v, PathOut *out)
+{
+    if (i == path->nsteps) {
+        if (out->count < out->n) {
+            out->vals[out->count] = *v;
+        }
+        out->count += 1;
+    } else if (path->steps[i].descend) {
+        path_descend(path, i, v, out);
+    } else {
+        path_select(path, i, v, out);
+    }
+}
+
+/*
+ * VALS: the first N values PATH selects in DOC, borrowed, return how
+ * many values it selects, which may be more than N
+ */
+int json_path_eval(const void *doc, const JSONPath *path, JSON *vals, int n)
+{
+    PathOut out = { vals, n, 0 };
+
+    assert(doc && path && (vals || 0 == n));
+    path_eval_at(path, 0, doc, &out);
+    return out.count;
+}
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "lib/json_pointer.h"
+#include "lib/json_htab.h"
+#include "lib/json_list.h"
+#include "lib/json_key.h"
+#include "lib/json_utils.h"
+
+
+/* a array index: digits without a leading zero, -1 if TOK is not one */
+static int pointer_index(const char *tok, size_t len)
+{
+    size_t i;
+    long long n = 0;
+
+    if (0 == len || (len > 1 && '0' == tok[0])) {
+        return -1;
+    }
+    for (i = 0; i < len; i++) {
+        if (tok[i] < '0' || tok[i] > '9') {
+            return -1;
+        }
+        n = n * 10 + (tok[i] - '0');
+        if (n > INT_MAX) {
+            return -1;
+        }
+    }
+    return (int)n;
+}
+
+/* unescape '~1' and '~0' of the token STR[0, LEN) into BUF */
+static int pointer_unescape(const char *str, size_t len, char *buf, size_t *plen)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i < len; i++) {
+        if (str[i] != '~') {
+            buf[n++] = str[i];
+        } else if (i + 1 < len && ('0' == str[i + 1] || '1' == str[i + 1])) {
+            buf[n++] = '0' == str[++i] ? '~' : '/';
+        } else {
+            return -1;
+        }
+    }
+    *plen = n;
+    return 0;
+}
+
+/* "" is the whole document, else each token starts with '/' */
+JSONPointer *json_pointer_compile(const char *str)
+{
+    int i, n;
+    size_t len;
+    char *buf;
+    const char *p, *end;
+    JSONPointer *ptr;
+
+    assert(str);
+    if (*str && *str != '/') {
+        THROW_WARNING("a JSON pointer must start with '/'");
+        return NULL;
+    }
+    for (n = 0, p = str; *p; p++) {
+        n += '/' == *p;
+    }
+    ptr = json_xmallocz(sizeof(*ptr) + n * sizeof(JSONPointerToken));
+    buf = json_xmallocz(strlen(str) + 1);
+    for (i = 0, p = str; i < n; i++, p = end) {
+        p++;
+        end = strchr(p, '/');
+        end = end ? end : p + strlen(p);
+        if (pointer_unescape(p, end - p, buf, &len)) {
+            THROW_WARNING("illegal escape in a JSON pointer");
+            ptr->ntokens = i;
+            json_pointer_free(ptr);
+            json_xfree(buf);
+            return NULL;
+        }
+        ptr->tokens[i].key = key_intern_len(buf, len, key_hash_str(buf, len));
+        ptr->tokens[i].index = pointer_index(buf, len);
+    }
+    ptr->ntokens = n;
+    json_xfree(buf);
+    return ptr;
+}
+
+void json_pointer_free(JSONPointer *ptr)
+{
+    int i;
+
+    assert(ptr);
+    for (i = 0; i < ptr->ntokens; i++) {
+        key_release(ptr->tokens[i].key);
+    }
+    json_xfree(ptr);
+}
+
+/* VAL: borrowed value PTR refers to in DOC, -1 if there is none */
+int json_pointer_get(const void *doc, const JSONPointer *ptr, void *val)
+{
+    int i;
+    JSON cur;
+    const JSON *v;
+
+    assert(doc && ptr && val);
+    cur = *(const JSON *)doc;
+    for (i = 0; i < ptr->ntokens; i++) {
+        if (JSON_TYPE_OBJECT == cur.type) {
+            v = htab_view_k(cur.data, ptr->tokens[i].key);
+            if (NULL == v) {
+                return -1;
+            }
+            cur = *v;
+        } else if (JSON_TYPE_ARRAY == cur.type && ptr->tokens[i].index >= 0) {
+            if (list_view(cur.data, ptr->tokens[i].index, &cur)) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    *(JSON *)val = cur;
+    return 0;
+}
@@ -4,10 +4,18 @@
 #include <assert.h>
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "lib/json_utils.h"
 #include "lib/config.h"
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#define usable_size(__ptr) malloc_usable_size(__ptr)
+#else
+#define usable_size(__ptr) ((size_t)0)
+#endif
+
 /* must place a NULL-Terminated trailing */
 char* json_xmstrcat(char *str, ...)
 {
@@ -48,11 +56,85 @@ json_log_printf(const char *fmt, ...)
     va_end(ap);
 }
 
+/* allocator of all library memory, libc when no hook is set */
+static struct {
+    JSONAllocFn alloc;
+    JSONReallocFn realloc;
+    JSONFreeFn free;
+    void *ctx;
+} g_allocator;
+
+static size_t g_live_allocs, g_live_bytes;
+
+/*
+ * a block is released by the allocator current at the time, so it can
+ * only change while the library holds no memory: slab chunks are never
+ * released, once one exists the allocator is fixed
+ */
+int json_set_allocator(JSONAllocFn alloc, JSONReallocFn realloc,
+    JSONFreeFn free, void *ctx)
+{
+    if (__atomic_load_n(&g_live_allocs, __ATOMIC_ACQUIRE)) {
+        THROW_WARNING("allocator can't change while library memory is live");
+        return -1;
+    }
+    if (NULL == alloc && NULL == realloc && NULL == free) {
+        memset(&g_allocator, 0, sizeof(g_allocator));
+        return 0;
+    }
+    if (NULL == alloc || NULL == free) {
+        THROW_WARNING("allocator needs both ALLOC and FREE");
+        return -1;
+    }
+    g_allocator.alloc = alloc;
+    g_allocator.realloc = realloc;
+    g_allocator.free = free;
+    g_allocator.ctx = ctx;
+    return 0;
+}
+
+/*
+ * live allocations of the library, a slab chunk counts once, and their
+ * usable bytes under glibc; a user allocator sees every size itself,
+ * its bytes are not counted
+ */
+
+#define live_add(__ptr, __n) \
+do { \
+    if (NULL == g_allocator.alloc) { \
+        __atomic_add_fetch(&g_live_bytes, usable_size(__ptr), __ATOMIC_RELAXED); \
+    } \
+    __atomic_add_fetch(&g_live_allocs, __n, __ATOMIC_RELAXED); \
+} while (0)
+
+#define live_sub(__ptr, __n) \
+do { \
+    if (NULL == g_allocator.alloc) { \
+        __atomic_sub_fetch(&g_live_bytes, usable_size(__ptr), __ATOMIC_RELAXED); \
+    } \
+    __atomic_sub_fetch(&g_live_allocs, __n, __ATOMIC_RELAXED); \
+} while (0)
+
+void json_memory_live(size_t *nallocs, size_t *nbytes)
+{
+    if (nallocs) {
+        *nallocs = __atomic_load_n(&g_live_allocs, __ATOMIC_RELAXED);
+    }
+    if (nbytes) {
+        *nbytes = __atomic_load_n(&g_live_bytes, __ATOMIC_RELAXED);
+    }
+}
+
 /* zeroing each element */
 void *json_xmallocz(int size)
 {
     void *ptr;
-    ptr = malloc(size);
+    if (g_allocator.alloc) {
+        ptr = g_allocator.alloc(g_allocator.ctx, size);
+    } else {
+        ptr = malloc(size);
+    }
+    live_add(ptr, 1);
     if(size != 0)
     {
         assert(ptr != NULL);
@@ -64,7 +146,30 @@ void *json_xmallocz(int size)
 /* zeroing new elements */
 void *json_xreallocz(void *ptr, int old_size, int new_size)
 {
-    ptr = realloc(ptr, new_size);
+    void *old;
+
+    if (g_allocator.alloc) {
+        old = ptr;
+        if (g_allocator.realloc) {
+            ptr = g_allocator.realloc(g_allocator.ctx, ptr, old_size, new_size);
+        } else {
+            /* no realloc hook: move to a new block */
+            ptr = g_allocator.alloc(g_allocator.ctx, new_size);
+            if (old) {
+                memcpy(ptr, old, old_size < new_size ? old_size : new_size);
+                g_allocator.free(g_allocator.ctx, old);
+            }
+        }
+        if (NULL == old) {
+            live_add(ptr, 1);
+        }
+    } else {
+        if (ptr) {
+            live_sub(ptr, 1);
+        }
+        ptr = realloc(ptr, new_size);
+        live_add(ptr, 1);
+    }
     if(new_size != 0)
     {
         assert(ptr != NULL);
@@ -77,6 +182,184 @@ void *json_xreallocz(void *ptr, int old_size, int new_size)
 void json_xfree(void *ptr)
 {
     assert(ptr != NULL);
-    free(ptr);
+    live_sub(ptr, 1);
+    if (g_allocator.free) {
+        g_allocator.free(g_allocator.ctx, ptr);
+    } else {
+        free(ptr);
+    }
     return ;
+}
+
+/*
+ * a block handed to the user, who frees it with the allocator itself:
+ * it is no longer library memory
+ */
+void json_xdetach(void *ptr)
+{
+    assert(ptr != NULL);
+    live_sub(ptr, 1);
+}
+
+/*
+ * Slabs of fixed-size internal objects
+ *
+ * Each thread keeps a free list per size class and trades whole batches
+ * of objects with a global depot, so an allocation is a pointer pop and
+ * the depot lock is taken once per batch. Slab chunks are never given
+ * back. A user allocator gets every allocation instead, and so does
+ * ASan, which could not see a use after free inside a slab.
+ */
+#define SLAB_BATCH 64
+
+#if defined(__SANITIZE_ADDRESS__) || defined(CONFIG_NO_SLAB)
+#define slab_bypass() 1
+#else
+#define slab_bypass() (NULL != g_allocator.alloc)
+#endif
+
+typedef struct JSONSlabFree JSONSlabFree;
+typedef struct JSONSlabList JSONSlabList;
+
+struct JSONSlabFree {
+    JSONSlabFree *next;
+};
+
+struct JSONSlabList {
+    JSONSlabFree *head;
+    int n;
+};
+
+static struct {
+    JSONSlabList *batches; /* stack of batches */
+    int nbatches, capacity;
+} g_depot[JSON_SLAB_NR];
+
+static pthread_mutex_t g_depot_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *g_chunks; /* all slab chunks, chained by their 1st word */
+
+static __thread JSONSlabList t_cache[JSON_SLAB_NR];
+static __thread int t_registered;
+static pthread_key_t g_slab_key;
+static pthread_once_t g_slab_once = PTHREAD_ONCE_INIT;
+
+/* lock is held */
+static void slab_depot_push(int cls, JSONSlabList b)
+{
+    int n = g_depot[cls].capacity;
+
+    if (g_depot[cls].nbatches == n) {
+        g_depot[cls].capacity = n ? n << 1 : 16;
+        g_depot[cls].batches = json_xreallocz(g_depot[cls].batches,
+            n * sizeof(JSONSlabList),
+            g_depot[cls].capacity * sizeof(JSONSlabList));
+    }
+    g_depot[cls].batches[g_depot[cls].nbatches++] = b;
+}
+
+/* a exiting thread returns its cached objects to the depot */
+static void slab_thread_exit(void *arg)
+{
+    int cls;
+
+    pthread_mutex_lock(&g_depot_lock);
+    for (cls = 0; cls < JSON_SLAB_NR; cls++) {
+        if (t_cache[cls].head) {
+            slab_depot_push(cls, t_cache[cls]);
+            t_cache[cls].head = NULL;
+            t_cache[cls].n = 0;
+        }
+    }
+    pthread_mutex_unlock(&g_depot_lock);
+}
+
+static void slab_key_create(void)
+{
+    pthread_key_create(&g_slab_key, slab_thread_exit);
+}
+
+static void slab_refill(int cls, int size)
+{
+    int i;
+    char *chunk;
+    JSONSlabList *c = &t_cache[cls];
+
+    if (!t_registered) {
+        pthread_once(&g_slab_once, slab_key_create);
+        pthread_setspecific(g_slab_key, (void *)1);
+        t_registered = 1;
+    }
+
+    pthread_mutex_lock(&g_depot_lock);
+    if (g_depot[cls].nbatches) {
+        *c = g_depot[cls].batches[--g_depot[cls].nbatches];
+        pthread_mutex_unlock(&g_depot_lock);
+        return ;
+    }
+    /* carve a new chunk into a batch */
+    chunk = json_xmallocz(sizeof(void *) + SLAB_BATCH * size);
+    *(void **)chunk = g_chunks;
+    g_chunks = chunk;
+    pthread_mutex_unlock(&g_depot_lock);
+
+    chunk += sizeof(void *);
+    for (i = SLAB_BATCH - 1; i >= 0; i--) {
+        ((JSONSlabFree *)(chunk + i * size))->next = c->head;
+        c->head = (JSONSlabFree *)(chunk + i * size);
+    }
+    c->n = SLAB_BATCH;
+}
+
+/* zeroing object of class CLS, all objects of a class have same SIZE */
+void *json_slab_alloc(int cls, int size)
+{
+    JSONSlabFree *f;
+    JSONSlabList *c = &t_cache[cls];
+
+    if (slab_bypass()) {
+        return json_xmallocz(size);
+    }
+    if (NULL == c->head) {
+        /* room for the free list link, keep objects aligned */
+        slab_refill(cls, (size + 7) & ~7);
+    }
+    f = c->head;
+    c->head = f->next;
+    c->n -= 1;
+    memset(f, 0, size);
+    return f;
+}
+
+void json_slab_free(int cls, void *ptr)
+{
+    int i;
+    JSONSlabList b;
+    JSONSlabFree *f = ptr, *tail;
+    JSONSlabList *c = &t_cache[cls];
+
+    assert(ptr != NULL);
+    if (slab_bypass()) {
+        json_xfree(ptr);
+        return ;
+    }
+    f->next = c->head;
+    c->head = f;
+    c->n += 1;
+
+    /* too many cached objects: hand a batch to other threads */
+    if (c->n >= 2 * SLAB_BATCH) {
+        tail = c->head;
+        for (i = 1; i < SLAB_BATCH; i++) {
+            tail = tail->next;
+        }
+        b.head = c->head;
+        b.n = SLAB_BATCH;
+        c->head = tail->next;
+        c->n -= SLAB_BATCH;
+        tail->next = NULL;
+
+        pthread_mutex_lock(&g_depot_lock);
+        slab_depot_push(cls, b);
+        pthread_mutex_unlock(&g_depot_lock);
+    }
 }
\ No newline at end of file
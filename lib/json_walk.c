@@ -0,0 +1,158 @@
+#include <string.h>
+#include <assert.h>
+
+#include "lib/json_walk.h"
+#include "lib/json_htab.h"
+#include "lib/json_list.h"
+#include "lib/json_stack.h"
+#include "lib/json_utils.h"
+
+
+/* a object or array being walked, and where its next child is */
+typedef struct WalkFrame {
+    const JSON *val;
+    JSONWalkPos pos;
+    union {
+        uint64_t slot; /* entry of a object */
+        const JSONNode *node; /* node of a array */
+        const int *packed; /* value of a packed array */
+    } next;
+    int index; /* of the next child of a array */
+} WalkFrame;
+
+typedef json_stack(WalkFrame) WalkStack;
+
+#define walk_is_container(v) \
+    (JSON_TYPE_OBJECT == (v)->type || JSON_TYPE_ARRAY == (v)->type)
+
+#define walk_call(fn, v, pos, ctx) \
+    ((fn) ? (fn)(v, pos, ctx) : JSON_WALK_CONTINUE)
+
+static void walk_frame(WalkFrame *f, const JSON *v, const JSONWalkPos *pos)
+{
+    const JSONHashTable *h;
+    const JSONLinkedList *l;
+
+    f->val = v;
+    f->pos = *pos;
+    f->index = 0;
+    if (JSON_TYPE_OBJECT == v->type) {
+        h = v->data;
+        f->next.slot = h->first;
+        __builtin_prefetch(&h->entries[h->first]);
+    } else {
+        l = v->data;
+        if (l->packed) {
+            f->next.packed = &l->packed[1];
+        } else {
+            f->next.node = l->head;
+            __builtin_prefetch(l->head);
+        }
+    }
+}
+
+/* the next child of F and where it is, NULL after the last one */
+static const JSON *walk_next(WalkFrame *f, JSONWalkPos *pos, JSON *tmp)
+{
+    const JSONHashTable *h;
+    const JSONLinkedList *l;
+    const JSONEntry *e;
+    const JSONNode *n;
+
+    pos->depth = f->pos.depth + 1;
+    if (JSON_TYPE_OBJECT == f->val->type) {
+        h = f->val->data;
+        if (f->next.slot == h->capacity) {
+            return NULL;
+        }
+        e = &h->entries[f->next.slot];
+        f->next.slot = e->next;
+        /* the next sibling loads while the visitor runs */
+        __builtin_prefetch(&h->entries[e->next]);
+        pos->key = e->key;
+        pos->index = -1;
+        return &e->value;
+    }
+
+    l = f->val->data;
+    pos->key = NULL;
+    pos->index = f->index;
+    if (l->packed) {
+        if (f->next.packed == &l->packed[l->size + 1]) {
+            return NULL;
+        }
+        /* a packed value has no JSON of its own, see packed_json */
+        if (JSON_TYPE_NUMBER == l->packed_type) {
+            tmp->type = JSON_TYPE_NUMBER;
+            tmp->data = (int *)f->next.packed;
+        } else {
+            tmp->type = *f->next.packed ? JSON_TYPE_TRUE : JSON_TYPE_FALSE;
+            tmp->data = NULL;
+        }
+        f->next.packed++;
+        f->index++;
+        return tmp;
+    }
+    n = f->next.node;
+    if (n == l->nil) {
+        return NULL;
+    }
+    f->next.node = n->next;
+    f->index++;
+    __builtin_prefetch(n->next);
+    return &n->value;
+}
+
+/* pass V to its callback, and push it if its children are to be walked */
+static int walk_visit(WalkStack *stk, const JSONVisitor *vis, const JSON *v,
+    const JSONWalkPos *pos, void *ctx)
+{
+    WalkFrame f;
+    int ret;
+
+    if (!walk_is_container(v)) {
+        return walk_call(vis->scalar, v, pos, ctx);
+    }
+    /* its header loads while enter runs */
+    __builtin_prefetch(v->data);
+    ret = walk_call(vis->enter, v, pos, ctx);
+    if (JSON_WALK_SKIP == ret) {
+        return walk_call(vis->leave, v, pos, ctx);
+    } else if (JSON_WALK_STOP == ret) {
+        return ret;
+    }
+    walk_frame(&f, v, pos);
+    json_stack_push(*stk, f);
+    return JSON_WALK_CONTINUE;
+}
+
+/*
+ * visit DOC depth-first with VISITOR, return JSON_WALK_STOP if a
+ * callback stopped the walk, else 0
+ */
+int json_walk(const void *doc, const JSONVisitor *visitor, void *ctx)
+{
+    WalkStack stk;
+    WalkFrame *f;
+    JSONWalkPos pos = { NULL, -1, 0 };
+    const JSON *v;
+    JSON tmp;
+    int ret;
+
+    assert(doc && visitor);
+    json_stack_init(stk, 16);
+    ret = walk_visit(&stk, visitor, doc, &pos, ctx);
+    while (JSON_WALK_STOP != ret && !json_stack_empty(stk)) {
+        f = &json_stack_top(stk);
+        v = walk_next(f, &pos, &tmp);
+        if (v) {
+            ret = walk_visit(&stk, visitor, v, &pos, ctx);
+        } else {
+            ret = walk_call(visitor->leave, f->val, &f->pos, ctx);
+            json_stack_pop(stk);
+        }
+    }
+    json_stack_clear(stk);
+
+    return JSON_WALK_STOP == ret ? JSON_WALK_STOP : 0;
+}
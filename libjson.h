@@ -22,6 +22,8 @@
  *  SOFTWARE.
  */
 
+#include <stddef.h>
+
 /* JSON Type */
 enum {
     JSON_TYPE_OBJECT = 1,
@@ -33,6 +35,12 @@ enum {
     JSON_TYPE_NULL
 };
 
+/* flags of sort_with and sort_by */
+enum {
+    JSON_SORT_STABLE = 1,   /* equal items keep their order */
+    JSON_SORT_PARALLEL = 2  /* sort a large array in several threads */
+};
+
 /* JSON */
 typedef struct JSON JSON;
 
@@ -45,6 +53,137 @@ typedef struct JSON JSONTrue;
 typedef struct JSON JSONFalse;
 typedef struct JSON JSONNull;
 
+/* JSON Object Key Handle */
+typedef const char *JSONKey;
+
+/*
+ *  JSON Pointer, RFC 6901
+ *
+ *  Compiled once by JSON_POINTER, "" or "/a/b/0/c": escapes are
+ *  decoded and keys interned then. JSON_POINTER_GET sets <val> to a
+ *  borrowed value, one lookup per token, and returns -1 if there is
+ *  none. A borrowed value lives until the document is modified or
+ *  freed.
+ */
+typedef struct JSONPointer JSONPointer;
+
+/*
+ *  JSONPath
+ *
+ *  Compiled once by JSON_PATH: "$.items[*].price", "$['a b'][0]",
+ *  "$..id", "$.items[?(@.status == 'error' && @.code >= 500)]". Filters
+ *  compare a path from '@' with a number, 'string', true, false or null,
+ *  or test that it exists. JSON_PATH_EVAL sets the first <n> of <vals>
+ *  to the borrowed values selected, in document order, and returns how
+ *  many are selected. They live until the document is modified or
+ *  freed.
+ */
+typedef struct JSONPath JSONPath;
+
+/*
+ *  Document walker
+ *
+ *  JSON_WALK visits a document depth-first, in document order, with no
+ *  recursion and no copies: objects and arrays are passed to enter
+ *  before their children and to leave after them, other values to
+ *  scalar, all borrowed, with their key or index and depth. Callbacks
+ *  return JSON_WALK_CONTINUE, JSON_WALK_SKIP from enter to skip the
+ *  children, or JSON_WALK_STOP, which JSON_WALK then returns; any of
+ *  them may be NULL. Borrowed values live until the document is
+ *  modified or freed, callbacks must not modify it.
+ */
+enum {
+    JSON_WALK_CONTINUE = 0,
+    JSON_WALK_SKIP,
+    JSON_WALK_STOP
+};
+
+typedef struct JSONWalkPos {
+    const char* key; /* in the parent object, else NULL */
+    int index; /* in the parent array, else -1 */
+    int depth; /* 0 for the document */
+} JSONWalkPos;
+
+typedef struct JSONVisitor {
+    int (*enter)(const JSON* val, const JSONWalkPos* pos, void* ctx);
+    int (*leave)(const JSON* val, const JSONWalkPos* pos, void* ctx);
+    int (*scalar)(const JSON* val, const JSONWalkPos* pos, void* ctx);
+} JSONVisitor;
+
+/*
+ *  JSON Patch, RFC 6902
+ *
+ *  JSON_DIFF returns the patch, a array to free with FREE_JSON, of add,
+ *  remove and replace operations that turns <a> into <b>; subtrees
+ *  copies still share are skipped without being compared.
+ *  JSON_PATCH_APPLY applies all operations of a patch to <doc>, or
+ *  none and returns -1 if one fails. The root of <doc> keeps its type.
+ */
+
+/*
+ *  Allocator of all library memory
+ *
+ *  Set it before any JSON is created: memory must be released by the
+ *  allocator that made it, so JSON_SET_ALLOCATOR returns -1 once the
+ *  library holds any memory. With libc, internal objects come from
+ *  slabs that are never released, so it can't change after that.
+ *  Strings returned by get_str and stringify come from it too. REALLOC
+ *  may be NULL; all NULL restores libc.
+ */
+typedef void *(*JSONAllocFn)(void *ctx, size_t size);
+typedef void *(*JSONReallocFn)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+typedef void (*JSONFreeFn)(void *ctx, void *ptr);
+
+/*
+ *  Memory usage of a document, in bytes requested by the library
+ *
+ *  @keys: interned key records, counted at each use
+ *  @strings: string payloads
+ *  @entries: hash table entries, empty slots included
+ *  @nodes: list nodes, sentinels and reserved nodes included
+ *  @numbers: number cells and buffers of packed arrays
+ *  @headers: hash table and list headers
+ *  @total: sum of all above
+ *
+ *  Subtrees shared by copies are counted in every document using them.
+ */
+typedef struct JSONMemoryStats {
+    size_t keys;
+    size_t strings;
+    size_t entries;
+    size_t nodes;
+    size_t numbers;
+    size_t headers;
+    size_t total;
+} JSONMemoryStats;
+
+/*
+ *  Columns of a array of objects, see arr_columnize
+ *
+ *  @key: a interned key, see JSON_KEY
+ *  @type: type of the column, decided by its first value that is not
+ *         null, JSON_TYPE_TRUE for booleans
+ *  @nums: values of a number or boolean column, booleans as 0 and 1
+ *  @strs: values of a string column, borrowed from the array
+ *  @nulls: a bitmap of rows without a value of <type>: not a object,
+ *          no <key>, null or another type, bit i % 8 of nulls[i / 8]
+ *
+ *  Columns of objects and arrays only have <nulls>.
+ */
+typedef struct JSONColumn {
+    JSONKey key;
+    int type;
+    int *nums;
+    const char **strs;
+    unsigned char *nulls;
+} JSONColumn;
+
+typedef struct JSONColumns {
+    int rows;
+    int ncols;
+    JSONColumn *cols;
+} JSONColumns;
+
 /* JSON Object Iter */
 typedef struct JSONObjectIter JSONObjectIter;
 
@@ -70,6 +209,7 @@ struct klass { \
 JSONClass(JSON);
 
 
+#ifndef CONFIG_JSON_NO_CLASS
 /*
  *  JSONObject class
  *
@@ -77,9 +217,37 @@ JSONClass(JSON);
  *  @set: set a <key-val> pair
  *  @delete: delete a <key-val> pair
  *  @get: get a <val>
+ *  @get_ref: get a borrowed <val>, see below
+ *  @get_type: get type of a <val>, 0 if <key> does not exist
+ *  @get_many: get borrowed <val>s of <n> keys at once, a missing one is
+ *             { NULL, 0 }, return the number found
+ *  @reserve: presize for at least <n> pairs
+ *  @shrink_to_fit: release slots not needed by its pairs, a table also
+ *                 shrinks by itself when deletes leave it 1/8 full
+ *  @*_k: same as above, by a key handle from json_key
  *  @begin: return a iterator to the 1st element
  *  @end: return a past-the-end iterator that points to the element
  *        following the last element of the JSONObject
+ *
+ *  add, set copy <val>. add_ref, set_ref take the data of <val>, which
+ *  still points to it and must not be freed. add_move, set_move take
+ *  the data of <val> and leave it with none: a moved-from handle may
+ *  only be freed or reassigned, any other call on it is an error.
+ *
+ *  get, get_str copy the value, which the caller owns and frees.
+ *  get_ref, get_str_ref and get_num make no copy: the value is borrowed
+ *  from the container, it must not be freed or modified, and it stays
+ *  valid only until the container is modified or freed: any add, set,
+ *  del or reserve may move it. So do the values of get_many and the
+ *  views made by JSON_POINTER_GET, JSON_PATH_EVAL and JSON_WALK.
+ *  Reset the data of a view to NULL before passing it to get_ref again.
+ *
+ *  Objects and arrays are copied in O(1): copies share their data, and
+ *  a copy clones one level of it when it is modified.
+ *
+ *  json_freeze makes a document read-only, in a compact layout that
+ *  views taken before no longer point into. Modifiers of a frozen
+ *  object or array warn and leave it as it is; its copies are frozen.
  */
 #define JSONObjectClass(klass) \
 struct klass { \
@@ -89,6 +257,7 @@ struct klass { \
     /* member functions */ \
     void (*add)(JSONObject *this, const char *key, const void *val); \
     void (*add_ref)(JSONObject *this, const char *key, const void *val); \
+    void (*add_move)(JSONObject *this, const char *key, void *val); \
     void (*add_str)(JSONObject *this, const char *key, const char *val); \
     void (*add_num)(JSONObject *this, const char *key, int val); \
     void (*add_true)(JSONObject *this, const char *key); \
@@ -97,6 +266,7 @@ struct klass { \
     void (*del)(JSONObject *this, const char *key); \
     void (*set)(JSONObject *this, const char *key, const void *val); \
     void (*set_ref)(JSONObject *this, const char *key, const void *val); \
+    void (*set_move)(JSONObject *this, const char *key, void *val); \
     void (*set_str)(JSONObject *this, const char *key, const char *val); \
     void (*set_num)(JSONObject *this, const char *key, int val); \
     void (*set_true)(JSONObject *this, const char *key); \
@@ -107,6 +277,18 @@ struct klass { \
     char *(*get_str)(const JSONObject *this, const char *key); \
     char *(*get_str_ref)(const JSONObject *this, const char *key); \
     int (*get_num)(const JSONObject *this, const char *key); \
+    int (*get_type)(const JSONObject *this, const char *key); \
+    int (*get_many)(const JSONObject *this, const char *const keys[], int n, JSON vals[]); \
+    void (*reserve)(JSONObject *this, int n); \
+    void (*shrink_to_fit)(JSONObject *this); \
+    void (*del_k)(JSONObject *this, JSONKey key); \
+    void (*set_k)(JSONObject *this, JSONKey key, const void *val); \
+    void (*set_str_k)(JSONObject *this, JSONKey key, const char *val); \
+    void (*set_num_k)(JSONObject *this, JSONKey key, int val); \
+    void *(*get_k)(const JSONObject *this, JSONKey key, void *val); \
+    void *(*get_ref_k)(const JSONObject *this, JSONKey key, void *val); \
+    char *(*get_str_ref_k)(const JSONObject *this, JSONKey key); \
+    int (*get_num_k)(const JSONObject *this, JSONKey key); \
     JSONObjectIter (*begin)(const JSONObject *this); \
     JSONObjectIter (*end)(const JSONObject *this); \
 }
@@ -116,7 +298,8 @@ JSONObjectClass(JSONObject);
  *  JSONString class
  *
  *  @set: set
- *  @get: get
+ *  @get: get a copy
+ *  @get_ref: get borrowed chars, valid until next set or free
  */
 #define JSONStringClass(klass) \
 struct klass { \
@@ -124,6 +307,7 @@ struct klass { \
     JSONClass(); \
     void (*set)(JSONString *this, const char *val); \
     char *(*get)(const JSONString *this); \
+    char *(*get_ref)(const JSONString *this); \
 }
 JSONStringClass(JSONString);
 
@@ -149,7 +333,22 @@ JSONNumberClass(JSONNumber);
  *  @set: set a <val>
  *  @delete: delete a <val>
  *  @get: get a <val>
- *  @sort: sort all items by quick sort
+ *  @get_ref: get a borrowed <val>, see JSONObject
+ *  @add_move, @set_move: take a <val>, see JSONObject
+ *  @get_type: get type of a <val>, 0 if <pos> is out of range
+ *  @reserve: presize for at least <n> items
+ *  @shrink_to_fit: release the nodes reserved for items to come
+ *  @sort: sort all items by <compare_fn> on their data, in O(n log n), equal
+ *        items in any order, see json_cmp_num and json_cmp_str
+ *  @sort_with: sort, <flags> of JSON_SORT_STABLE and JSON_SORT_PARALLEL
+ *  @sort_by: sort by the values at <path>, keys separated by '.', of the
+ *        items, NULL for the items themselves: numbers, strings, false,
+ *        true, null, then objects and arrays, then items without <path>
+ *  @sum, @min, @max, @mean: aggregate the numbers, other items are skipped,
+ *        0 if there is no number
+ *  @count_if: count the numbers <pred> is true for
+ *  @columnize: copy <keys> of its objects into one column each, free them
+ *        by FREE_JSON_COLUMNS, see JSONColumn
  *  @begin: return a iterator to the first element
  *  @end: return a past-the-end iterator that points to the element following
  *        the last element of the jsong_array
@@ -164,6 +363,7 @@ struct klass { \
 /* public */ \
     /* member functions */ \
     void (*add)(JSONArray *this, int pos, const void *val); \
+    void (*add_move)(JSONArray *this, int pos, void *val); \
     void (*add_str)(JSONArray *this, int pos, const char *val); \
     void (*add_num)(JSONArray *this, int pos, int val); \
     void (*add_true)(JSONArray *this, int pos); \
@@ -171,21 +371,36 @@ struct klass { \
     void (*add_null)(JSONArray *this, int pos); \
     void (*del)(JSONArray *this, int pos); \
     void (*set)(JSONArray *this, int pos, const void *val); \
+    void (*set_move)(JSONArray *this, int pos, void *val); \
     void (*set_str)(JSONArray *this, int pos, const char *val); \
     void (*set_num)(JSONArray *this, int pos, int val); \
     void (*set_true)(JSONArray *this, int pos); \
     void (*set_false)(JSONArray *this, int pos); \
     void (*set_null)(JSONArray *this, int pos); \
     void *(*get)(const JSONArray *this, int pos, void *val); \
+    void *(*get_ref)(const JSONArray *this, int pos, void *val); \
     char *(*get_str)(const JSONArray *this, int pos); \
+    char *(*get_str_ref)(const JSONArray *this, int pos); \
     int (*get_num)(const JSONArray *this, int pos); \
+    int (*get_type)(const JSONArray *this, int pos); \
+    void (*reserve)(JSONArray *this, int n); \
+    void (*shrink_to_fit)(JSONArray *this); \
     void (*sort)(JSONArray *this, int (*compare_fn)(const void*, const void*)); \
+    void (*sort_with)(JSONArray *this, int (*compare_fn)(const void*, const void*), int flags); \
+    void (*sort_by)(JSONArray *this, const char *path, int flags); \
+    long long (*sum)(const JSONArray *this); \
+    int (*min)(const JSONArray *this); \
+    int (*max)(const JSONArray *this); \
+    double (*mean)(const JSONArray *this); \
+    int (*count_if)(const JSONArray *this, int (*pred)(int val)); \
+    JSONColumns *(*columnize)(const JSONArray *this, const char *const keys[], int n); \
     JSONArrayIter (*begin)(const JSONArray *this); \
     JSONArrayIter (*end)(const JSONArray *this); \
     JSONArrayIter (*rbegin)(const JSONArray *this); \
     JSONArrayIter (*rend)(const JSONArray *this); \
 }
 JSONArrayClass(JSONArray);
+#endif /* CONFIG_JSON_NO_CLASS */
 
 
 struct JSONObjectIter {
@@ -198,6 +413,7 @@ struct JSONObjectIter {
 struct JSONArrayIter {
     void* index;
     JSON value;
+    int __packed;
 };
 
 
@@ -232,18 +448,227 @@ JSONFalse* false_default_cstr();
 JSONFalse false_default();
 JSONNull* null_default_cstr();
 JSONNull null_default();
+JSONKey json_key(const char* str);
+void json_key_free(JSONKey key);
+JSONPointer* json_pointer_compile(const char* str);
+void json_pointer_free(JSONPointer* ptr);
+int json_pointer_get(const void* doc, const JSONPointer* ptr, void* val);
+JSONPath* json_path_compile(const char* query);
+void json_path_free(JSONPath* path);
+int json_path_eval(const void* doc, const JSONPath* path, JSON* vals, int n);
+int json_walk(const void* doc, const JSONVisitor* visitor, void* ctx);
+JSONArray* json_diff(const void* a, const void* b);
+int json_patch_apply(void* doc, const void* patch);
+unsigned long json_reseed_count(void);
+int json_set_allocator(JSONAllocFn alloc, JSONReallocFn realloc,
+    JSONFreeFn free, void *ctx);
 int json_reassign(void* dst, const void* src);
 int json_free(void* val);
 void json_free_data(JSON* json);
 
 void json_stringify(const void* json, char** pstr, int* plen);
 int json_parse(const char* str, void* json);
+int json_memory_usage(const void* json, JSONMemoryStats* stats);
+void json_memory_live(size_t* nallocs, size_t* nbytes);
+int json_compact(void* json);
+int json_freeze(void* json);
+int json_is_frozen(const void* json);
+JSON json_handle_copy(const void* src);
 
 JSONObjectIter obj_iterate(JSONObjectIter iter);
 JSONArrayIter arr_iterate(JSONArrayIter iter);
 JSONArrayIter arr_riterate(JSONArrayIter iter);
 
 
+/*
+ *  Compact handles
+ *
+ *  A JSON is a handle by itself: the data and the type, 16 bytes with no
+ *  table of member functions. The json_obj_*, json_arr_*, json_str_* and
+ *  json_num_* functions below take a handle and call the implementation
+ *  directly, so calls are not indirect and small accessors are inlined.
+ *  They follow the rules of the member functions of the same name.
+ *
+ *  Handles are made by the *_HANDLE macros, passed to JSON_STRINGIFY,
+ *  JSON_PARSE and the add/set functions like any JSON, and released by
+ *  FREE_JSON_DATA. A class instance is a handle too, as (JSON *)obj.
+ *  Define CONFIG_JSON_NO_CLASS to leave the classes out.
+ */
+JSON obj_handle(void);
+JSON arr_handle(void);
+JSON str_handle(const char* val);
+JSON num_handle(int val);
+JSON true_handle(void);
+JSON false_handle(void);
+JSON null_handle(void);
+
+void obj_add(JSONObject* obj, const char* key, const void* val);
+void obj_add_ref(JSONObject* obj, const char* key, const void* val);
+void obj_add_move(JSONObject* obj, const char* key, void* val);
+void obj_add_str(JSONObject* obj, const char* key, const char* val);
+void obj_add_num(JSONObject* obj, const char* key, int val);
+void obj_add_true(JSONObject* obj, const char* key);
+void obj_add_false(JSONObject* obj, const char* key);
+void obj_add_null(JSONObject* obj, const char* key);
+void obj_del(JSONObject* obj, const char* key);
+void obj_set(JSONObject* obj, const char* key, const void* val);
+void obj_set_ref(JSONObject* obj, const char* key, const void* val);
+void obj_set_move(JSONObject* obj, const char* key, void* val);
+void obj_set_str(JSONObject* obj, const char* key, const char* val);
+void obj_set_num(JSONObject* obj, const char* key, int val);
+void obj_set_true(JSONObject* obj, const char* key);
+void obj_set_false(JSONObject* obj, const char* key);
+void obj_set_null(JSONObject* obj, const char* key);
+void* obj_get(const JSONObject* obj, const char* key, void* val);
+void* obj_get_ref(const JSONObject* obj, const char* key, void* val);
+char* obj_get_str(const JSONObject* obj, const char* key);
+char* obj_get_str_ref(const JSONObject* obj, const char* key);
+int obj_get_num(const JSONObject* obj, const char* key);
+int obj_get_type(const JSONObject* obj, const char* key);
+int obj_get_many(const JSONObject* obj, const char* const keys[], int n, JSON vals[]);
+void obj_reserve(JSONObject* obj, int n);
+void obj_shrink_to_fit(JSONObject* obj);
+void obj_del_k(JSONObject* obj, JSONKey key);
+void obj_set_k(JSONObject* obj, JSONKey key, const void* val);
+void obj_set_str_k(JSONObject* obj, JSONKey key, const char* val);
+void obj_set_num_k(JSONObject* obj, JSONKey key, int val);
+void* obj_get_k(const JSONObject* obj, JSONKey key, void* val);
+void* obj_get_ref_k(const JSONObject* obj, JSONKey key, void* val);
+char* obj_get_str_ref_k(const JSONObject* obj, JSONKey key);
+int obj_get_num_k(const JSONObject* obj, JSONKey key);
+JSONObjectIter obj_begin(const JSONObject* obj);
+JSONObjectIter obj_end(const JSONObject* obj);
+
+void arr_add(JSONArray* arr, int pos, const void* val);
+void arr_add_move(JSONArray* arr, int pos, void* val);
+void arr_add_str(JSONArray* arr, int pos, const char* val);
+void arr_add_num(JSONArray* arr, int pos, int val);
+void arr_add_true(JSONArray* arr, int pos);
+void arr_add_false(JSONArray* arr, int pos);
+void arr_add_null(JSONArray* arr, int pos);
+void arr_del(JSONArray* arr, int pos);
+void arr_set(JSONArray* arr, int pos, const void* val);
+void arr_set_move(JSONArray* arr, int pos, void* val);
+void arr_set_str(JSONArray* arr, int pos, const char* val);
+void arr_set_num(JSONArray* arr, int pos, int val);
+void arr_set_true(JSONArray* arr, int pos);
+void arr_set_false(JSONArray* arr, int pos);
+void arr_set_null(JSONArray* arr, int pos);
+void* arr_get(const JSONArray* arr, int pos, void* val);
+void* arr_get_ref(const JSONArray* arr, int pos, void* val);
+char* arr_get_str(const JSONArray* arr, int pos);
+char* arr_get_str_ref(const JSONArray* arr, int pos);
+int arr_get_num(const JSONArray* arr, int pos);
+int arr_get_type(const JSONArray* arr, int pos);
+void arr_reserve(JSONArray* arr, int n);
+void arr_shrink_to_fit(JSONArray* arr);
+void arr_qsort(JSONArray* arr, int (*compare_fn)(const void*, const void*));
+void arr_sort_with(JSONArray* arr, int (*compare_fn)(const void*, const void*), int flags);
+void arr_sort_by(JSONArray* arr, const char* path, int flags);
+int json_cmp_num(const void* a, const void* b);
+int json_cmp_str(const void* a, const void* b);
+long long arr_sum(const JSONArray* arr);
+int arr_min(const JSONArray* arr);
+int arr_max(const JSONArray* arr);
+double arr_mean(const JSONArray* arr);
+int arr_count_if(const JSONArray* arr, int (*pred)(int val));
+JSONColumns* arr_columnize(const JSONArray* arr, const char* const keys[], int n);
+void json_columns_free(JSONColumns* cols);
+JSONArrayIter arr_begin(const JSONArray* arr);
+JSONArrayIter arr_end(const JSONArray* arr);
+JSONArrayIter arr_rbegin(const JSONArray* arr);
+JSONArrayIter arr_rend(const JSONArray* arr);
+
+void str_set(JSONString* str, const char* val);
+char* str_get(const JSONString* str);
+void num_set(JSONNumber* num, int val);
+
+/* the type of a handle */
+static inline int json_type(const JSON* json) { return json->type; }
+
+/* object */
+static inline void json_obj_add(JSON* obj, const char* key, const void* val) { obj_add((JSONObject*)obj, key, val); }
+static inline void json_obj_add_ref(JSON* obj, const char* key, const void* val) { obj_add_ref((JSONObject*)obj, key, val); }
+static inline void json_obj_add_move(JSON* obj, const char* key, void* val) { obj_add_move((JSONObject*)obj, key, val); }
+static inline void json_obj_add_str(JSON* obj, const char* key, const char* val) { obj_add_str((JSONObject*)obj, key, val); }
+static inline void json_obj_add_num(JSON* obj, const char* key, int val) { obj_add_num((JSONObject*)obj, key, val); }
+static inline void json_obj_add_true(JSON* obj, const char* key) { obj_add_true((JSONObject*)obj, key); }
+static inline void json_obj_add_false(JSON* obj, const char* key) { obj_add_false((JSONObject*)obj, key); }
+static inline void json_obj_add_null(JSON* obj, const char* key) { obj_add_null((JSONObject*)obj, key); }
+static inline void json_obj_del(JSON* obj, const char* key) { obj_del((JSONObject*)obj, key); }
+static inline void json_obj_set(JSON* obj, const char* key, const void* val) { obj_set((JSONObject*)obj, key, val); }
+static inline void json_obj_set_ref(JSON* obj, const char* key, const void* val) { obj_set_ref((JSONObject*)obj, key, val); }
+static inline void json_obj_set_move(JSON* obj, const char* key, void* val) { obj_set_move((JSONObject*)obj, key, val); }
+static inline void json_obj_set_str(JSON* obj, const char* key, const char* val) { obj_set_str((JSONObject*)obj, key, val); }
+static inline void json_obj_set_num(JSON* obj, const char* key, int val) { obj_set_num((JSONObject*)obj, key, val); }
+static inline void json_obj_set_true(JSON* obj, const char* key) { obj_set_true((JSONObject*)obj, key); }
+static inline void json_obj_set_false(JSON* obj, const char* key) { obj_set_false((JSONObject*)obj, key); }
+static inline void json_obj_set_null(JSON* obj, const char* key) { obj_set_null((JSONObject*)obj, key); }
+static inline void* json_obj_get(const JSON* obj, const char* key, void* val) { return obj_get((const JSONObject*)obj, key, val); }
+static inline void* json_obj_get_ref(const JSON* obj, const char* key, void* val) { return obj_get_ref((const JSONObject*)obj, key, val); }
+static inline char* json_obj_get_str(const JSON* obj, const char* key) { return obj_get_str((const JSONObject*)obj, key); }
+static inline char* json_obj_get_str_ref(const JSON* obj, const char* key) { return obj_get_str_ref((const JSONObject*)obj, key); }
+static inline int json_obj_get_num(const JSON* obj, const char* key) { return obj_get_num((const JSONObject*)obj, key); }
+static inline int json_obj_get_type(const JSON* obj, const char* key) { return obj_get_type((const JSONObject*)obj, key); }
+static inline int json_obj_get_many(const JSON* obj, const char* const keys[], int n, JSON vals[]) { return obj_get_many((const JSONObject*)obj, keys, n, vals); }
+static inline void json_obj_reserve(JSON* obj, int n) { obj_reserve((JSONObject*)obj, n); }
+static inline void json_obj_shrink_to_fit(JSON* obj) { obj_shrink_to_fit((JSONObject*)obj); }
+static inline void json_obj_del_k(JSON* obj, JSONKey key) { obj_del_k((JSONObject*)obj, key); }
+static inline void json_obj_set_k(JSON* obj, JSONKey key, const void* val) { obj_set_k((JSONObject*)obj, key, val); }
+static inline void json_obj_set_str_k(JSON* obj, JSONKey key, const char* val) { obj_set_str_k((JSONObject*)obj, key, val); }
+static inline void json_obj_set_num_k(JSON* obj, JSONKey key, int val) { obj_set_num_k((JSONObject*)obj, key, val); }
+static inline void* json_obj_get_k(const JSON* obj, JSONKey key, void* val) { return obj_get_k((const JSONObject*)obj, key, val); }
+static inline void* json_obj_get_ref_k(const JSON* obj, JSONKey key, void* val) { return obj_get_ref_k((const JSONObject*)obj, key, val); }
+static inline char* json_obj_get_str_ref_k(const JSON* obj, JSONKey key) { return obj_get_str_ref_k((const JSONObject*)obj, key); }
+static inline int json_obj_get_num_k(const JSON* obj, JSONKey key) { return obj_get_num_k((const JSONObject*)obj, key); }
+static inline JSONObjectIter json_obj_begin(const JSON* obj) { return obj_begin((const JSONObject*)obj); }
+static inline JSONObjectIter json_obj_end(const JSON* obj) { return obj_end((const JSONObject*)obj); }
+
+/* array */
+static inline void json_arr_add(JSON* arr, int pos, const void* val) { arr_add((JSONArray*)arr, pos, val); }
+static inline void json_arr_add_move(JSON* arr, int pos, void* val) { arr_add_move((JSONArray*)arr, pos, val); }
+static inline void json_arr_add_str(JSON* arr, int pos, const char* val) { arr_add_str((JSONArray*)arr, pos, val); }
+static inline void json_arr_add_num(JSON* arr, int pos, int val) { arr_add_num((JSONArray*)arr, pos, val); }
+static inline void json_arr_add_true(JSON* arr, int pos) { arr_add_true((JSONArray*)arr, pos); }
+static inline void json_arr_add_false(JSON* arr, int pos) { arr_add_false((JSONArray*)arr, pos); }
+static inline void json_arr_add_null(JSON* arr, int pos) { arr_add_null((JSONArray*)arr, pos); }
+static inline void json_arr_del(JSON* arr, int pos) { arr_del((JSONArray*)arr, pos); }
+static inline void json_arr_set(JSON* arr, int pos, const void* val) { arr_set((JSONArray*)arr, pos, val); }
+static inline void json_arr_set_move(JSON* arr, int pos, void* val) { arr_set_move((JSONArray*)arr, pos, val); }
+static inline void json_arr_set_str(JSON* arr, int pos, const char* val) { arr_set_str((JSONArray*)arr, pos, val); }
+static inline void json_arr_set_num(JSON* arr, int pos, int val) { arr_set_num((JSONArray*)arr, pos, val); }
+static inline void json_arr_set_true(JSON* arr, int pos) { arr_set_true((JSONArray*)arr, pos); }
+static inline void json_arr_set_false(JSON* arr, int pos) { arr_set_false((JSONArray*)arr, pos); }
+static inline void json_arr_set_null(JSON* arr, int pos) { arr_set_null((JSONArray*)arr, pos); }
+static inline void* json_arr_get(const JSON* arr, int pos, void* val) { return arr_get((const JSONArray*)arr, pos, val); }
+static inline void* json_arr_get_ref(const JSON* arr, int pos, void* val) { return arr_get_ref((const JSONArray*)arr, pos, val); }
+static inline char* json_arr_get_str(const JSON* arr, int pos) { return arr_get_str((const JSONArray*)arr, pos); }
+static inline char* json_arr_get_str_ref(const JSON* arr, int pos) { return arr_get_str_ref((const JSONArray*)arr, pos); }
+static inline int json_arr_get_num(const JSON* arr, int pos) { return arr_get_num((const JSONArray*)arr, pos); }
+static inline int json_arr_get_type(const JSON* arr, int pos) { return arr_get_type((const JSONArray*)arr, pos); }
+static inline void json_arr_reserve(JSON* arr, int n) { arr_reserve((JSONArray*)arr, n); }
+static inline void json_arr_shrink_to_fit(JSON* arr) { arr_shrink_to_fit((JSONArray*)arr); }
+static inline void json_arr_sort(JSON* arr, int (*compare_fn)(const void*, const void*)) { arr_qsort((JSONArray*)arr, compare_fn); }
+static inline void json_arr_sort_with(JSON* arr, int (*compare_fn)(const void*, const void*), int flags) { arr_sort_with((JSONArray*)arr, compare_fn, flags); }
+static inline void json_arr_sort_by(JSON* arr, const char* path, int flags) { arr_sort_by((JSONArray*)arr, path, flags); }
+static inline long long json_arr_sum(const JSON* arr) { return arr_sum((const JSONArray*)arr); }
+static inline int json_arr_min(const JSON* arr) { return arr_min((const JSONArray*)arr); }
+static inline int json_arr_max(const JSON* arr) { return arr_max((const JSONArray*)arr); }
+static inline double json_arr_mean(const JSON* arr) { return arr_mean((const JSONArray*)arr); }
+static inline int json_arr_count_if(const JSON* arr, int (*pred)(int val)) { return arr_count_if((const JSONArray*)arr, pred); }
+static inline JSONColumns* json_arr_columnize(const JSON* arr, const char* const keys[], int n) { return arr_columnize((const JSONArray*)arr, keys, n); }
+static inline JSONArrayIter json_arr_begin(const JSON* arr) { return arr_begin((const JSONArray*)arr); }
+static inline JSONArrayIter json_arr_end(const JSON* arr) { return arr_end((const JSONArray*)arr); }
+static inline JSONArrayIter json_arr_rbegin(const JSON* arr) { return arr_rbegin((const JSONArray*)arr); }
+static inline JSONArrayIter json_arr_rend(const JSON* arr) { return arr_rend((const JSONArray*)arr); }
+
+/* string and number, reads are inlined */
+static inline void json_str_set(JSON* str, const char* val) { str_set((JSONString*)str, val); }
+static inline char* json_str_get(const JSON* str) { return str_get((const JSONString*)str); }
+static inline char* json_str_get_ref(const JSON* str) { return (char*)str->data; }
+static inline void json_num_set(JSON* num, int val) { num_set((JSONNumber*)num, val); }
+static inline int json_num_get(const JSON* num) { return *(const int*)num->data; }
+
 /*
  *  User Interface
  */
@@ -254,6 +679,20 @@ JSONArrayIter arr_riterate(JSONArrayIter iter);
 #define JSON_OBJECT_COPY_PTR(obj)             obj_copy_cstr(obj)
 #define JSON_OBJECT_COPY(obj)                 obj_copy(obj)
 #define JSON_OBJECT_FOREACH(iter, end)        for(;iter.index != end.index;iter = obj_iterate(iter))
+#define JSON_KEY(str)                         json_key(str)
+#define FREE_JSON_KEY(key)                    json_key_free(key)
+#define JSON_POINTER(str)                     json_pointer_compile(str)
+#define FREE_JSON_POINTER(ptr)                json_pointer_free(ptr)
+#define JSON_POINTER_GET(doc, ptr, val)       json_pointer_get(doc, ptr, val)
+#define JSON_PATH(query)                      json_path_compile(query)
+#define FREE_JSON_PATH(path)                  json_path_free(path)
+#define JSON_PATH_EVAL(doc, path, vals, n)    json_path_eval(doc, path, vals, n)
+#define JSON_WALK(doc, visitor, ctx)          json_walk(doc, visitor, ctx)
+#define JSON_DIFF(a, b)                       json_diff(a, b)
+#define JSON_PATCH_APPLY(doc, patch)          json_patch_apply(doc, patch)
+#define FREE_JSON_COLUMNS(cols)               json_columns_free(cols)
+#define JSON_RESEED_COUNT()                   json_reseed_count()
+#define JSON_SET_ALLOCATOR(a, r, f, ctx)      json_set_allocator(a, r, f, ctx)
 #define JSON_STRING_PTR(str)                  str_assign_cstr(str)
 #define JSON_STRING(str)                      str_assign(str)
 #define JSON_STRING_DATA_PTR(data)            str_data_cstr(data)
@@ -280,9 +719,22 @@ JSONArrayIter arr_riterate(JSONArrayIter iter);
 #define JSON_FALSE()                          false_default()
 #define JSON_NULL_PTR()                       null_default_cstr()
 #define JSON_NULL()                           null_default()
+#define JSON_OBJECT_HANDLE()                  obj_handle()
+#define JSON_ARRAY_HANDLE()                   arr_handle()
+#define JSON_STRING_HANDLE(str)               str_handle(str)
+#define JSON_NUMBER_HANDLE(num)               num_handle(num)
+#define JSON_TRUE_HANDLE()                    true_handle()
+#define JSON_FALSE_HANDLE()                   false_handle()
+#define JSON_NULL_HANDLE()                    null_handle()
+#define JSON_HANDLE_COPY(json)                json_handle_copy(json)
 #define JSON_REASSIGN(json, val)              json_reassign(json, val)
 #define FREE_JSON(json)                       json_free(json)
 #define FREE_JSON_DATA(json)                  json_free_data(json)
 
 #define JSON_STRINGIFY(json, pstr, plen)      json_stringify(json, pstr, plen)
-#define JSON_PARSE(str, json)                 json_parse(str, json)
\ No newline at end of file
+#define JSON_PARSE(str, json)                 json_parse(str, json)
+#define JSON_MEMORY_USAGE(json, stats)        json_memory_usage(json, stats)
+#define JSON_MEMORY_LIVE(nallocs, nbytes)     json_memory_live(nallocs, nbytes)
+#define JSON_COMPACT(json)                    json_compact(json)
+#define JSON_FREEZE(json)                     json_freeze(json)
+#define JSON_IS_FROZEN(json)                  json_is_frozen(json)
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #define COUNT 1000
 #define TEST_EXPECT(__val, __cmpr) \
@@ -870,6 +871,435 @@ void test_json_array_quick_sort(void)
     FREE_JSON(json);
 }
 
+void test_json_array_reserve(void)
+{
+    int i;
+    JSONArray* json = JSON_ARRAY_PTR();
+
+    /* presize, then add elements from reserved nodes */
+    json->reserve(json, COUNT);
+    TEST_EXPECT(get_json_array_list_size(json), 0);
+    for (i = 0; i < COUNT; i++) {
+        json->add_num(json, -1, i);
+    }
+    TEST_EXPECT(get_json_array_list_size(json), COUNT);
+    for (i = 0; i < COUNT; i++) {
+        TEST_EXPECT(json->get_num(json, i), i);
+    }
+
+    /* unused reserved nodes are released with the array */
+    json->reserve(json, 2 * COUNT);
+    json->add_num(json, 0, -1);
+    TEST_EXPECT(json->get_num(json, 0), -1);
+
+    FREE_JSON(json);
+}
+
+void test_json_array_get_ref(void)
+{
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONArray* json = JSON_ARRAY_PTR();
+    JSONObject view = JSON_OBJECT_DATA(NULL);
+
+    json_obj->add_num(json_obj, "id", 1);
+    json->add(json, -1, json_obj);
+    json->add_str(json, -1, "str");
+    json->add_num(json, -1, 7);
+    json->add_null(json, -1);
+
+    /* borrowed views share data with the items */
+    json->get_ref(json, 0, &view);
+    TEST_EXPECT(view.data, ((JSON *)get_json_array_list_head(json))->data);
+    TEST_EXPECT(view.get_num(&view, "id"), 1);
+    TEST_EXPECT(strcmp(json->get_str_ref(json, 1), "str"), 0);
+    TEST_EXPECT(json->get_str_ref(json, -3), json->get_str_ref(json, 1));
+    TEST_EXPECT(json->get_num(json, -2), 7);
+
+    /* types without any copy */
+    TEST_EXPECT(json->get_type(json, 0), JSON_TYPE_OBJECT);
+    TEST_EXPECT(json->get_type(json, 1), JSON_TYPE_STRING);
+    TEST_EXPECT(json->get_type(json, -1), JSON_TYPE_NULL);
+    TEST_EXPECT(json->get_type(json, 4), 0);
+
+    FREE_JSON(json_obj);
+    FREE_JSON(json);
+}
+
+void test_json_array_move(void)
+{
+    void *data;
+    JSONArray* json = JSON_ARRAY_PTR();
+    JSONArray* json_sub = JSON_ARRAY_PTR();
+    JSONString* json_str = JSON_STRING_PTR("moved");
+
+    /* the array takes the data, the source is left empty */
+    json_sub->add_num(json_sub, 0, 1);
+    data = json_sub->data;
+    json->add_move(json, 0, json_sub);
+    TEST_EXPECT(json_sub->data, NULL);
+    TEST_EXPECT(((JSON *)get_json_array_list_head(json))->data, data);
+
+    /* set replaces the old value */
+    json->set_move(json, 0, json_str);
+    TEST_EXPECT(json_str->data, NULL);
+    TEST_EXPECT(strcmp(json->get_str_ref(json, 0), "moved"), 0);
+    TEST_EXPECT(get_json_array_list_size(json), 1);
+
+    /* a illegal position is not taken */
+    json_str->set(json_str, "kept");
+    json->add_move(json, 5, json_str);
+    TEST_EXPECT(strcmp(json_str->data, "kept"), 0);
+
+    FREE_JSON(json_sub);
+    FREE_JSON(json_str);
+    FREE_JSON(json);
+}
+
+void test_json_array_copy_on_write(void)
+{
+    int i;
+    JSONArray* json = JSON_ARRAY_PTR();
+    JSONArray* json_copy;
+
+    for (i = 0; i < COUNT; i++) {
+        json->add_num(json, -1, i);
+    }
+
+    /* a copy shares all data until it is modified */
+    json_copy = JSON_ARRAY_COPY_PTR(json);
+    TEST_EXPECT(json_copy->data, json->data);
+    json_copy->del(json_copy, 0);
+    TEST_EXPECT((json_copy->data != json->data), 1);
+    TEST_EXPECT(get_json_array_list_size(json), COUNT);
+    TEST_EXPECT(get_json_array_list_size(json_copy), COUNT - 1);
+    TEST_EXPECT(json->get_num(json, 0), 0);
+    TEST_EXPECT(json_copy->get_num(json_copy, 0), 1);
+
+    /* sorting a shared array leaves other copies in order */
+    FREE_JSON(json_copy);
+    json_copy = JSON_ARRAY_COPY_PTR(json);
+    json_copy->add_num(json_copy, 0, COUNT);
+    TEST_EXPECT(json->get_num(json, 0), 0);
+    TEST_EXPECT(json_copy->get_num(json_copy, 0), COUNT);
+
+    FREE_JSON(json_copy);
+    FREE_JSON(json);
+}
+
+void test_json_array_packed(void)
+{
+    int i, sum, len;
+    char* str_json;
+    JSONArrayIter iter, end;
+    JSONMemoryStats st, st2;
+    JSONArray* json = JSON_ARRAY_PTR();
+    JSONArray* json_bool = JSON_ARRAY_PTR();
+
+    /* only numbers: one buffer and no nodes */
+    for (i = 0; i < COUNT; i++) {
+        json->add_num(json, -1, i);
+    }
+    json->add_num(json, 0, -1);
+    TEST_EXPECT(json->get_num(json, 0), -1);
+    TEST_EXPECT(json->get_num(json, -1), COUNT - 1);
+    TEST_EXPECT(get_json_array_list_head(json), get_json_array_list_nil(json));
+    JSON_MEMORY_USAGE(json, &st);
+    TEST_EXPECT((st.total < 8 * COUNT), 1);
+    json->del(json, 0);
+
+    /* iterators read the packed values */
+    sum = 0;
+    iter = json->begin(json);
+    end = json->end(json);
+    JSON_ARRAY_FOREACH(iter, end)
+    {
+        TEST_EXPECT(iter.value.type, JSON_TYPE_NUMBER);
+        sum += *(int *)iter.value.data;
+    }
+    TEST_EXPECT(sum, COUNT * (COUNT - 1) / 2);
+    i = COUNT - 1;
+    iter = json->rbegin(json);
+    end = json->rend(json);
+    JSON_ARRAY_REVERSE_FOREACH(iter, end)
+    {
+        TEST_EXPECT(*(int *)iter.value.data, i);
+        i--;
+    }
+    TEST_EXPECT(i, -1);
+
+    /* another type moves the values back into nodes */
+    json->add_str(json, 1, "str");
+    TEST_EXPECT(json->get_type(json, 1), JSON_TYPE_STRING);
+    TEST_EXPECT(json->get_num(json, 2), 1);
+    TEST_EXPECT(json->get_num(json, -1), COUNT - 1);
+    JSON_MEMORY_USAGE(json, &st2);
+    TEST_EXPECT((st2.total > st.total), 1);
+
+    /* and shrink_to_fit packs them again once it is gone */
+    json->del(json, 1);
+    json->shrink_to_fit(json);
+    JSON_MEMORY_USAGE(json, &st2);
+    TEST_EXPECT((st2.total < st.total), 1);
+    TEST_EXPECT(json->get_num(json, 1), 1);
+
+    /* only booleans */
+    json_bool->add_true(json_bool, -1);
+    json_bool->add_false(json_bool, -1);
+    json_bool->add_true(json_bool, 1);
+    TEST_EXPECT(json_bool->get_type(json_bool, 0), JSON_TYPE_TRUE);
+    TEST_EXPECT(json_bool->get_type(json_bool, 1), JSON_TYPE_TRUE);
+    TEST_EXPECT(json_bool->get_type(json_bool, 2), JSON_TYPE_FALSE);
+    json_bool->set_false(json_bool, 0);
+    json_stringify(json_bool, &str_json, &len);
+    TEST_EXPECT(strcmp(str_json, "[false,true,false]"), 0);
+    free(str_json);
+
+    /* a number is not a boolean */
+    json_bool->add_num(json_bool, -1, 7);
+    TEST_EXPECT(json_bool->get_type(json_bool, 2), JSON_TYPE_FALSE);
+    TEST_EXPECT(json_bool->get_num(json_bool, 3), 7);
+
+    /* parsed and sorted in place */
+    FREE_JSON(json);
+    json = JSON_ARRAY_PTR();
+    json_parse("[3,1,2]", json);
+    json->sort(json, numcmp);
+    json_stringify(json, &str_json, &len);
+    TEST_EXPECT(strcmp(str_json, "[1,2,3]"), 0);
+    free(str_json);
+
+    FREE_JSON(json);
+    FREE_JSON(json_bool);
+}
+
+/* only for test */
+static int is_even(int val)
+{
+    return 0 == val % 2;
+}
+
+void test_json_array_aggregate(void)
+{
+    int i;
+    JSONArray* json = JSON_ARRAY_PTR();
+
+    /* nothing to aggregate */
+    TEST_EXPECT(json->sum(json), 0);
+    TEST_EXPECT(json->min(json), 0);
+    TEST_EXPECT(json->mean(json), 0);
+
+    /* packed numbers, the tail not a multiple of the vector width */
+    for (i = 0; i < COUNT + 3; i++) {
+        json->add_num(json, -1, i - COUNT / 2);
+    }
+    json->add_num(json, -1, INT32_MAX);
+    json->add_num(json, -1, INT32_MAX);
+    TEST_EXPECT(json->sum(json), 2LL * INT32_MAX + (COUNT + 3) * (COUNT + 2) / 2 - (COUNT + 3) * (COUNT / 2));
+    TEST_EXPECT(json->min(json), -COUNT / 2);
+    TEST_EXPECT(json->max(json), INT32_MAX);
+    TEST_EXPECT(json->count_if(json, is_even), (COUNT + 4) / 2);
+    json->del(json, -1);
+    json->del(json, -1);
+    TEST_EXPECT(json->mean(json), (COUNT + 2) / 2 - COUNT / 2);
+
+    /* the same over nodes, other values skipped */
+    json->add_str(json, 0, "str");
+    json->add_null(json, -1);
+    TEST_EXPECT(json->sum(json), (COUNT + 3) * (COUNT + 2) / 2 - (COUNT + 3) * (COUNT / 2));
+    TEST_EXPECT(json->min(json), -COUNT / 2);
+    TEST_EXPECT(json->max(json), COUNT / 2 + 2);
+    TEST_EXPECT(json->count_if(json, is_even), (COUNT + 4) / 2);
+    TEST_EXPECT(json->mean(json), (COUNT + 2) / 2 - COUNT / 2);
+
+    /* booleans are not numbers */
+    FREE_JSON(json);
+    json = JSON_ARRAY_PTR();
+    json->add_true(json, -1);
+    TEST_EXPECT(json->sum(json), 0);
+    TEST_EXPECT(json->max(json), 0);
+    TEST_EXPECT(json->count_if(json, is_even), 0);
+
+    FREE_JSON(json);
+}
+
+/* only for test */
+static int is_null_row(const JSONColumn* col, int row)
+{
+    return (col->nulls[row / 8] >> (row % 8)) & 1;
+}
+
+void test_json_array_columnize(void)
+{
+    int i;
+    const char* keys[4] = { "id", "name", "ok", "none" };
+    JSONColumns* cols;
+    JSONArray* json = JSON_ARRAY_PTR();
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONObject view = JSON_OBJECT_DATA(NULL);
+
+    for (i = 0; i < COUNT; i++) {
+        json_obj->set_num(json_obj, "id", i);
+        json_obj->set_str(json_obj, "name", i % 2 ? "odd" : "even");
+        if (i % 3) {
+            json_obj->set_true(json_obj, "ok");
+        } else {
+            json_obj->set_false(json_obj, "ok");
+        }
+        json->add(json, -1, json_obj);
+    }
+    /* rows without a value of the type of the column */
+    json->set_num(json, 1, 7);
+    json_obj->set_str(json_obj, "id", "str");
+    json_obj->set_null(json_obj, "name");
+    json->set(json, 2, json_obj);
+
+    cols = json->columnize(json, keys, 4);
+    TEST_EXPECT(cols->rows, COUNT);
+    TEST_EXPECT(cols->ncols, 4);
+    TEST_EXPECT(cols->cols[0].key, JSON_KEY("id"));
+    FREE_JSON_KEY(cols->cols[0].key);
+
+    TEST_EXPECT(cols->cols[0].type, JSON_TYPE_NUMBER);
+    TEST_EXPECT(cols->cols[0].nums[COUNT - 1], COUNT - 1);
+    TEST_EXPECT(is_null_row(&cols->cols[0], 0), 0);
+    TEST_EXPECT(is_null_row(&cols->cols[0], 1), 1);
+    TEST_EXPECT(is_null_row(&cols->cols[0], 2), 1);
+
+    TEST_EXPECT(cols->cols[1].type, JSON_TYPE_STRING);
+    TEST_EXPECT(strcmp(cols->cols[1].strs[3], "odd"), 0);
+    json->get_ref(json, 3, &view);
+    TEST_EXPECT(cols->cols[1].strs[3], view.get_str_ref(&view, "name"));
+    TEST_EXPECT(is_null_row(&cols->cols[1], 2), 1);
+
+    TEST_EXPECT(cols->cols[2].type, JSON_TYPE_TRUE);
+    TEST_EXPECT(cols->cols[2].nums[3], 0);
+    TEST_EXPECT(cols->cols[2].nums[4], 1);
+    TEST_EXPECT(is_null_row(&cols->cols[2], 4), 0);
+
+    TEST_EXPECT(cols->cols[3].type, 0);
+    TEST_EXPECT(is_null_row(&cols->cols[3], COUNT - 1), 1);
+    FREE_JSON_COLUMNS(cols);
+
+    FREE_JSON(json_obj);
+    FREE_JSON(json);
+}
+
+void test_json_array_sort(void)
+{
+    int i, k, id, n = 20000;
+    JSONArray* json = JSON_ARRAY_PTR();
+    JSONArray* json_sub = JSON_ARRAY_PTR();
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONObject* json_inner = JSON_OBJECT_PTR();
+    JSONObject view = JSON_OBJECT_DATA(NULL);
+    JSONObject inner = JSON_OBJECT_DATA(NULL);
+
+    /* items of mixed types keep their types */
+    json->add_num(json, -1, 3);
+    json->add_str(json, -1, "b");
+    json->add_true(json, -1);
+    json->add_null(json, -1);
+    json->add_num(json, -1, -1);
+    json->add_str(json, -1, "a");
+    json->add(json, -1, json_obj);
+    json->add_false(json, -1);
+    json->sort_by(json, NULL, 0);
+    TEST_EXPECT(json->get_num(json, 0), -1);
+    TEST_EXPECT(json->get_num(json, 1), 3);
+    TEST_EXPECT(strcmp(json->get_str_ref(json, 2), "a"), 0);
+    TEST_EXPECT(strcmp(json->get_str_ref(json, 3), "b"), 0);
+    TEST_EXPECT(json->get_type(json, 4), JSON_TYPE_FALSE);
+    TEST_EXPECT(json->get_type(json, 5), JSON_TYPE_TRUE);
+    TEST_EXPECT(json->get_type(json, 6), JSON_TYPE_NULL);
+    TEST_EXPECT(json->get_type(json, 7), JSON_TYPE_OBJECT);
+    FREE_JSON(json);
+
+    /* sorted and reversed input, strings */
+    json = JSON_ARRAY_PTR();
+    for (i = 0; i < n; i++) {
+        json->add_num(json, -1, i);
+        json_sub->add_str(json_sub, 0, i % 2 ? "odd" : "even");
+    }
+    json->sort(json, json_cmp_num);
+    json->sort_with(json, json_cmp_num, JSON_SORT_STABLE);
+    TEST_EXPECT(json->get_num(json, n - 1), n - 1);
+    json->set_num(json, 0, n);
+    json->sort(json, json_cmp_num);
+    TEST_EXPECT(json->get_num(json, 0), 1);
+    TEST_EXPECT(json->get_num(json, -1), n);
+    json_sub->sort(json_sub, json_cmp_str);
+    TEST_EXPECT(strcmp(json_sub->get_str_ref(json_sub, n / 2 - 1), "even"), 0);
+    TEST_EXPECT(strcmp(json_sub->get_str_ref(json_sub, n / 2), "odd"), 0);
+    FREE_JSON(json);
+
+    /* stable by a key path, in threads */
+    json = JSON_ARRAY_PTR();
+    for (i = 0; i < n; i++) {
+        json_inner->set_num(json_inner, "k", (i * 7919) % 10);
+        json_obj->set(json_obj, "a", json_inner);
+        json_obj->set_num(json_obj, "i", i);
+        json->add(json, -1, json_obj);
+    }
+    json->add_num(json, n / 2, 0);
+    json->sort_by(json, "a.k", JSON_SORT_STABLE | JSON_SORT_PARALLEL);
+    TEST_EXPECT(json->get_type(json, n), JSON_TYPE_NUMBER);
+    for (i = 0, k = -1, id = -1; i < n; i++) {
+        view.data = NULL;
+        inner.data = NULL;
+        json->get_ref(json, i, &view);
+        view.get_ref(&view, "a", &inner);
+        TEST_EXPECT((inner.get_num(&inner, "k") > k ||
+            (inner.get_num(&inner, "k") == k && view.get_num(&view, "i") > id)), 1);
+        k = inner.get_num(&inner, "k");
+        id = view.get_num(&view, "i");
+    }
+
+    FREE_JSON(json);
+    FREE_JSON(json_sub);
+    FREE_JSON(json_obj);
+    FREE_JSON(json_inner);
+}
+
+/* only for test, build a array of numbers and objects */
+static void *build_json_array(void *arg)
+{
+    int i;
+    JSONArray* json = JSON_ARRAY_PTR();
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    for (i = 0; i < COUNT; i++) {
+        json_obj->set_num(json_obj, "id", i);
+        json->add_num(json, -1, i);
+        json->add(json, -1, json_obj);
+    }
+    FREE_JSON(json_obj);
+    return json;
+}
+
+void test_json_array_threads(void)
+{
+    int i, j;
+    pthread_t threads[4];
+    JSONArray* json[4];
+    JSONObject json_obj = JSON_OBJECT_DATA(NULL);
+
+    /* built by other threads, checked and freed by this one */
+    for (j = 0; j < 4; j++) {
+        pthread_create(&threads[j], NULL, build_json_array, NULL);
+    }
+    for (j = 0; j < 4; j++) {
+        pthread_join(threads[j], (void **)&json[j]);
+        TEST_EXPECT(get_json_array_list_size(json[j]), 2 * COUNT);
+        for (i = 0; i < COUNT; i += 100) {
+            TEST_EXPECT(json[j]->get_num(json[j], 2 * i), i);
+            json_obj.data = NULL;
+            json[j]->get_ref(json[j], 2 * i + 1, &json_obj);
+            TEST_EXPECT(json_obj.get_num(&json_obj, "id"), i);
+        }
+        FREE_JSON(json[j]);
+    }
+}
+
 void test_json_array_traverse_all_elements(void)
 {
     JSONArrayIter iter, end;
@@ -1079,6 +1509,15 @@ int main(int argc, char* argv[])
     test_json_array_add_json_array();
     test_json_array_delete_json();
     test_json_array_quick_sort();
+    test_json_array_sort();
+    test_json_array_reserve();
+    test_json_array_get_ref();
+    test_json_array_move();
+    test_json_array_copy_on_write();
+    test_json_array_packed();
+    test_json_array_aggregate();
+    test_json_array_columnize();
+    test_json_array_threads();
     test_json_array_traverse_all_elements();
     test_json_array_stringify();
     test_parse_json_array();
@@ -25,8 +25,12 @@ typedef struct jsong_htab
 {
     jsong_entry* entries;
     uint64_t capacity, size, first, last;
+    uint64_t seed, max_probe;
 } jsong_htab;
 
+/* only for test, the key hash of the library */
+uint64_t key_hash_str(const char *str, size_t len);
+
 /* only for test */
 jsong_node* get_json_array_list_head(JSONArray *arr)
 {
@@ -51,6 +55,18 @@ int get_json_object_htab_size(JSONObject* obj)
     return ((jsong_htab*)(obj->data))->size;
 }
 
+/* only for test */
+int get_json_object_htab_max_probe(JSONObject* obj)
+{
+    return ((jsong_htab*)(obj->data))->max_probe;
+}
+
+/* only for test */
+int get_json_object_htab_capacity(JSONObject* obj)
+{
+    return ((jsong_htab*)(obj->data))->capacity;
+}
+
 /* only for test */
 int get_json_type(JSON *json)
 {
@@ -926,6 +942,1079 @@ void test_json_object_delete_json(void)
     FREE_JSON(sub_json_obj_get);
 }
 
+void test_json_object_delete_in_clusters(void)
+{
+    int i, n;
+    char key[32];
+    JSONObjectIter iter, end;
+
+    /* create a json object */
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    /* add many keys, so that some of them share probe clusters */
+    for (i = 0; i < 1000; i++) {
+        sprintf(key, "key%d", i);
+        json_obj->add_num(json_obj, key, i);
+    }
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 1000);
+
+    /* delete every element at an odd position */
+    for (i = 1; i < 1000; i += 2) {
+        sprintf(key, "key%d", i);
+        json_obj->del(json_obj, key);
+    }
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 500);
+
+    /* every remaining element is still reachable */
+    for (i = 0; i < 1000; i += 2) {
+        sprintf(key, "key%d", i);
+        TEST_EXPECT(json_obj->get_num(json_obj, key), i);
+    }
+
+    /* traverse in insertion order */
+    iter = json_obj->begin(json_obj);
+    end = json_obj->end(json_obj);
+    n = 0;
+    JSON_OBJECT_FOREACH(iter, end)
+    {
+        TEST_EXPECT(*(int*)iter.value.data, n);
+        n += 2;
+    }
+    TEST_EXPECT(n, 1000);
+
+    /* delete the rest */
+    for (i = 0; i < 1000; i += 2) {
+        sprintf(key, "key%d", i);
+        json_obj->del(json_obj, key);
+    }
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 0);
+    iter = json_obj->begin(json_obj);
+    end = json_obj->end(json_obj);
+    TEST_EXPECT(iter.index, end.index);
+
+    FREE_JSON(json_obj);
+}
+
+void test_json_object_small_to_hashed(void)
+{
+    int i;
+    char key[32];
+    JSONObjectIter iter, end;
+
+    /* create a json object */
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    /* a few keys fit into the inline entries */
+    for (i = 0; i < 8; i++) {
+        sprintf(key, "key%d", i);
+        json_obj->add_num(json_obj, key, i);
+    }
+    TEST_EXPECT(get_json_object_htab_capacity(json_obj), 8);
+
+    /* delete in the middle, order is kept */
+    json_obj->del(json_obj, "key3");
+    json_obj->add_num(json_obj, "key3", 3);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 8);
+    TEST_EXPECT(get_json_object_htab_capacity(json_obj), 8);
+
+    /* one more key promotes it to a hash table */
+    json_obj->add_num(json_obj, "key8", 8);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 9);
+    TEST_EXPECT((get_json_object_htab_capacity(json_obj) > 8), 1);
+    for (i = 0; i < 9; i++) {
+        sprintf(key, "key%d", i);
+        TEST_EXPECT(json_obj->get_num(json_obj, key), i);
+    }
+
+    /* traverse in insertion order */
+    iter = json_obj->begin(json_obj);
+    end = json_obj->end(json_obj);
+    i = 0;
+    JSON_OBJECT_FOREACH(iter, end)
+    {
+        sprintf(key, "key%d", i < 3 ? i : (i < 7 ? i + 1 : (i == 7 ? 3 : 8)));
+        TEST_EXPECT(strcmp(iter.key, key), 0);
+        i++;
+    }
+    TEST_EXPECT(i, 9);
+
+    FREE_JSON(json_obj);
+}
+
+void test_json_object_reserve(void)
+{
+    int i, capacity;
+    char key[32];
+
+    /* create a json object */
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    /* presize, then add keys without growing */
+    json_obj->reserve(json_obj, 100);
+    capacity = get_json_object_htab_capacity(json_obj);
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "key%d", i);
+        json_obj->add_num(json_obj, key, i);
+    }
+    TEST_EXPECT(get_json_object_htab_capacity(json_obj), capacity);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 100);
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "key%d", i);
+        TEST_EXPECT(json_obj->get_num(json_obj, key), i);
+    }
+
+    /* reserve never shrinks */
+    json_obj->reserve(json_obj, 1);
+    TEST_EXPECT(get_json_object_htab_capacity(json_obj), capacity);
+
+    FREE_JSON(json_obj);
+}
+
+void test_json_object_shrink(void)
+{
+    int i, capacity;
+    char key[32];
+    JSONObjectIter iter, end;
+    JSONMemoryStats st, st2;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONObject* json_sub = JSON_OBJECT_PTR();
+    JSONArray* json_arr = JSON_ARRAY_PTR();
+
+    for (i = 0; i < 1000; i++) {
+        sprintf(key, "key%d", i);
+        json_obj->add_num(json_obj, key, i);
+    }
+    capacity = get_json_object_htab_capacity(json_obj);
+
+    /* deletes shrink it once it is 1/8 full, keeping order */
+    for (i = 0; i < 900; i++) {
+        sprintf(key, "key%d", i);
+        json_obj->del(json_obj, key);
+    }
+    TEST_EXPECT((get_json_object_htab_capacity(json_obj) < capacity), 1);
+    iter = json_obj->begin(json_obj);
+    end = json_obj->end(json_obj);
+    i = 900;
+    JSON_OBJECT_FOREACH(iter, end) {
+        sprintf(key, "key%d", i);
+        TEST_EXPECT(strcmp(iter.key, key), 0);
+        TEST_EXPECT(json_obj->get_num(json_obj, key), i);
+        i++;
+    }
+    TEST_EXPECT(i, 1000);
+
+    /* and back to a small table */
+    for (i = 900; i < 997; i++) {
+        sprintf(key, "key%d", i);
+        json_obj->del(json_obj, key);
+    }
+    TEST_EXPECT(get_json_object_htab_capacity(json_obj), 8);
+    TEST_EXPECT(json_obj->get_num(json_obj, "key998"), 998);
+    json_obj->add_num(json_obj, "key0", 0);
+    iter = json_obj->begin(json_obj);
+    TEST_EXPECT(strcmp(iter.key, "key997"), 0);
+
+    /* shrink_to_fit gives back what reserve took */
+    json_obj->reserve(json_obj, 1000);
+    capacity = get_json_object_htab_capacity(json_obj);
+    json_obj->shrink_to_fit(json_obj);
+    TEST_EXPECT((get_json_object_htab_capacity(json_obj) < capacity), 1);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 4);
+    TEST_EXPECT(json_obj->get_num(json_obj, "key0"), 0);
+
+    /* compact a whole document */
+    json_arr->add_null(json_arr, -1);
+    json_arr->reserve(json_arr, 100);
+    json_sub->reserve(json_sub, 100);
+    json_sub->add_move(json_sub, "arr", json_arr);
+    json_obj->add_move(json_obj, "sub", json_sub);
+    JSON_MEMORY_USAGE(json_obj, &st);
+    TEST_EXPECT(JSON_COMPACT(json_obj), 0);
+    JSON_MEMORY_USAGE(json_obj, &st2);
+    TEST_EXPECT((st2.nodes < st.nodes), 1);
+    TEST_EXPECT((st2.entries < st.entries), 1);
+
+    FREE_JSON(json_arr);
+    FREE_JSON(json_sub);
+    FREE_JSON(json_obj);
+}
+
+void test_parse_json_object_of_same_shape(void)
+{
+    int i;
+    char key[32];
+    char* str =
+    "[{\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,"
+    "\"k6\":6,\"k7\":7,\"k8\":8,\"k9\":9,\"k10\":10,\"k11\":11},"
+    "{\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,"
+    "\"k6\":6,\"k7\":7,\"k8\":8,\"k9\":9,\"k10\":10,\"k11\":11},"
+    "{\"k0\":0}]";
+    JSONArray* json_arr = JSON_ARRAY_PTR();
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    TEST_EXPECT(json_parse(str, json_arr), 0);
+    TEST_EXPECT(get_json_array_list_size(json_arr), 3);
+
+    /* the second record is presized from the first one */
+    json_obj = json_arr->get(json_arr, 1, json_obj);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 12);
+    for (i = 0; i < 12; i++) {
+        sprintf(key, "k%d", i);
+        TEST_EXPECT(json_obj->get_num(json_obj, key), i);
+    }
+
+    json_obj = json_arr->get(json_arr, 2, json_obj);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 1);
+    TEST_EXPECT(json_obj->get_num(json_obj, "k0"), 0);
+
+    FREE_JSON(json_arr);
+    FREE_JSON(json_obj);
+}
+
+void test_parse_json_object_after_wide(void)
+{
+    int i, n = 0;
+    char* str = malloc(200000 * 16);
+    JSONMemoryStats st, st2;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONObject* json_small = JSON_OBJECT_PTR();
+
+    n += sprintf(str + n, "{");
+    for (i = 0; i < 200000; i++) {
+        n += sprintf(str + n, "%s\"k%d\":%d", i ? "," : "", i, i);
+    }
+    sprintf(str + n, "}");
+    TEST_EXPECT(json_parse(str, json_obj), 0);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 200000);
+
+    /* a wide object does not presize the small ones after it */
+    TEST_EXPECT(json_parse("{\"a\":{\"x\":1}}", json_small), 0);
+    JSON_MEMORY_USAGE(json_small, &st);
+    TEST_EXPECT((st.total < 8192), 1);
+    TEST_EXPECT(json_parse("{\"a\":{\"x\":1}}", json_small), 0);
+    JSON_MEMORY_USAGE(json_small, &st2);
+    TEST_EXPECT((st2.total <= st.total), 1);
+
+    free(str);
+    FREE_JSON(json_obj);
+    FREE_JSON(json_small);
+}
+
+void test_json_object_shared_keys(void)
+{
+    char *key;
+    JSONObjectIter iter, end;
+    char* str = "[{\"id\":1,\"name\":\"a\"},{\"id\":2,\"name\":\"b\"}]";
+    JSONArray* json_arr = JSON_ARRAY_PTR();
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONObject* json_obj_copy;
+
+    TEST_EXPECT(json_parse(str, json_arr), 0);
+
+    /* records of the same shape store each key once */
+    json_obj = json_arr->get(json_arr, 0, json_obj);
+    iter = json_obj->begin(json_obj);
+    key = iter.key;
+    json_obj = json_arr->get(json_arr, 1, json_obj);
+    iter = json_obj->begin(json_obj);
+    TEST_EXPECT(iter.key, key);
+    TEST_EXPECT(strcmp(iter.key, "id"), 0);
+
+    /* a copy shares its keys too */
+    json_obj_copy = JSON_OBJECT_COPY_PTR(json_obj);
+    iter = json_obj->begin(json_obj);
+    end = json_obj_copy->begin(json_obj_copy);
+    TEST_EXPECT(iter.key, end.key);
+
+    /* keys outlive the document they were parsed from */
+    FREE_JSON(json_arr);
+    FREE_JSON(json_obj);
+    TEST_EXPECT(json_obj_copy->get_num(json_obj_copy, "id"), 2);
+    json_obj_copy->del(json_obj_copy, "name");
+    TEST_EXPECT(get_json_object_htab_size(json_obj_copy), 1);
+
+    FREE_JSON(json_obj_copy);
+}
+
+void test_json_object_key_handle(void)
+{
+    int i;
+    char key[32];
+    JSONObjectIter iter;
+    JSONKey k_id = JSON_KEY("id");
+    JSONKey k_name = JSON_KEY("name");
+    JSONKey k_tag = JSON_KEY("tag");
+    JSONString* json_str = JSON_STRING_PTR("tagged");
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    /* set by handle in a small table */
+    json_obj->set_num_k(json_obj, k_id, 1);
+    json_obj->set_str_k(json_obj, k_name, "a");
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 2);
+    TEST_EXPECT(json_obj->get_num(json_obj, "id"), 1);
+    TEST_EXPECT(strcmp(json_obj->get_str_ref_k(json_obj, k_name), "a"), 0);
+    iter = json_obj->begin(json_obj);
+    TEST_EXPECT(iter.key, k_id);
+
+    /* get by handle in a hashed table */
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "k%d", i);
+        json_obj->add_num(json_obj, key, i);
+    }
+    TEST_EXPECT(json_obj->get_num_k(json_obj, k_id), 1);
+    json_obj->set_num_k(json_obj, k_id, 2);
+    TEST_EXPECT(json_obj->get_num_k(json_obj, k_id), 2);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 102);
+
+    /* set a value by handle, inserted then replaced by a copy */
+    json_obj->set_k(json_obj, k_tag, json_str);
+    json_str->set(json_str, "retagged");
+    TEST_EXPECT(strcmp(json_obj->get_str_ref_k(json_obj, k_tag), "tagged"), 0);
+    json_obj->set_k(json_obj, k_tag, json_str);
+    TEST_EXPECT(strcmp(json_obj->get_str_ref_k(json_obj, k_tag), "retagged"), 0);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 103);
+    json_obj->del_k(json_obj, k_tag);
+
+    /* delete by handle, the handle stays valid */
+    json_obj->del_k(json_obj, k_id);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 101);
+    FREE_JSON(json_obj);
+    TEST_EXPECT(strcmp(k_id, "id"), 0);
+
+    /* the copy is freed when a frozen object refuses it */
+    json_obj = JSON_OBJECT_PTR();
+    JSON_FREEZE(json_obj);
+    json_obj->set_k(json_obj, k_tag, json_str);
+    TEST_EXPECT(json_obj->get_type(json_obj, "tag"), 0);
+    FREE_JSON(json_obj);
+
+    FREE_JSON(json_str);
+    FREE_JSON_KEY(k_id);
+    FREE_JSON_KEY(k_name);
+    FREE_JSON_KEY(k_tag);
+}
+
+void test_json_object_key_lengths(void)
+{
+    int i;
+    char key[128];
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    /* keys of every length up to 2 blocks of the hash, "" included */
+    for (i = 0; i < 100; i++) {
+        memset(key, 'k', i);
+        key[i] = '\0';
+        json_obj->add_num(json_obj, key, i);
+    }
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 100);
+    for (i = 0; i < 100; i++) {
+        memset(key, 'k', i);
+        key[i] = '\0';
+        TEST_EXPECT(json_obj->get_num(json_obj, key), i);
+    }
+
+    /* keys that differ only in the last byte */
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "https://example.com/a/long/path/that/passes/48/bytes/%c", 'A' + i % 50);
+        json_obj->set_num(json_obj, key, i);
+    }
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 150);
+    TEST_EXPECT(json_obj->get_num(json_obj, "https://example.com/a/long/path/that/passes/48/bytes/A"), 50);
+
+    FREE_JSON(json_obj);
+}
+
+void test_json_object_hash_flooding(void)
+{
+    int i, n;
+    char key[32];
+    JSONKey k;
+    unsigned long reseeds = JSON_RESEED_COUNT();
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    /* keys with the same home slot in 1024 slots, as a flooder would send */
+    json_obj->reserve(json_obj, 400);
+    TEST_EXPECT(get_json_object_htab_capacity(json_obj), 1024);
+    for (i = 0, n = 0; n < 300; i++) {
+        sprintf(key, "flood%d", i);
+        if ((key_hash_str(key, strlen(key)) & 1023) == 7) {
+            json_obj->add_num(json_obj, key, i);
+            n++;
+        }
+    }
+
+    /* the table rehashed itself, probes stay short */
+    TEST_EXPECT((JSON_RESEED_COUNT() > reseeds), 1);
+    TEST_EXPECT(get_json_object_htab_capacity(json_obj), 1024);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 300);
+    TEST_EXPECT((get_json_object_htab_max_probe(json_obj) < 128), 1);
+    k = JSON_KEY("flood0");
+    json_obj->set_num_k(json_obj, k, -1);
+    TEST_EXPECT(json_obj->get_num(json_obj, "flood0"), -1);
+    json_obj->del_k(json_obj, k);
+    FREE_JSON_KEY(k);
+    for (i--; n > 0; i--) {
+        sprintf(key, "flood%d", i);
+        if ((key_hash_str(key, strlen(key)) & 1023) == 7) {
+            TEST_EXPECT(json_obj->get_num(json_obj, key), i);
+            json_obj->del(json_obj, key);
+            n--;
+        }
+    }
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 0);
+
+    FREE_JSON(json_obj);
+}
+
+void test_json_object_get_type(void)
+{
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    json_obj->add_true(json_obj, "t");
+    json_obj->add_false(json_obj, "f");
+    json_obj->add_null(json_obj, "n");
+    json_obj->add_num(json_obj, "num", 3);
+
+    TEST_EXPECT(json_obj->get_type(json_obj, "t"), JSON_TYPE_TRUE);
+    TEST_EXPECT(json_obj->get_type(json_obj, "f"), JSON_TYPE_FALSE);
+    TEST_EXPECT(json_obj->get_type(json_obj, "n"), JSON_TYPE_NULL);
+    TEST_EXPECT(json_obj->get_type(json_obj, "num"), JSON_TYPE_NUMBER);
+    TEST_EXPECT(json_obj->get_type(json_obj, "none"), 0);
+    TEST_EXPECT(json_obj->get_num(json_obj, "num"), 3);
+
+    FREE_JSON(json_obj);
+}
+
+void test_json_object_move(void)
+{
+    void *data;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONObject* json_sub = JSON_OBJECT_PTR();
+    JSONString* json_str = JSON_STRING_PTR("moved");
+
+    /* the object takes the data, the source is left empty */
+    json_sub->add_num(json_sub, "id", 1);
+    data = json_sub->data;
+    json_obj->add_move(json_obj, "sub", json_sub);
+    TEST_EXPECT(json_sub->data, NULL);
+    json_obj->get_ref(json_obj, "sub", json_sub);
+    TEST_EXPECT(json_sub->data, data);
+    json_sub->data = NULL;
+
+    /* a existing key is not taken */
+    json_obj->add_move(json_obj, "str", json_str);
+    TEST_EXPECT(json_str->data, NULL);
+    json_str->set(json_str, "twice");
+    json_obj->add_move(json_obj, "str", json_str);
+    TEST_EXPECT(strcmp(json_str->data, "twice"), 0);
+
+    /* set replaces the old value */
+    json_obj->set_move(json_obj, "str", json_str);
+    TEST_EXPECT(json_str->data, NULL);
+    TEST_EXPECT(strcmp(json_obj->get_str_ref(json_obj, "str"), "twice"), 0);
+
+    /* empty sources can be freed */
+    FREE_JSON(json_sub);
+    FREE_JSON(json_str);
+    FREE_JSON(json_obj);
+}
+
+void test_json_object_copy_on_write(void)
+{
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONObject* json_sub = JSON_OBJECT_PTR();
+    JSONObject* json_copy;
+    JSONObject view_obj = JSON_OBJECT_DATA(NULL);
+    JSONObject view_copy = JSON_OBJECT_DATA(NULL);
+
+    json_sub->add_num(json_sub, "id", 1);
+    json_obj->add(json_obj, "sub", json_sub);
+    json_obj->add_num(json_obj, "n", 1);
+
+    /* a copy shares all data */
+    json_copy = JSON_OBJECT_COPY_PTR(json_obj);
+    TEST_EXPECT(json_copy->data, json_obj->data);
+
+    /* modifying the copy clones its top level only */
+    json_copy->set_num(json_copy, "n", 2);
+    TEST_EXPECT((json_copy->data != json_obj->data), 1);
+    TEST_EXPECT(json_obj->get_num(json_obj, "n"), 1);
+    TEST_EXPECT(json_copy->get_num(json_copy, "n"), 2);
+    json_obj->get_ref(json_obj, "sub", &view_obj);
+    json_copy->get_ref(json_copy, "sub", &view_copy);
+    TEST_EXPECT(view_obj.data, view_copy.data);
+
+    /* a nested copy is cloned when it is modified */
+    json_sub = json_copy->get(json_copy, "sub", json_sub);
+    json_sub->set_num(json_sub, "id", 2);
+    json_copy->set(json_copy, "sub", json_sub);
+    view_copy.data = NULL; /* borrowed, must not be freed by get_ref */
+    json_copy->get_ref(json_copy, "sub", &view_copy);
+    TEST_EXPECT((view_obj.data != view_copy.data), 1);
+    TEST_EXPECT(view_obj.get_num(&view_obj, "id"), 1);
+    TEST_EXPECT(view_copy.get_num(&view_copy, "id"), 2);
+
+    /* a object added to itself is a snapshot */
+    json_obj->add(json_obj, "self", json_obj);
+    view_obj.data = NULL;
+    json_obj->get_ref(json_obj, "self", &view_obj);
+    TEST_EXPECT(view_obj.get_num(&view_obj, "n"), 1);
+    TEST_EXPECT(view_obj.get_type(&view_obj, "self"), 0);
+
+    FREE_JSON(json_sub);
+    FREE_JSON(json_copy);
+    FREE_JSON(json_obj);
+}
+
+void test_json_object_handle(void)
+{
+    int len;
+    char* str = NULL;
+    JSONObjectIter iter, end;
+    JSON json_obj = JSON_OBJECT_HANDLE();
+    JSON json_arr = JSON_ARRAY_HANDLE();
+    JSON json_str = JSON_STRING_HANDLE("this is a string");
+    JSON json_num = JSON_NUMBER_HANDLE(2022);
+    JSON json_null = JSON_NULL_HANDLE();
+    JSON json_copy, json_val = { NULL, JSON_TYPE_ARRAY };
+
+    TEST_EXPECT((sizeof(JSON) * 8 < sizeof(JSONObject)), 1);
+    TEST_EXPECT(json_type(&json_obj), JSON_TYPE_OBJECT);
+
+    json_arr_add_num(&json_arr, -1, 1);
+    json_arr_add_true(&json_arr, -1);
+    json_obj_add(&json_obj, "string", &json_str);
+    json_obj_add(&json_obj, "number", &json_num);
+    json_obj_add(&json_obj, "null", &json_null);
+    json_obj_add_move(&json_obj, "array", &json_arr);
+    TEST_EXPECT(json_arr.data, NULL);
+
+    TEST_EXPECT(strcmp(json_obj_get_str_ref(&json_obj, "string"), "this is a string"), 0);
+    TEST_EXPECT(json_obj_get_num(&json_obj, "number"), 2022);
+    TEST_EXPECT(json_obj_get_type(&json_obj, "array"), JSON_TYPE_ARRAY);
+    json_obj_get_ref(&json_obj, "array", &json_val);
+    TEST_EXPECT(json_arr_get_num(&json_val, 0), 1);
+
+    /* handles and classes mix */
+    json_num_set(&json_num, 2023);
+    TEST_EXPECT(json_num_get(&json_num), 2023);
+    json_obj_set(&json_obj, "number", &json_num);
+
+    JSON_STRINGIFY(&json_obj, &str, &len);
+    TEST_EXPECT(strcmp(str, "{\"string\":\"this is a string\",\"number\":2023,"
+        "\"null\":null,\"array\":[1,true]}"), 0);
+    free(str);
+
+    /* copies share until modified */
+    json_copy = JSON_HANDLE_COPY(&json_obj);
+    json_obj_del(&json_copy, "string");
+    TEST_EXPECT(json_obj_get_type(&json_obj, "string"), JSON_TYPE_STRING);
+    TEST_EXPECT(json_obj_get_type(&json_copy, "string"), 0);
+
+    len = 0;
+    iter = json_obj_begin(&json_copy);
+    end = json_obj_end(&json_copy);
+    JSON_OBJECT_FOREACH(iter, end) {
+        len++;
+    }
+    TEST_EXPECT(len, 3);
+
+    FREE_JSON_DATA(&json_copy);
+    FREE_JSON_DATA(&json_obj);
+    FREE_JSON_DATA(&json_arr);
+    FREE_JSON_DATA(&json_str);
+    FREE_JSON_DATA(&json_num);
+    FREE_JSON_DATA(&json_null);
+}
+
+void test_json_object_get_many(void)
+{
+    int i;
+    char key[40][32];
+    const char* keys[40];
+    JSON vals[40];
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+
+    for (i = 0; i < 40; i++) {
+        sprintf(key[i], "key%d", i);
+        keys[i] = key[i];
+    }
+
+    /* small table, a missing key in the middle */
+    json_obj->add_num(json_obj, "key0", 0);
+    json_obj->add_str(json_obj, "key2", "two");
+    TEST_EXPECT(json_obj->get_many(json_obj, keys, 3, vals), 2);
+    TEST_EXPECT(*(int *)vals[0].data, 0);
+    TEST_EXPECT(vals[1].data, NULL);
+    TEST_EXPECT(vals[1].type, 0);
+    TEST_EXPECT(vals[2].type, JSON_TYPE_STRING);
+    TEST_EXPECT(strcmp(vals[2].data, "two"), 0);
+    TEST_EXPECT(json_obj->get_many(json_obj, keys, 0, NULL), 0);
+
+    /* hashed table, more keys than one batch, borrowed values */
+    json_obj->del(json_obj, "key2");
+    for (i = 1; i < 30; i++) {
+        json_obj->add_num(json_obj, key[i], i);
+    }
+    TEST_EXPECT(json_obj->get_many(json_obj, keys, 40, vals), 30);
+    for (i = 0; i < 40; i++) {
+        TEST_EXPECT(vals[i].type, (i < 30 ? JSON_TYPE_NUMBER : 0));
+        if (i < 30) {
+            TEST_EXPECT(*(int *)vals[i].data, i);
+        }
+    }
+    vals[39].type = JSON_TYPE_NUMBER;
+    json_obj->get_ref(json_obj, "key7", &vals[39]);
+    TEST_EXPECT(vals[39].data, vals[7].data);
+
+    /* frozen table */
+    TEST_EXPECT(JSON_FREEZE(json_obj), 0);
+    TEST_EXPECT(json_obj_get_many((JSON *)json_obj, keys + 20, 20, vals), 10);
+    TEST_EXPECT(*(int *)vals[9].data, 29);
+    TEST_EXPECT(vals[10].data, NULL);
+
+    FREE_JSON(json_obj);
+}
+
+void test_json_object_pointer(void)
+{
+    JSONPointer* ptr;
+    JSON val;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONObject view = JSON_OBJECT_DATA(NULL);
+    JSONObject view2 = JSON_OBJECT_DATA(NULL);
+    const char* str = "{\"a\":{\"b\":[{\"c\":5},\"x\",[1,2]],\"0\":true},"
+        "\"m~n\":1,\"a/b\":2,\"\":3}";
+
+    TEST_EXPECT(JSON_PARSE(str, json_obj), 0);
+
+    /* a borrowed value, shared with the document */
+    ptr = JSON_POINTER("/a/b/0/c");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), 0);
+    TEST_EXPECT(val.type, JSON_TYPE_NUMBER);
+    TEST_EXPECT(*(int *)val.data, 5);
+    FREE_JSON_POINTER(ptr);
+    ptr = JSON_POINTER("/a");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &view), 0);
+    json_obj->get_ref(json_obj, "a", &view2);
+    TEST_EXPECT(view.data, view2.data);
+    FREE_JSON_POINTER(ptr);
+
+    /* the whole document, packed arrays, keys that look like indexes */
+    ptr = JSON_POINTER("");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), 0);
+    TEST_EXPECT(val.data, json_obj->data);
+    FREE_JSON_POINTER(ptr);
+    ptr = JSON_POINTER("/a/b/2/1");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), 0);
+    TEST_EXPECT(*(int *)val.data, 2);
+    FREE_JSON_POINTER(ptr);
+    ptr = JSON_POINTER("/a/0");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), 0);
+    TEST_EXPECT(val.type, JSON_TYPE_TRUE);
+    FREE_JSON_POINTER(ptr);
+
+    /* escapes and the empty key */
+    ptr = JSON_POINTER("/m~0n");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), 0);
+    TEST_EXPECT(*(int *)val.data, 1);
+    FREE_JSON_POINTER(ptr);
+    ptr = JSON_POINTER("/a~1b");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), 0);
+    TEST_EXPECT(*(int *)val.data, 2);
+    FREE_JSON_POINTER(ptr);
+    ptr = JSON_POINTER("/");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), 0);
+    TEST_EXPECT(*(int *)val.data, 3);
+    FREE_JSON_POINTER(ptr);
+
+    /* nothing there */
+    ptr = JSON_POINTER("/a/b/3");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), -1);
+    FREE_JSON_POINTER(ptr);
+    ptr = JSON_POINTER("/a/b/-");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), -1);
+    FREE_JSON_POINTER(ptr);
+    ptr = JSON_POINTER("/a/b/01");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), -1);
+    FREE_JSON_POINTER(ptr);
+    ptr = JSON_POINTER("/m~0n/x");
+    TEST_EXPECT(JSON_POINTER_GET(json_obj, ptr, &val), -1);
+    FREE_JSON_POINTER(ptr);
+
+    /* malformed pointers */
+    TEST_EXPECT(JSON_POINTER("a/b"), NULL);
+    TEST_EXPECT(JSON_POINTER("/a/~2"), NULL);
+
+    FREE_JSON(json_obj);
+}
+
+void test_json_object_path(void)
+{
+    int i;
+    JSONPath* path;
+    JSON vals[8];
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    const char* str = "{\"items\":[{\"price\":10,\"status\":\"ok\",\"code\":200},"
+        "{\"price\":20,\"status\":\"error\",\"code\":500},"
+        "{\"price\":30,\"status\":\"error\",\"code\":404,\"id\":{\"id\":7}}],"
+        "\"nums\":[1,2,3],\"a b\":{\"id\":1}}";
+
+    TEST_EXPECT(JSON_PARSE(str, json_obj), 0);
+
+    /* keys, wildcards and indexes, values borrowed from the document */
+    path = JSON_PATH("$.items[*].price");
+    TEST_EXPECT(JSON_PATH_EVAL(json_obj, path, vals, 8), 3);
+    for (i = 0; i < 3; i++) {
+        TEST_EXPECT(*(int *)vals[i].data, 10 * (i + 1));
+    }
+    FREE_JSON_PATH(path);
+    path = JSON_PATH("$.nums[-1]");
+    TEST_EXPECT(JSON_PATH_EVAL(json_obj, path, vals, 8), 1);
+    TEST_EXPECT(*(int *)vals[0].data, 3);
+    FREE_JSON_PATH(path);
+    path = JSON_PATH("$['a b'].id");
+    TEST_EXPECT(JSON_PATH_EVAL(json_obj, path, vals, 8), 1);
+    TEST_EXPECT(*(int *)vals[0].data, 1);
+    FREE_JSON_PATH(path);
+    path = JSON_PATH("$");
+    TEST_EXPECT(JSON_PATH_EVAL(json_obj, path, vals, 8), 1);
+    TEST_EXPECT(vals[0].data, json_obj->data);
+    FREE_JSON_PATH(path);
+
+    /* filters */
+    path = JSON_PATH("$.items[?(@.status=='error')].price");
+    TEST_EXPECT(JSON_PATH_EVAL(json_obj, path, vals, 8), 2);
+    TEST_EXPECT(*(int *)vals[0].data, 20);
+    TEST_EXPECT(*(int *)vals[1].data, 30);
+    FREE_JSON_PATH(path);
+    path = JSON_PATH("$.items[?(@.status == 'error' && @.code >= 500 || @.price < 15)].code");
+    TEST_EXPECT(JSON_PATH_EVAL(json_obj, path, vals, 8), 2);
+    TEST_EXPECT(*(int *)vals[0].data, 200);
+    TEST_EXPECT(*(int *)vals[1].data, 500);
+    FREE_JSON_PATH(path);
+    path = JSON_PATH("$.items[?(@.id.id)]");
+    TEST_EXPECT(JSON_PATH_EVAL(json_obj, path, vals, 8), 1);
+    TEST_EXPECT(vals[0].type, JSON_TYPE_OBJECT);
+    FREE_JSON_PATH(path);
+    path = JSON_PATH("$.nums[?(@ > 1)]");
+    TEST_EXPECT(JSON_PATH_EVAL(json_obj, path, vals, 8), 2);
+    FREE_JSON_PATH(path);
+
+    /* recursive descent, more values than room for them */
+    path = JSON_PATH("$..id");
+    TEST_EXPECT(JSON_PATH_EVAL(json_obj, path, vals, 8), 3);
+    FREE_JSON_PATH(path);
+    path = JSON_PATH("$..*");
+    TEST_EXPECT(JSON_PATH_EVAL(json_obj, path, vals, 2), 21);
+    FREE_JSON_PATH(path);
+
+    /* malformed queries */
+    TEST_EXPECT(JSON_PATH("items"), NULL);
+    TEST_EXPECT(JSON_PATH("$.items[?(@.a == )]"), NULL);
+    TEST_EXPECT(JSON_PATH("$.items[0"), NULL);
+
+    FREE_JSON(json_obj);
+}
+
+typedef struct WalkTrace {
+    char buf[1024];
+    int max_depth;
+    int nscalars;
+    int stop_at; /* stop at the scalar of this number, 0: never */
+} WalkTrace;
+
+static void walk_trace_pos(WalkTrace* tr, const JSONWalkPos* pos)
+{
+    size_t n = strlen(tr->buf);
+
+    if (pos->key) {
+        snprintf(tr->buf + n, sizeof(tr->buf) - n, "%s=", pos->key);
+    } else if (pos->index >= 0) {
+        snprintf(tr->buf + n, sizeof(tr->buf) - n, "%d=", pos->index);
+    }
+    if (pos->depth > tr->max_depth) {
+        tr->max_depth = pos->depth;
+    }
+}
+
+static int walk_enter(const JSON* val, const JSONWalkPos* pos, void* ctx)
+{
+    WalkTrace* tr = ctx;
+
+    walk_trace_pos(tr, pos);
+    strcat(tr->buf, JSON_TYPE_OBJECT == val->type ? "{" : "[");
+    /* skip the children of "skip" */
+    return pos->key && 0 == strcmp(pos->key, "skip") ? JSON_WALK_SKIP : JSON_WALK_CONTINUE;
+}
+
+static int walk_leave(const JSON* val, const JSONWalkPos* pos, void* ctx)
+{
+    strcat(((WalkTrace*)ctx)->buf, JSON_TYPE_OBJECT == val->type ? "}" : "]");
+    return JSON_WALK_CONTINUE;
+}
+
+static int walk_scalar(const JSON* val, const JSONWalkPos* pos, void* ctx)
+{
+    WalkTrace* tr = ctx;
+    size_t n;
+
+    walk_trace_pos(tr, pos);
+    n = strlen(tr->buf);
+    if (JSON_TYPE_NUMBER == val->type) {
+        snprintf(tr->buf + n, sizeof(tr->buf) - n, "%d,", *(int *)val->data);
+    } else if (JSON_TYPE_STRING == val->type) {
+        snprintf(tr->buf + n, sizeof(tr->buf) - n, "'%s',", (char *)val->data);
+    } else {
+        snprintf(tr->buf + n, sizeof(tr->buf) - n, "%s,",
+            JSON_TYPE_TRUE == val->type ? "t" : JSON_TYPE_FALSE == val->type ? "f" : "n");
+    }
+    tr->nscalars++;
+    return tr->nscalars == tr->stop_at ? JSON_WALK_STOP : JSON_WALK_CONTINUE;
+}
+
+void test_json_object_walk(void)
+{
+    int i;
+    WalkTrace tr;
+    JSONVisitor visitor = { walk_enter, walk_leave, walk_scalar };
+    JSONVisitor scalars = { NULL, NULL, walk_scalar };
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONArray* json_arr = JSON_ARRAY_PTR();
+    JSONArray* json_sub;
+    JSONNumber* json_num = JSON_NUMBER_PTR(5);
+    const char* str = "{\"a\":[1,{\"b\":null},\"s\"],\"nums\":[1,2,3],"
+        "\"bools\":[true,false],\"skip\":{\"x\":1},\"e\":{}}";
+
+    TEST_EXPECT(JSON_PARSE(str, json_obj), 0);
+
+    /* document order, keys and indexes, packed arrays, a skipped object */
+    memset(&tr, 0, sizeof(tr));
+    TEST_EXPECT(JSON_WALK(json_obj, &visitor, &tr), 0);
+    TEST_EXPECT(strcmp(tr.buf, "{a=[0=1,1={b=n,}2='s',]nums=[0=1,1=2,2=3,]"
+        "bools=[0=t,1=f,]skip={}e={}}"), 0);
+    TEST_EXPECT(tr.max_depth, 3);
+    TEST_EXPECT(tr.nscalars, 8);
+
+    /* stopped by a callback, only scalars, a frozen document */
+    memset(&tr, 0, sizeof(tr));
+    tr.stop_at = 3;
+    TEST_EXPECT(JSON_WALK(json_obj, &scalars, &tr), JSON_WALK_STOP);
+    TEST_EXPECT(strcmp(tr.buf, "0=1,b=n,2='s',"), 0);
+    TEST_EXPECT(JSON_FREEZE(json_obj), 0);
+    memset(&tr, 0, sizeof(tr));
+    TEST_EXPECT(JSON_WALK(json_obj, &scalars, &tr), 0);
+    TEST_EXPECT(tr.nscalars, 9);
+
+    /* a scalar document */
+    memset(&tr, 0, sizeof(tr));
+    TEST_EXPECT(JSON_WALK(json_num, &visitor, &tr), 0);
+    TEST_EXPECT(strcmp(tr.buf, "5,"), 0);
+
+    /* nesting deeper than the stack starts with */
+    for (i = 0; i < 100; i++) {
+        json_sub = JSON_ARRAY_PTR();
+        json_sub->add_move(json_sub, -1, json_arr);
+        FREE_JSON(json_arr);
+        json_arr = json_sub;
+    }
+    memset(&tr, 0, sizeof(tr));
+    TEST_EXPECT(JSON_WALK(json_arr, &visitor, &tr), 0);
+    TEST_EXPECT(tr.max_depth, 100);
+
+    FREE_JSON(json_obj);
+    FREE_JSON(json_arr);
+    FREE_JSON(json_num);
+}
+
+static void expect_json_str(const void* json, const char* expected)
+{
+    int len;
+    char* str = NULL;
+
+    JSON_STRINGIFY(json, &str, &len);
+    TEST_EXPECT(strcmp(str, expected), 0);
+    free(str);
+}
+
+void test_json_object_patch(void)
+{
+    JSONArray* patch;
+    JSONArray* json_ops = JSON_ARRAY_PTR();
+    JSONObject* json_a = JSON_OBJECT_PTR();
+    JSONObject* json_b = JSON_OBJECT_PTR();
+    JSONObject* json_copy;
+    JSONObject* json_sub = JSON_OBJECT_PTR();
+    JSONNumber* json_num = JSON_NUMBER_PTR(1);
+    const char* b = "{\"name\":\"b\",\"n\":1,\"tags\":[\"x\",\"w\",\"y\",\"z\"],"
+        "\"sub\":{\"k\":true,\"new\":[1]},\"nums\":[1,2,4],\"extra\":{}}";
+
+    TEST_EXPECT(JSON_PARSE("{\"name\":\"a\",\"n\":1,\"tags\":[\"x\",\"y\",\"z\"],"
+        "\"sub\":{\"k\":true,\"gone\":null},\"nums\":[1,2,3,4]}", json_a), 0);
+    TEST_EXPECT(JSON_PARSE(b, json_b), 0);
+
+    /* members replaced, removed and added, arrays past common head and tail */
+    patch = JSON_DIFF(json_a, json_b);
+    expect_json_str(patch, "[{\"op\":\"replace\",\"path\":\"/name\",\"value\":\"b\"},"
+        "{\"op\":\"add\",\"path\":\"/tags/1\",\"value\":\"w\"},"
+        "{\"op\":\"remove\",\"path\":\"/sub/gone\"},"
+        "{\"op\":\"add\",\"path\":\"/sub/new\",\"value\":[1]},"
+        "{\"op\":\"remove\",\"path\":\"/nums/2\"},"
+        "{\"op\":\"add\",\"path\":\"/extra\",\"value\":{}}]");
+
+    /* the patch turns a into b, a copy of a is left as it was */
+    json_copy = JSON_OBJECT_COPY_PTR(json_a);
+    TEST_EXPECT(JSON_PATCH_APPLY(json_a, patch), 0);
+    expect_json_str(json_a, b);
+    TEST_EXPECT(strcmp(json_copy->get_str_ref(json_copy, "name"), "a"), 0);
+    FREE_JSON(patch);
+    patch = JSON_DIFF(json_a, json_b);
+    expect_json_str(patch, "[]");
+    FREE_JSON(patch);
+
+    /* a copy shares all it does not modify, escaped keys */
+    FREE_JSON(json_copy);
+    json_copy = JSON_OBJECT_COPY_PTR(json_a);
+    json_sub->add_num(json_sub, "m~n/", 1);
+    json_copy->set(json_copy, "sub", json_sub);
+    patch = JSON_DIFF(json_a, json_copy);
+    expect_json_str(patch, "[{\"op\":\"remove\",\"path\":\"/sub/k\"},"
+        "{\"op\":\"remove\",\"path\":\"/sub/new\"},"
+        "{\"op\":\"add\",\"path\":\"/sub/m~0n~1\",\"value\":1}]");
+    FREE_JSON(patch);
+    patch = JSON_DIFF(json_sub, json_num);
+    expect_json_str(patch, "[{\"op\":\"replace\",\"path\":\"\",\"value\":1}]");
+    FREE_JSON(patch);
+
+    /* test, copy, move and add of a parsed patch */
+    TEST_EXPECT(JSON_PARSE("{\"a\":{\"b\":1},\"c\":[1,2]}", json_b), 0);
+    TEST_EXPECT(JSON_PARSE("[{\"op\":\"test\",\"path\":\"/a/b\",\"value\":1},"
+        "{\"op\":\"copy\",\"from\":\"/a\",\"path\":\"/d\"},"
+        "{\"op\":\"move\",\"from\":\"/c/0\",\"path\":\"/c/-\"},"
+        "{\"op\":\"replace\",\"path\":\"/d/b\",\"value\":2},"
+        "{\"op\":\"add\",\"path\":\"/a~1x\",\"value\":true}]", json_ops), 0);
+    TEST_EXPECT(JSON_PATCH_APPLY(json_b, json_ops), 0);
+    expect_json_str(json_b, "{\"a\":{\"b\":1},\"c\":[2,1],\"d\":{\"b\":2},\"a/x\":true}");
+
+    /* all or nothing */
+    TEST_EXPECT(JSON_PARSE("[{\"op\":\"remove\",\"path\":\"/a\"},"
+        "{\"op\":\"test\",\"path\":\"/c/0\",\"value\":5}]", json_ops), 0);
+    TEST_EXPECT(JSON_PATCH_APPLY(json_b, json_ops), -1);
+    TEST_EXPECT(JSON_PARSE("[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a/b\"}]", json_ops), 0);
+    TEST_EXPECT(JSON_PATCH_APPLY(json_b, json_ops), -1);
+    TEST_EXPECT(JSON_PARSE("[{\"op\":\"add\",\"path\":\"/c/3\",\"value\":0}]", json_ops), 0);
+    TEST_EXPECT(JSON_PATCH_APPLY(json_b, json_ops), -1);
+    TEST_EXPECT(JSON_PARSE("[{\"op\":\"replace\",\"path\":\"\",\"value\":0}]", json_ops), 0);
+    TEST_EXPECT(JSON_PATCH_APPLY(json_b, json_ops), -1);
+    TEST_EXPECT(JSON_PARSE("[{\"op\":\"swap\",\"path\":\"/a\"}]", json_ops), 0);
+    TEST_EXPECT(JSON_PATCH_APPLY(json_b, json_ops), -1);
+    expect_json_str(json_b, "{\"a\":{\"b\":1},\"c\":[2,1],\"d\":{\"b\":2},\"a/x\":true}");
+
+    /* a frozen document is not modified */
+    TEST_EXPECT(JSON_PARSE("[{\"op\":\"remove\",\"path\":\"/a\"}]", json_ops), 0);
+    TEST_EXPECT(JSON_FREEZE(json_b), 0);
+    TEST_EXPECT(JSON_PATCH_APPLY(json_b, json_ops), -1);
+
+    FREE_JSON(json_a);
+    FREE_JSON(json_b);
+    FREE_JSON(json_copy);
+    FREE_JSON(json_sub);
+    FREE_JSON(json_num);
+    FREE_JSON(json_ops);
+}
+
+void test_json_object_freeze(void)
+{
+    int i, len;
+    char key[32];
+    char *str1 = NULL, *str2 = NULL;
+    JSONKey k;
+    JSONObjectIter iter, end;
+    JSONMemoryStats st, st2;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONObject* json_small = JSON_OBJECT_PTR();
+    JSONObject* json_copy;
+    JSONArray* json_arr = JSON_ARRAY_PTR();
+    JSONNumber* json_num = JSON_NUMBER_PTR(7);
+    JSONObject view_small = JSON_OBJECT_DATA(NULL);
+    JSONArray view_arr = JSON_ARRAY_DATA(NULL);
+
+    for (i = 0; i < 1000; i++) {
+        sprintf(key, "key%d", i);
+        json_obj->add_num(json_obj, key, i);
+        json_arr->add_num(json_arr, -1, i);
+    }
+    json_small->add_str(json_small, "name", "small");
+    json_obj->add(json_obj, "small", json_small);
+    json_obj->add(json_obj, "arr", json_arr);
+
+    JSON_STRINGIFY(json_obj, &str1, &len);
+    JSON_MEMORY_USAGE(json_obj, &st);
+    TEST_EXPECT(JSON_IS_FROZEN(json_obj), 0);
+    TEST_EXPECT(JSON_FREEZE(json_obj), 0);
+    TEST_EXPECT(JSON_IS_FROZEN(json_obj), 1);
+    JSON_MEMORY_USAGE(json_obj, &st2);
+    TEST_EXPECT((st2.entries < st.entries), 1);
+
+    /* same content, same order */
+    JSON_STRINGIFY(json_obj, &str2, &len);
+    TEST_EXPECT(strcmp(str1, str2), 0);
+    free(str1);
+    free(str2);
+
+    /* every key in one probe, absent keys are not found */
+    TEST_EXPECT(get_json_object_htab_capacity(json_obj), 1002);
+    for (i = 0; i < 1000; i++) {
+        sprintf(key, "key%d", i);
+        TEST_EXPECT(json_obj->get_num(json_obj, key), i);
+    }
+    TEST_EXPECT(json_obj->get_type(json_obj, "key1000"), 0);
+    TEST_EXPECT(json_obj->get_type(json_obj, "arr"), JSON_TYPE_ARRAY);
+    k = JSON_KEY("key500");
+    TEST_EXPECT(json_obj->get_num_k(json_obj, k), 500);
+    FREE_JSON_KEY(k);
+    iter = json_obj->begin(json_obj);
+    end = json_obj->end(json_obj);
+    i = 0;
+    JSON_OBJECT_FOREACH(iter, end) {
+        i++;
+    }
+    TEST_EXPECT(i, 1002);
+
+    /* nested containers are frozen too */
+    json_obj->get_ref(json_obj, "arr", &view_arr);
+    TEST_EXPECT(JSON_IS_FROZEN(&view_arr), 1);
+    TEST_EXPECT(view_arr.get_num(&view_arr, 999), 999);
+    TEST_EXPECT(view_arr.get_num(&view_arr, -1000), 0);
+    json_obj->get_ref(json_obj, "small", &view_small);
+    TEST_EXPECT(JSON_IS_FROZEN(&view_small), 1);
+    TEST_EXPECT(strcmp(view_small.get_str_ref(&view_small, "name"), "small"), 0);
+
+    /* modifiers fail and leave it as it is */
+    json_obj->add_num(json_obj, "new", 1);
+    json_obj->set_num(json_obj, "key1", 2);
+    json_obj->del(json_obj, "key2");
+    json_obj->add_move(json_obj, "num", json_num);
+    json_obj->reserve(json_obj, 5000);
+    TEST_EXPECT(get_json_object_htab_size(json_obj), 1002);
+    TEST_EXPECT(json_obj->get_num(json_obj, "key1"), 1);
+    TEST_EXPECT(json_obj->get_num(json_obj, "key2"), 2);
+    TEST_EXPECT(json_obj->get_type(json_obj, "new"), 0);
+    TEST_EXPECT(json_num->get(json_num), 7);
+
+    /* and so do they on a copy */
+    json_copy = JSON_OBJECT_COPY_PTR(json_obj);
+    TEST_EXPECT(JSON_IS_FROZEN(json_copy), 1);
+    json_copy->del(json_copy, "key3");
+    TEST_EXPECT(json_copy->get_num(json_copy, "key3"), 3);
+
+    FREE_JSON(json_copy);
+    FREE_JSON(json_num);
+    FREE_JSON(json_arr);
+    FREE_JSON(json_small);
+    FREE_JSON(json_obj);
+}
+
 void test_json_object_traverse_all_elements(void)
 {
     JSONObjectIter iter, end;
@@ -947,7 +2036,7 @@ void test_json_object_traverse_all_elements(void)
     /* traverse */
     iter = json_obj->begin(json_obj);
     end = json_obj->end(json_obj);
-    int i =  2;
+    int i =  0;
     JSON_OBJECT_FOREACH(iter, end)
     {
         char* get;
@@ -955,7 +2044,7 @@ void test_json_object_traverse_all_elements(void)
         get = iter.value.data;
         TEST_EXPECT(strcmp(pchars[i], get), 0);
         printf("value: %s\n", get);
-        i--;
+        i++;
     }
 
     FREE_JSON(json_obj);
@@ -967,16 +2056,19 @@ void test_json_object_stringify(void)
     int len;
     char* str =
     "{"
+        "\"string\":\"this is a string\","
+        "\"number\":2022,"
+        "\"true\":true,"
+        "\"false\":false,"
+        "\"null\":null,"
         "\"object\":"
             "{"
-                "\"false\":false,"
                 "\"string\":\"this is a string\","
+                "\"number\":2022,"
                 "\"true\":true,"
-                "\"null\":null,"
-                "\"number\":2022"
+                "\"false\":false,"
+                "\"null\":null"
             "},"
-        "\"false\":false,"
-        "\"string\":\"this is a string\","
         "\"array\":"
         "["
             "\"string\","
@@ -985,11 +2077,11 @@ void test_json_object_stringify(void)
             "false,"
             "null,"
             "{"
+                "\"string\":\"this is a string\","
+                "\"number\":2022,"
                 "\"true\":true,"
-                "\"null\":null,"
                 "\"false\":false,"
-                "\"number\":2022,"
-                "\"string\":\"this is a string\""
+                "\"null\":null"
             "},"
             "["
                 "\"string\","
@@ -998,17 +2090,14 @@ void test_json_object_stringify(void)
                 "false,"
                 "null,"
                 "{"
+                    "\"string\":\"this is a string\","
+                    "\"number\":2022,"
                     "\"true\":true,"
-                    "\"null\":null,"
                     "\"false\":false,"
-                    "\"number\":2022,"
-                    "\"string\":\"this is a string\""
+                    "\"null\":null"
                 "}"
             "]"
-        "],"
-        "\"true\":true,"
-        "\"null\":null,"
-        "\"number\":2022"
+        "]"
     "}";
     printf("%s\n", str);
 
@@ -1154,8 +2243,116 @@ void test_parse_json_object(void )
     FREE_JSON(sub_json_obj);
 }
 
+void test_json_object_memory_usage(void)
+{
+    int i;
+    char key[32];
+    char str[1000];
+    size_t nallocs, nbytes, nallocs2, nbytes2;
+    JSONMemoryStats st, st2;
+    JSONObject* json_obj = JSON_OBJECT_PTR();
+    JSONArray* json_arr = JSON_ARRAY_PTR();
+
+    json_arr->add_null(json_arr, -1);
+    json_arr->add_null(json_arr, -1);
+    json_obj->add_str(json_obj, "k", "ab");
+    json_obj->add_num(json_obj, "n", 1);
+    json_obj->add(json_obj, "arr", json_arr);
+
+    TEST_EXPECT(JSON_MEMORY_USAGE(json_obj, &st), 0);
+    TEST_EXPECT(st.strings, 3);
+    TEST_EXPECT(st.numbers, sizeof(int));
+    TEST_EXPECT(st.total, st.keys + st.strings + st.entries + st.nodes + st.numbers + st.headers);
+
+    /* 3 more bytes of key, no more entries in a small table */
+    json_obj->del(json_obj, "k");
+    json_obj->add_str(json_obj, "kkkk", "ab");
+    JSON_MEMORY_USAGE(json_obj, &st2);
+    TEST_EXPECT(st2.keys, st.keys + 3);
+    TEST_EXPECT(st2.entries, st.entries);
+
+    /* empty slots of a hash table */
+    for (i = 0; i < 9; i++) {
+        sprintf(key, "%d", i);
+        json_obj->add_null(json_obj, key);
+    }
+    JSON_MEMORY_USAGE(json_obj, &st2);
+    TEST_EXPECT((st2.entries > st.entries), 1);
+
+    /* reserved nodes of a list: 2 items and 1 sentinel, then 10 and 1 */
+    JSON_MEMORY_USAGE(json_arr, &st);
+    json_arr->reserve(json_arr, 10);
+    JSON_MEMORY_USAGE(json_arr, &st2);
+    TEST_EXPECT(st2.nodes * 3, st.nodes * 11);
+
+    /* global counters follow a large string */
+    memset(str, 'x', sizeof(str) - 1);
+    str[sizeof(str) - 1] = '\0';
+    JSON_MEMORY_LIVE(&nallocs, &nbytes);
+    json_obj->set_str(json_obj, "n", str);
+    JSON_MEMORY_LIVE(&nallocs2, &nbytes2);
+    TEST_EXPECT((nbytes2 >= nbytes + sizeof(str) - sizeof(int)), 1);
+    json_obj->del(json_obj, "n");
+    JSON_MEMORY_LIVE(&nallocs2, &nbytes2);
+    TEST_EXPECT((nbytes2 < nbytes), 1);
+    TEST_EXPECT((nallocs2 <= nallocs), 1);
+
+    FREE_JSON(json_arr);
+    FREE_JSON(json_obj);
+}
+
+/* only for test, a counting allocator */
+static int g_test_allocs, g_test_frees;
+
+static void *test_alloc(void *ctx, size_t size)
+{
+    *(int *)ctx += 1;
+    g_test_allocs++;
+    return malloc(size);
+}
+
+static void *test_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    *(int *)ctx += 1;
+    return realloc(ptr, new_size);
+}
+
+static void test_free(void *ctx, void *ptr)
+{
+    g_test_frees++;
+    free(ptr);
+}
+
+void test_json_object_allocator(void)
+{
+    int calls = 0, len;
+    char *str;
+    JSONObject* json_obj;
+
+    TEST_EXPECT(JSON_SET_ALLOCATOR(test_alloc, NULL, NULL, &calls), -1);
+    TEST_EXPECT(JSON_SET_ALLOCATOR(test_alloc, test_realloc, test_free, &calls), 0);
+
+    /* every allocation of build, parse and stringify goes to the hook */
+    json_obj = JSON_OBJECT_PTR();
+    /* memory of the hook can't go back to libc */
+    TEST_EXPECT(JSON_SET_ALLOCATOR(NULL, NULL, NULL, NULL), -1);
+    json_obj->add_str(json_obj, "allocator-name", "counting");
+    json_obj->add_num(json_obj, "allocator-calls", 1);
+    TEST_EXPECT(JSON_PARSE("{\"allocator-list\":[1,2,{\"allocator-x\":null}]}", json_obj), 0);
+    JSON_STRINGIFY(json_obj, &str, &len);
+    TEST_EXPECT(strcmp(str, "{\"allocator-list\":[1,2,{\"allocator-x\":null}]}"), 0);
+    test_free(NULL, str);
+    FREE_JSON(json_obj);
+
+    TEST_EXPECT((calls > 0), 1);
+    TEST_EXPECT(g_test_allocs, g_test_frees);
+    TEST_EXPECT(JSON_SET_ALLOCATOR(NULL, NULL, NULL, NULL), 0);
+}
+
 int main(int argc, char* argv[])
 {
+    /* first: the allocator is set before the library holds memory */
+    test_json_object_allocator();
     test_json_object_create_and_remove();
     test_json_object_set_and_get_json_string();
     test_json_object_set_and_get_json_number();
@@ -1172,9 +2369,30 @@ int main(int argc, char* argv[])
     test_json_object_add_json_object();
     test_json_object_add_json_array();
     test_json_object_delete_json();
+    test_json_object_delete_in_clusters();
+    test_json_object_small_to_hashed();
+    test_json_object_reserve();
+    test_json_object_shrink();
+    test_json_object_shared_keys();
+    test_json_object_key_handle();
+    test_json_object_key_lengths();
+    test_json_object_hash_flooding();
+    test_json_object_get_type();
+    test_json_object_move();
+    test_json_object_copy_on_write();
+    test_json_object_handle();
+    test_json_object_freeze();
+    test_json_object_get_many();
+    test_json_object_pointer();
+    test_json_object_path();
+    test_json_object_walk();
+    test_json_object_patch();
     test_json_object_traverse_all_elements();
     test_json_object_stringify();
     test_parse_json_object();
+    test_parse_json_object_of_same_shape();
+    test_parse_json_object_after_wide();
+    test_json_object_memory_usage();
     printf("All tests pass\n");
     return 0;
 }
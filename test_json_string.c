@@ -36,16 +36,24 @@ void test_json_string_create_and_remove(void)
 void test_json_string_set_and_get(void)
 {
     char* get = NULL;
+    size_t nallocs, nbytes, nallocs2, nbytes2;
     JSONString* json = JSON_STRING_PTR("some characters");
 
     /* set */
     json->set(json, "another characters");
     TEST_EXPECT(strcmp(get_json_data(json), "another characters"), 0);
 
-    /* get */
+    /* get, the copy is the caller's and leaves the live count */
+    JSON_MEMORY_LIVE(&nallocs, &nbytes);
     get = json->get(json);
     TEST_EXPECT(strcmp(get, "another characters"), 0);
     free(get);
+    JSON_MEMORY_LIVE(&nallocs2, &nbytes2);
+    TEST_EXPECT(nallocs2, nallocs);
+    TEST_EXPECT(nbytes2, nbytes);
+
+    /* borrowed chars are the data itself */
+    TEST_EXPECT(json->get_ref(json), get_json_data(json));
 
     /* set NULL-Terminated as string */
     json->set(json, "");